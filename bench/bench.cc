@@ -0,0 +1,514 @@
+// throughput of the paths that avoid building or walking a whole tree, each
+// next to the way it would be done otherwise. `meson test --benchmark -v`
+// runs every section, or run the executable with the names of the sections
+// to run. the numbers only mean something with -Dbuildtype=release.
+
+#include <osmium-html/columnar.hh>
+#include <osmium-html/encoding.hh>
+#include <osmium-html/frozen_document.hh>
+#include <osmium-html/link_extractor.hh>
+#include <osmium-html/parser.hh>
+#include <osmium-html/stream.hh>
+#include <osmium-html/text_extractor.hh>
+#include <osmium-html/url.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// results are added up here, so that the work can't be optimized away
+size_t sink = 0;
+
+// indented markup with the usual mix of blocks, links, images, inline
+// formatting, character references and a script, one record per item
+std::string generate_page(size_t records) {
+  std::string page = "<!DOCTYPE html>\n<html>\n<head>\n"
+                     "  <meta charset=\"utf-8\">\n"
+                     "  <title>Items</title>\n"
+                     "  <script>var items = [1, 2, 3];</script>\n"
+                     "</head>\n<body>\n";
+  for (size_t i = 0; i < records; i++) {
+    std::string id = std::to_string(i);
+    page += "  <div class=\"record\">\n"
+            "    <h2><a href=\"/item/" +
+            id + "\">Item " + id +
+            "</a></h2>\n"
+            "    <p>Some <b>bold</b> text &amp; more, see <a "
+            "href=\"https://example.com/x?i=" +
+            id +
+            "#top\">this link</a>.</p>\n"
+            "    <img src=\"/img/" +
+            id + ".png\" srcset=\"/img/" + id +
+            "@2x.png 2x\" alt=\"\">\n"
+            "    <ul>\n      <li>one</li>\n      <li>two</li>\n    </ul>\n"
+            "  </div>\n";
+  }
+  page += "</body>\n</html>\n";
+  return page;
+}
+
+// the fastest of a few runs, in seconds
+template <typename F> double best_of(F &&run) {
+  constexpr int runs = 5;
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < runs; i++) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+void report(std::string_view what, double seconds, size_t bytes) {
+  std::printf("  %-36.*s %9.2f ms %9.1f MB/s\n", static_cast<int>(what.size()),
+              what.data(), seconds * 1e3,
+              static_cast<double>(bytes) / seconds / 1e6);
+}
+
+void report_rate(std::string_view what, double seconds, size_t count,
+                 std::string_view unit) {
+  std::printf("  %-36.*s %9.2f ms %9.2f M %.*s/s\n",
+              static_cast<int>(what.size()), what.data(), seconds * 1e3,
+              static_cast<double>(count) / seconds / 1e6,
+              static_cast<int>(unit.size()), unit.data());
+}
+
+// counts what is written to it and throws it away
+class CountingBuffer : public std::streambuf {
+public:
+  [[nodiscard]] size_t count() const { return m_count; }
+
+protected:
+  std::streamsize xsputn(const char * /*data*/, std::streamsize size) override {
+    m_count += static_cast<size_t>(size);
+    return size;
+  }
+  int_type overflow(int_type c) override {
+    m_count++;
+    return c;
+  }
+
+private:
+  size_t m_count = 0;
+};
+
+// every text node's content, in document order
+void collect_text(const NodePtr &root, std::string &out) {
+  std::vector<const Node *> stack = {root.get()};
+  while (!stack.empty()) {
+    const auto *node = stack.back();
+    stack.pop_back();
+    if (!node->is_element()) {
+      out += static_cast<const TextNode *>(node)->content();
+      continue;
+    }
+    const auto &children = static_cast<const Element *>(node)->children();
+    for (auto it = children.rbegin(); it != children.rend(); ++it) {
+      stack.push_back(it->get());
+    }
+  }
+}
+
+void bench_positions(const std::string &page) {
+  ParseOptions options;
+  auto parse = [&] { sink += parse_document(page, options).source().size(); };
+  report("parse_document()", best_of(parse), page.size());
+
+  options.track_positions = true;
+  report("parse_document(), track_positions", best_of(parse), page.size());
+
+  // the first position() builds the line table, which is timed with it
+  auto last = static_cast<uint32_t>(page.size() - 1);
+  report("parse_document() and a position", best_of([&] {
+           auto document = parse_document(page, options);
+           sink += document.position(last).line;
+         }),
+         page.size());
+}
+
+void bench_text(const std::string &page) {
+  TextExtractor extractor;
+  report("TextExtractor::extract()", best_of([&] {
+           sink += extractor.extract(page).size();
+         }),
+         page.size());
+
+  std::string text;
+  report("parse_document() and a walk", best_of([&] {
+           auto document = parse_document(page);
+           text.clear();
+           collect_text(document.root(), text);
+           sink += text.size();
+         }),
+         page.size());
+}
+
+// a coroutine that starts right away and counts the tokens of a stream
+struct TokenCounter {
+  struct promise_type {
+    TokenCounter get_return_object() {
+      return TokenCounter(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+
+  explicit TokenCounter(std::coroutine_handle<promise_type> h) : handle(h) {}
+  TokenCounter(TokenCounter &&other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {}
+  TokenCounter(const TokenCounter &) = delete;
+  TokenCounter &operator=(const TokenCounter &) = delete;
+  ~TokenCounter() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+TokenCounter count_tokens(TokenStream &stream) {
+  while (auto token = co_await stream.next()) {
+    sink++;
+  }
+}
+
+// the page cut into chunks that are fed to every stream in turn, the way a
+// server would as data arrives on each of its connections
+template <typename Stream>
+void feed_interleaved(std::vector<std::unique_ptr<Stream>> &streams,
+                      std::string_view page, size_t chunk_size) {
+  for (size_t offset = 0; offset < page.size(); offset += chunk_size) {
+    for (auto &stream : streams) {
+      stream->feed(page.substr(offset, chunk_size));
+    }
+  }
+}
+
+void bench_stream(const std::string &page) {
+  report("parse_document()", best_of([&] {
+           sink += parse_document(page).root() != nullptr;
+         }),
+         page.size());
+
+  for (size_t chunk_size : {size_t{512}, size_t{4096}, size_t{65536}}) {
+    std::string what = "StreamParser, " + std::to_string(chunk_size) +
+                       " byte chunks";
+    report(what, best_of([&] {
+             StreamParser parser;
+             std::string_view rest = page;
+             while (!rest.empty()) {
+               size_t size = std::min(chunk_size, rest.size());
+               parser.feed(rest.substr(0, size));
+               rest.remove_prefix(size);
+             }
+             sink += parser.finish().root() != nullptr;
+           }),
+           page.size());
+  }
+
+  // a small page per connection, fed 512 bytes at a time
+  constexpr size_t connections = 1000;
+  constexpr size_t chunk_size = 512;
+  std::string small = generate_page(20);
+  size_t total = connections * small.size();
+  std::printf("  %zu connections, %zu bytes each\n", connections,
+              small.size());
+
+  report("parse_document(), one after another", best_of([&] {
+           for (size_t i = 0; i < connections; i++) {
+             sink += parse_document(small).root() != nullptr;
+           }
+         }),
+         total);
+
+  report("StreamParser, interleaved", best_of([&] {
+           std::vector<std::unique_ptr<StreamParser>> parsers;
+           for (size_t i = 0; i < connections; i++) {
+             parsers.push_back(std::make_unique<StreamParser>());
+           }
+           feed_interleaved(parsers, small, chunk_size);
+           for (auto &parser : parsers) {
+             sink += parser->finish().root() != nullptr;
+           }
+         }),
+         total);
+
+  report("TokenStream and a coroutine each", best_of([&] {
+           std::vector<std::unique_ptr<TokenStream>> streams;
+           std::vector<TokenCounter> counters;
+           for (size_t i = 0; i < connections; i++) {
+             streams.push_back(std::make_unique<TokenStream>());
+             counters.push_back(count_tokens(*streams.back()));
+           }
+           feed_interleaved(streams, small, chunk_size);
+           for (auto &stream : streams) {
+             stream->finish();
+           }
+         }),
+         total);
+}
+
+void bench_freeze(const std::string &page) {
+  auto document = parse_document(page);
+  std::string text;
+  report("walk of the tree", best_of([&] {
+           text.clear();
+           collect_text(document.root(), text);
+           sink += text.size();
+         }),
+         page.size());
+
+  report("freeze()", best_of([&] { sink += freeze(document).size(); }),
+         page.size());
+
+  // ids are in document order, so a walk is a loop
+  auto frozen = freeze(document);
+  auto walk_frozen = [&](std::string &out) {
+    for (FrozenDocument::NodeId id = 0; id < frozen.size(); id++) {
+      out += frozen.text(id);
+    }
+  };
+  report("walk of the frozen document", best_of([&] {
+           text.clear();
+           walk_frozen(text);
+           sink += text.size();
+         }),
+         page.size());
+
+  // every thread walks the whole document, the rate is of all of them
+  // together. the shared tree is walked twice, once the way collect_text()
+  // does without touching a reference count, and once holding on to each
+  // node the way code that keeps nodes around does, which makes every
+  // thread write to the same counts.
+  unsigned threads = std::max(2U, std::thread::hardware_concurrency());
+  auto in_threads = [&](auto &&walk) {
+    std::vector<std::string> texts(threads);
+    std::vector<std::thread> workers;
+    for (auto &out : texts) {
+      workers.emplace_back([&walk, &out] { walk(out); });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    for (const auto &out : texts) {
+      sink += out.size();
+    }
+  };
+  std::string label = std::to_string(threads) + " threads: ";
+  report(label + "walk of the tree", best_of([&] {
+           in_threads([&](std::string &out) {
+             collect_text(document.root(), out);
+           });
+         }),
+         page.size() * threads);
+  report(label + "walk holding each node", best_of([&] {
+           in_threads([&](std::string &out) {
+             std::vector<NodePtr> stack = {document.root()};
+             while (!stack.empty()) {
+               NodePtr node = std::move(stack.back());
+               stack.pop_back();
+               if (!node->is_element()) {
+                 out += static_cast<const TextNode &>(*node).content();
+                 continue;
+               }
+               const auto &children =
+                   static_cast<const Element &>(*node).children();
+               stack.insert(stack.end(), children.rbegin(), children.rend());
+             }
+           });
+         }),
+         page.size() * threads);
+  report(label + "walk of frozen document",
+         best_of([&] { in_threads(walk_frozen); }), page.size() * threads);
+}
+
+void bench_columnar(const std::string &page) {
+  auto document = parse_document(page);
+  size_t nodes = freeze(document).size();
+  CountingBuffer buffer;
+  std::ostream out(&buffer);
+  report_rate("ColumnarWriter::add() and flush()", best_of([&] {
+                ColumnarWriter writer(out);
+                writer.add(document);
+                writer.flush();
+              }),
+              nodes, "nodes");
+  sink += buffer.count();
+}
+
+void bench_decode(const std::string &page) {
+  // the page is ASCII, each of these decodes to something a little different
+  std::string latin1 = page;
+  std::replace(latin1.begin(), latin1.end(), 'e', '\xE9');
+  std::string utf16 = "\xFF\xFE";
+  for (char c : page) {
+    utf16 += c;
+    utf16 += '\0';
+  }
+
+  struct Input {
+    std::string_view what;
+    const std::string &bytes;
+  };
+  std::string decoded;
+  for (const auto &input : {Input{"UTF-8, validated only", page},
+                            Input{"windows-1252", latin1},
+                            Input{"UTF-16LE", utf16}}) {
+    report(input.what, best_of([&] {
+             auto sniffed = sniff(input.bytes);
+             sink += decode_to_utf8(input.bytes, sniffed, decoded).size();
+           }),
+           input.bytes.size());
+  }
+}
+
+// the href and src attributes LinkExtractor looks at, resolved and without
+// duplicates, the way it would be done on a parsed document. srcset is left
+// out, which only makes this side faster.
+size_t collect_links(const NodePtr &root, std::string_view document_url,
+                     std::unordered_set<std::string> &seen) {
+  seen.clear();
+  std::string url;
+  std::vector<const Node *> stack = {root.get()};
+  while (!stack.empty()) {
+    const auto *node = stack.back();
+    stack.pop_back();
+    if (!node->is_element()) {
+      continue;
+    }
+    const auto *element = static_cast<const Element *>(node);
+    for (std::string_view name : {"href", "src"}) {
+      auto it = element->attributes().find(std::string(name));
+      if (it == element->attributes().end()) {
+        continue;
+      }
+      url.clear();
+      resolve_url(document_url, it->second, url);
+      url.resize(std::min(url.size(), url.find('#')));
+      seen.insert(url);
+    }
+    for (const auto &child : element->children()) {
+      stack.push_back(child.get());
+    }
+  }
+  return seen.size();
+}
+
+void bench_links(const std::string &page) {
+  constexpr std::string_view document_url = "https://example.com/items/";
+
+  LinkExtractor extractor;
+  report("LinkExtractor::extract()", best_of([&] {
+           sink += extractor.extract(page, document_url).size();
+         }),
+         page.size());
+
+  std::unordered_set<std::string> seen;
+  report("parse_document() and a walk", best_of([&] {
+           auto document = parse_document(page);
+           sink += collect_links(document.root(), document_url, seen);
+         }),
+         page.size());
+}
+
+// drops every record as soon as it is complete
+class DroppingSink : public SubtreeSink {
+public:
+  DroppingSink() : SubtreeSink({Tag::Div}) {}
+
+  void subtree_complete(ElementPtr /*element*/) override { m_count++; }
+
+private:
+  size_t m_count = 0;
+};
+
+void bench_whitespace(const std::string &page) {
+  struct Mode {
+    std::string_view name;
+    WhitespaceText mode;
+  };
+  for (auto [name, mode] : {Mode{"Keep", WhitespaceText::Keep},
+                            Mode{"Collapse", WhitespaceText::Collapse},
+                            Mode{"Drop", WhitespaceText::Drop}}) {
+    ParseOptions options;
+    options.whitespace_text = mode;
+    auto document = parse_document(page, options);
+    std::printf("  %-36.*s %9zu nodes %9.1f MB\n",
+                static_cast<int>(name.size()), name.data(),
+                freeze(document).size(),
+                static_cast<double>(
+                    document.estimate_memory_usage().total()) /
+                    1e6);
+
+    // fewer nodes make every walk shorter, not only the parse
+    std::string text;
+    report(std::string(name) + ", walk of the tree", best_of([&] {
+             text.clear();
+             collect_text(document.root(), text);
+             sink += text.size();
+           }),
+           page.size());
+
+    std::string what = std::string(name) + ", records dropped as parsed";
+    report(what, best_of([&] {
+             DroppingSink records;
+             options.subtree_sink = &records;
+             sink += parse_document(page, options).root() != nullptr;
+           }),
+           page.size());
+  }
+}
+
+struct Section {
+  std::string_view name;
+  void (*run)(const std::string &page);
+};
+
+constexpr Section sections[] = {
+    {"positions", bench_positions},
+    {"text", bench_text},
+    {"stream", bench_stream},
+    {"freeze", bench_freeze},
+    {"columnar", bench_columnar},
+    {"decode", bench_decode},
+    {"links", bench_links},
+    {"whitespace", bench_whitespace},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string page = generate_page(20000);
+  std::printf("%zu bytes of markup\n", page.size());
+
+  std::vector<std::string_view> wanted(argv + 1, argv + argc);
+  for (const auto &section : sections) {
+    if (!wanted.empty() &&
+        std::find(wanted.begin(), wanted.end(), section.name) == wanted.end()) {
+      continue;
+    }
+    std::printf("%.*s\n", static_cast<int>(section.name.size()),
+                section.name.data());
+    section.run(page);
+  }
+  return sink == 0 ? 1 : 0;
+}
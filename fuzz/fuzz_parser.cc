@@ -0,0 +1,110 @@
+// libFuzzer entry point, built with -Dfuzz=true. the first bytes of the
+// input pick the ParseOptions, the rest is the document:
+//
+//   meson setup build-fuzz -Dfuzz=true && ninja -C build-fuzz
+//   ./build-fuzz/fuzz_parser corpus/
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/tokenizer.hh>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// hands out the option bytes, zeros once they run out
+class OptionBytes {
+public:
+  OptionBytes(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+  uint8_t next() { return m_used < m_size ? m_data[m_used++] : 0; }
+  bool next_bool() { return (next() & 1) != 0; }
+  // mostly unlimited, otherwise small enough to be hit
+  size_t next_limit() {
+    uint8_t byte = next();
+    return byte < 128 ? 0 : static_cast<size_t>(byte - 127);
+  }
+
+  [[nodiscard]] size_t used() const { return m_used; }
+
+private:
+  const uint8_t *m_data;
+  size_t m_size;
+  size_t m_used = 0;
+};
+
+constexpr size_t option_bytes = 12;
+
+// keeps every other record, to exercise both eviction and handing over
+class AlternatingSink : public SubtreeSink {
+public:
+  AlternatingSink() : SubtreeSink({Tag::Div, Tag::P, Tag::Li, Tag::Tr}) {}
+
+  void subtree_complete(ElementPtr element) override {
+    if (m_keep) {
+      m_kept = std::move(element);
+    }
+    m_keep = !m_keep;
+  }
+
+private:
+  ElementPtr m_kept;
+  bool m_keep = false;
+};
+
+class CountingSink : public TokenSink {
+public:
+  void emit(Token & /*token*/) override { m_count++; }
+
+private:
+  size_t m_count = 0;
+};
+
+// through the first token sink callbacks and the feed() buffer boundaries
+void tokenize_in_chunks(std::string_view input, const ParseOptions &options,
+                        size_t chunk_size) {
+  CountingSink sink;
+  Tokenizer tokenizer(sink, options);
+  for (size_t i = 0; i < input.size(); i += chunk_size) {
+    tokenizer.feed(input.substr(i, chunk_size));
+  }
+  tokenizer.finish();
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  OptionBytes bytes(data, size < option_bytes ? size : option_bytes);
+
+  ErrorList errors(16);
+  AlternatingSink subtree_sink;
+
+  ParseOptions options;
+  options.track_positions = bytes.next_bool();
+  options.hash_subtrees = bytes.next_bool();
+  options.error_sink = bytes.next_bool() ? &errors : nullptr;
+  options.subtree_sink = bytes.next_bool() ? &subtree_sink : nullptr;
+  options.whitespace_text = static_cast<WhitespaceText>(bytes.next() % 3);
+  uint8_t encoding = bytes.next();
+  if (encoding <= static_cast<uint8_t>(Encoding::Iso8859_16)) {
+    options.encoding = static_cast<Encoding>(encoding);
+  }
+  options.limits.max_input_size = bytes.next_limit();
+  options.limits.max_attributes = bytes.next_limit();
+  options.limits.max_nodes = bytes.next_limit();
+  options.limits.max_depth = bytes.next_limit();
+  options.limits.max_text_bytes = bytes.next_limit();
+  size_t chunk_size = bytes.next() % 16 + 1;
+
+  std::string input(reinterpret_cast<const char *>(data) + bytes.used(),
+                    size - bytes.used());
+
+  auto document = parse_document(input, options);
+  (void)document.estimate_memory_usage();
+
+  (void)Tokenizer(input, options).parse();
+  tokenize_in_chunks(input, options, chunk_size);
+  return 0;
+}
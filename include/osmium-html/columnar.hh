@@ -0,0 +1,94 @@
+#pragma once
+
+#include "document.hh"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// writes batches of documents as column arrays, for loading into columnar
+// analytics engines.
+//
+// a file is any number of blocks back to back, so more can be appended to an
+// existing file at any time. each block holds whole documents and starts with
+// this header, all integers little-endian:
+//
+//   char     magic[8]              "OSMCOL1\0"
+//   uint32_t document_count        D
+//   uint32_t node_count            N
+//   uint32_t attribute_count       A
+//   uint32_t reserved              0
+//   uint64_t text_bytes
+//   uint64_t attribute_name_bytes
+//   uint64_t attribute_value_bytes
+//
+// followed by these columns, in this order, each padded with zeros to a
+// multiple of 8 bytes:
+//
+//   uint32_t document_nodes[D + 1]  document i is nodes [d[i], d[i + 1])
+//   uint8_t  kind[N]                0 element, 1 text
+//   uint8_t  tag[N]                 the value of the Tag atom, see
+//                                   tag_name(). 0 for text and for elements
+//                                   that have none
+//   uint32_t depth[N]               0 for the root of each document
+//   uint32_t parent[N]              index in the block, 0xFFFFFFFF for roots
+//   uint32_t text_offsets[N + 1]    node i's string is text[t[i], t[i + 1]):
+//                                   the content of a text node, the name of
+//                                   an element without a tag atom, else empty
+//   uint32_t attributes[N + 1]      node i's attributes are [a[i], a[i + 1])
+//   uint32_t attribute_name_offsets[A + 1]
+//   uint32_t attribute_value_offsets[A + 1]
+//   char     text[text_bytes]
+//   char     attribute_names[attribute_name_bytes]
+//   char     attribute_values[attribute_value_bytes]
+//
+// nodes are in document order, so a node's subtree follows it directly, and
+// parents always come before their children. the document root stands for
+// the document itself, as in Document::root().
+class ColumnarWriter {
+public:
+  // a block is written once it holds this many nodes
+  static constexpr size_t default_block_nodes = size_t{1} << 20;
+
+  explicit ColumnarWriter(std::ostream &out,
+                          size_t block_nodes = default_block_nodes)
+      : m_out(out), m_block_nodes(block_nodes) {}
+
+  // appends the document to the current block, and writes the block out if
+  // it is full
+  void add(const Document &document);
+  // writes out what is buffered as a block, if anything. returns false if
+  // the stream failed.
+  bool flush();
+
+  [[nodiscard]] size_t buffered_nodes() const { return m_kind.size(); }
+
+private:
+  std::ostream &m_out;
+  size_t m_block_nodes;
+
+  // the columns of the current block. they keep their capacity across
+  // blocks, so a steady stream of documents doesn't allocate.
+  std::vector<uint32_t> m_document_nodes;
+  std::vector<uint8_t> m_kind;
+  std::vector<uint8_t> m_tag;
+  std::vector<uint32_t> m_depth;
+  std::vector<uint32_t> m_parent;
+  std::vector<uint32_t> m_text_offsets;
+  std::vector<uint32_t> m_attributes;
+  std::vector<uint32_t> m_attribute_name_offsets;
+  std::vector<uint32_t> m_attribute_value_offsets;
+  std::string m_text;
+  std::string m_attribute_names;
+  std::string m_attribute_values;
+
+  struct Pending {
+    const Node *node;
+    uint32_t parent;
+    uint32_t depth;
+  };
+  std::vector<Pending> m_stack;
+
+  void write(const void *data, size_t size);
+  template <typename T> void write_column(std::vector<T> &column);
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "dom.hh"
+#include "options.hh"
+#include "source.hh"
+#include <memory>
+#include <string>
+#include <utility>
+
+// estimated heap footprint of a document in bytes, see
+// Document::estimate_memory_usage()
+struct MemoryEstimate {
+  // node objects with their allocation overhead, children and tag names
+  size_t nodes = 0;
+  // attribute maps and their names and values
+  size_t attributes = 0;
+  // the text pool blocks that text nodes point into, each counted once and
+  // in full: besides the contents, that is the room at the end of a block,
+  // text that was left behind when it was merged and copied, and text of
+  // nodes that are gone, e.g. taken by a SubtreeSink, while any other node
+  // keeps the block alive. the reference each node holds is part of nodes.
+  size_t text = 0;
+  // the source and the line table, if it was built
+  size_t source = 0;
+
+  [[nodiscard]] size_t total() const {
+    return nodes + attributes + text + source;
+  }
+};
+
+// https://dom.spec.whatwg.org/#concept-document-quirks
+// picked from the doctype, a document without one is in quirks mode
+enum class QuirksMode {
+  NoQuirks,
+  LimitedQuirks,
+  Quirks,
+};
+
+class Document {
+public:
+  Document(std::string source, NodePtr root)
+      : m_source(std::move(source)), m_root(std::move(root)) {}
+
+  [[nodiscard]] const NodePtr &root() const { return m_root; }
+  // the input as it was tokenized: decoded to UTF-8, cut to max_input_size
+  // and with its newlines normalized
+  [[nodiscard]] const std::string &source() const { return m_source; }
+
+  // the line table is built on first use, so documents that never ask for a
+  // position don't pay for the newline scan
+  [[nodiscard]] const LineTable &line_table() const;
+  [[nodiscard]] SourcePosition position(uint32_t offset) const;
+  [[nodiscard]] SourcePosition position(const Node &node) const;
+
+  // which of ParseOptions::limits cut the document short
+  [[nodiscard]] const LimitsExceeded &limits_exceeded() const {
+    return m_limits_exceeded;
+  }
+  void set_limits_exceeded(const LimitsExceeded &exceeded) {
+    m_limits_exceeded = exceeded;
+  }
+
+  // what the source was decoded from, source() itself is always UTF-8
+  [[nodiscard]] Encoding encoding() const { return m_encoding; }
+  void set_encoding(Encoding encoding) { m_encoding = encoding; }
+
+  [[nodiscard]] QuirksMode quirks_mode() const { return m_quirks_mode; }
+  void set_quirks_mode(QuirksMode mode) { m_quirks_mode = mode; }
+
+  // an estimate, not a count of the allocations: the sizes of the standard
+  // library's allocations are taken from libstdc++'s layout, and what the
+  // allocator adds to each is left out. nodes shared with another document
+  // or kept alive elsewhere are counted as if this one owned them. walks the
+  // whole tree, so this is meant for accounting, not hot paths.
+  [[nodiscard]] MemoryEstimate estimate_memory_usage() const;
+
+private:
+  std::string m_source;
+  NodePtr m_root;
+  mutable std::unique_ptr<LineTable> m_line_table;
+  LimitsExceeded m_limits_exceeded;
+  Encoding m_encoding = Encoding::Utf8;
+  QuirksMode m_quirks_mode = QuirksMode::NoQuirks;
+};
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "source.hh"
+#include "tags.hh"
+#include "text_pool.hh"
+#include <algorithm>
+#include <iterator>
 #include <memory>
 #include <set>
 #include <sstream>
@@ -30,11 +35,25 @@ static std::string escape(const std::string &s) {
   return out;
 }
 
+class Element;
+
 class Node {
 public:
   virtual ~Node() = default;
   [[nodiscard]] virtual bool is_element() const = 0;
   virtual std::string dump(size_t i) = 0;
+
+  [[nodiscard]] SourceRange source_range() const { return m_source_range; }
+  void set_source_range(SourceRange range) { m_source_range = range; }
+
+  // non-owning, null for the root and for detached nodes
+  [[nodiscard]] Element *parent() const { return m_parent; }
+
+private:
+  friend class Element;
+
+  Element *m_parent = nullptr;
+  SourceRange m_source_range;
 };
 
 using NodePtr = std::shared_ptr<Node>;
@@ -43,10 +62,17 @@ class Element : public Node {
 public:
   using Attributes = std::unordered_map<std::string, std::string>;
 
-  explicit Element(std::string name) : m_name(std::move(name)) {}
+  explicit Element(std::string name)
+      : m_name(std::move(name)), m_tag(lookup_tag(m_name)) {}
+  Element(std::string name, Namespace ns)
+      : m_name(std::move(name)), m_tag(lookup_tag(m_name, ns)),
+        m_namespace(ns) {}
 
-  [[nodiscard]] std::string name() const { return m_name; }
+  [[nodiscard]] const std::string &name() const { return m_name; }
+  [[nodiscard]] Tag tag() const { return m_tag; }
+  [[nodiscard]] Namespace ns() const { return m_namespace; }
   [[nodiscard]] Attributes &attributes() { return m_attributes; }
+  [[nodiscard]] const Attributes &attributes() const { return m_attributes; }
   [[nodiscard]] const std::vector<NodePtr> &children() const {
     return m_children;
   }
@@ -57,10 +83,50 @@ public:
     return tags.find(m_name) != tags.end();
   }
 
-  void append(const NodePtr &child) { m_children.emplace_back(child); }
+  void append(const NodePtr &child) {
+    child->m_parent = this;
+    m_children.emplace_back(child);
+  }
+
+  void insert_before(const NodePtr &child, const Node *reference) {
+    auto it = std::find_if(
+        m_children.begin(), m_children.end(),
+        [reference](const NodePtr &n) { return n.get() == reference; });
+    child->m_parent = this;
+    m_children.insert(it, child);
+  }
+
+  void insert_at(size_t index, const NodePtr &child) {
+    child->m_parent = this;
+    m_children.insert(m_children.begin() + static_cast<long>(index), child);
+  }
+
+  void remove(const Node *child) {
+    // from the back, where the child that was just closed is
+    auto it = std::find_if(
+        m_children.rbegin(), m_children.rend(),
+        [child](const NodePtr &n) { return n.get() == child; });
+    if (it != m_children.rend()) {
+      (*it)->m_parent = nullptr;
+      m_children.erase(std::next(it).base());
+    }
+  }
+
+  [[nodiscard]] std::vector<NodePtr> take_children() {
+    for (const auto &child : m_children) {
+      child->m_parent = nullptr;
+    }
+    auto children = std::move(m_children);
+    m_children.clear();
+    return children;
+  }
 
   [[nodiscard]] bool is_element() const override { return true; }
 
+  // see compute_subtree_hash(), 0 if it wasn't computed
+  [[nodiscard]] uint64_t subtree_hash() const { return m_subtree_hash; }
+  void set_subtree_hash(uint64_t hash) { m_subtree_hash = hash; }
+
   std::string dump(size_t i) override {
     std::stringstream ss;
     ss << std::string(2 * i, ' ') << "- " << m_name;
@@ -76,28 +142,40 @@ public:
 
 private:
   std::string m_name;
+  Tag m_tag;
+  Namespace m_namespace = Namespace::Html;
   Attributes m_attributes;
   std::vector<NodePtr> m_children;
+  uint64_t m_subtree_hash = 0;
 };
 
 using ElementPtr = std::shared_ptr<Element>;
 
+// the content is not a string of its own but points into storage shared with
+// other nodes, usually a TextPool block that the node keeps alive
 class TextNode : public Node {
 public:
-  explicit TextNode(std::string content) : m_content(std::move(content)) {}
-
-  [[nodiscard]] std::string content() const { return m_content; }
+  explicit TextNode(std::string_view content)
+      : m_text(TextPool(content.size()).store(content)) {}
+  explicit TextNode(TextPool::Text text) : m_text(std::move(text)) {}
+
+  [[nodiscard]] std::string_view content() const { return m_text.content; }
+  [[nodiscard]] const TextPool::Text &text() const { return m_text; }
+  void append(std::string_view s, TextPool &pool) {
+    m_text = pool.append(m_text, s);
+  }
 
   [[nodiscard]] bool is_element() const override { return false; }
 
   std::string dump(size_t i) override {
     std::stringstream ss;
-    ss << std::string(2 * i, ' ') << "- \"" + escape(m_content) << "\"\n";
+    ss << std::string(2 * i, ' ') << "- \"" + escape(std::string(content()))
+       << "\"\n";
     return ss.str();
   }
 
 private:
-  std::string m_content;
+  TextPool::Text m_text;
 };
 
 using TextNodePtr = std::shared_ptr<TextNode>;
\ No newline at end of file
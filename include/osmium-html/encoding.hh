@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// https://encoding.spec.whatwg.org/#names-and-labels
+// the encodings the parser can decode. every label of iso-8859-1 and ascii
+// means windows-1252, as in browsers.
+enum class Encoding : uint8_t {
+  Utf8,
+  Utf16Le,
+  Utf16Be,
+  Windows1252,
+  Iso8859_2,
+  Iso8859_3,
+  Iso8859_4,
+  Iso8859_5,
+  Iso8859_6,
+  Iso8859_7,
+  Iso8859_8,
+  Iso8859_10,
+  Iso8859_13,
+  Iso8859_14,
+  Iso8859_15,
+  Iso8859_16,
+};
+
+// https://encoding.spec.whatwg.org/#concept-encoding-get
+// the encoding with this label, e.g. "latin1" or " UTF-8", ignoring case and
+// surrounding whitespace
+[[nodiscard]] std::optional<Encoding> lookup_encoding(std::string_view label);
+// the canonical name, e.g. "windows-1252"
+[[nodiscard]] std::string_view encoding_name(Encoding encoding);
+
+// the code points of the bytes 0x80 to 0xFF, U+FFFD where a byte means
+// nothing. null for the encodings that are not single-byte.
+[[nodiscard]] const std::array<uint16_t, 128> *
+single_byte_index(Encoding encoding);
+
+// https://html.spec.whatwg.org/multipage/parsing.html#determining-the-character-encoding
+// picks the encoding of a document from, in this order, a byte order mark,
+// the caller's hint (e.g. the charset of a Content-Type header), a <meta>
+// in the first 1024 bytes and finally the content itself: UTF-8 if it is
+// valid UTF-8, windows-1252 otherwise.
+[[nodiscard]] Encoding
+sniff_encoding(std::string_view input,
+               std::optional<Encoding> hint = std::nullopt);
+
+// sniff_encoding(), and whether it had to check that the input is valid
+// UTF-8 to get there and found it was, so that decoding doesn't check again
+struct SniffResult {
+  Encoding encoding = Encoding::Utf8;
+  bool valid_utf8 = false;
+};
+[[nodiscard]] SniffResult sniff(std::string_view input,
+                                std::optional<Encoding> hint = std::nullopt);
+
+// https://html.spec.whatwg.org/multipage/parsing.html#prescan-a-byte-stream-to-determine-its-encoding
+// the encoding a <meta charset> or <meta http-equiv=content-type> in the
+// first 1024 bytes declares, if any
+[[nodiscard]] std::optional<Encoding> prescan_encoding(std::string_view input);
+
+// whether the input is well-formed UTF-8, i.e. no overlong forms, surrogates
+// or truncated sequences. checks 16 bytes at a time where the CPU allows.
+[[nodiscard]] bool is_valid_utf8(std::string_view input);
+
+// https://encoding.spec.whatwg.org/#decode
+// turns the input into UTF-8, dropping a byte order mark and replacing
+// malformed sequences with U+FFFD. valid UTF-8 is returned as a view of the
+// input without being copied, anything else is decoded into `buffer` and the
+// result points there.
+[[nodiscard]] std::string_view decode_to_utf8(std::string_view input,
+                                              Encoding encoding,
+                                              std::string &buffer);
+// the same, for input that sniff() looked at
+[[nodiscard]] std::string_view decode_to_utf8(std::string_view input,
+                                              const SniffResult &sniffed,
+                                              std::string &buffer);
+
+// the length of the longest prefix of the input that doesn't end in the
+// middle of a character, for input that was cut off at an arbitrary byte.
+// decoding a cut character would turn it into U+FFFD, and for UTF-8 keep
+// sniff() from seeing that the input is valid.
+[[nodiscard]] size_t character_boundary(std::string_view input,
+                                        Encoding encoding);
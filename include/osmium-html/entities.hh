@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string_view>
+
+// https://html.spec.whatwg.org/multipage/named-characters.html
+// the UTF-8 replacement text for a reference name without the leading '&',
+// e.g. "amp;" or the legacy "amp". empty if there is no such reference.
+[[nodiscard]] std::string_view
+lookup_named_character_reference(std::string_view name);
+
+// the longest name in the table, including its ';'
+constexpr size_t max_character_reference_name_length = 32;
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parse-errors
+enum class ParseErrorCode : uint8_t {
+  AbruptClosingOfEmptyComment,
+  AbruptDoctypePublicIdentifier,
+  AbruptDoctypeSystemIdentifier,
+  AbsenceOfDigitsInNumericCharacterReference,
+  CdataInHtmlContent,
+  CharacterReferenceOutsideUnicodeRange,
+  ControlCharacterReference,
+  DuplicateAttribute,
+  EndTagWithAttributes,
+  EndTagWithTrailingSolidus,
+  EofBeforeTagName,
+  EofInCdata,
+  EofInComment,
+  EofInDoctype,
+  EofInScriptHtmlCommentLikeText,
+  EofInTag,
+  IncorrectlyClosedComment,
+  IncorrectlyOpenedComment,
+  InvalidCharacterSequenceAfterDoctypeName,
+  InvalidFirstCharacterOfTagName,
+  MissingAttributeValue,
+  MissingDoctypeName,
+  MissingDoctypePublicIdentifier,
+  MissingDoctypeSystemIdentifier,
+  MissingEndTagName,
+  MissingQuoteBeforeDoctypePublicIdentifier,
+  MissingQuoteBeforeDoctypeSystemIdentifier,
+  MissingSemicolonAfterCharacterReference,
+  MissingWhitespaceAfterDoctypePublicKeyword,
+  MissingWhitespaceAfterDoctypeSystemKeyword,
+  MissingWhitespaceBeforeDoctypeName,
+  MissingWhitespaceBetweenAttributes,
+  MissingWhitespaceBetweenDoctypePublicAndSystemIdentifiers,
+  NestedComment,
+  NonVoidHtmlElementStartTagWithTrailingSolidus,
+  NoncharacterCharacterReference,
+  NullCharacterReference,
+  SurrogateCharacterReference,
+  UnexpectedCharacterAfterDoctypeSystemIdentifier,
+  UnexpectedCharacterInAttributeName,
+  UnexpectedCharacterInUnquotedAttributeValue,
+  UnexpectedEqualsSignBeforeAttributeName,
+  UnexpectedNullCharacter,
+  UnexpectedQuestionMarkInsteadOfTagName,
+  UnexpectedSolidusInTag,
+  UnknownNamedCharacterReference,
+};
+
+// the error code as written in the spec, e.g. "eof-in-tag"
+[[nodiscard]] std::string_view to_string(ParseErrorCode code);
+
+struct ParseError {
+  ParseErrorCode code;
+  // byte offset of the input character the error was reported at. the tree
+  // builder only knows offsets with ParseOptions::track_positions, without
+  // it its errors have SourceRange::invalid_offset.
+  uint32_t offset;
+};
+
+// parse errors are never fatal. the tokenizer and parser recover as the spec
+// describes and only report the error here.
+//
+// every error the spec lists for the tokenizer is reported, except those of
+// the input stream preprocessing such as control-character-in-input-stream.
+// of the tree construction errors, only a trailing solidus on a non-void
+// element is: the tree builder recovers from misnested and unexpected tags
+// without saying so.
+class ErrorSink {
+public:
+  virtual ~ErrorSink() = default;
+  virtual void report(const ParseError &error) = 0;
+};
+
+// keeps up to `limit` errors and counts the rest
+class ErrorList : public ErrorSink {
+public:
+  explicit ErrorList(size_t limit = 1024) : m_limit(limit) {}
+
+  void report(const ParseError &error) override {
+    if (m_errors.size() < m_limit) {
+      m_errors.push_back(error);
+    }
+    m_count++;
+  }
+
+  [[nodiscard]] const std::vector<ParseError> &errors() const {
+    return m_errors;
+  }
+  [[nodiscard]] size_t count() const { return m_count; }
+
+private:
+  size_t m_limit;
+  size_t m_count = 0;
+  std::vector<ParseError> m_errors;
+};
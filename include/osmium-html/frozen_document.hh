@@ -0,0 +1,108 @@
+#pragma once
+
+#include "document.hh"
+#include "source.hh"
+#include "tags.hh"
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// an immutable copy of a parsed document, see freeze(). nodes are numbered in
+// document order and refer to each other by index, so there are no reference
+// counts to update while reading, and every subtree is a contiguous range of
+// ids. nothing is computed lazily, which makes it safe to read from any
+// number of threads at once.
+class FrozenDocument {
+public:
+  using NodeId = uint32_t;
+  static constexpr NodeId no_node = std::numeric_limits<NodeId>::max();
+
+  struct Attribute {
+    std::string_view name;
+    std::string_view value;
+  };
+
+  // the root element, which stands for the document itself
+  [[nodiscard]] NodeId root() const { return 0; }
+  [[nodiscard]] size_t size() const { return m_nodes.size(); }
+
+  [[nodiscard]] bool is_element(NodeId id) const {
+    return m_nodes[id].is_element;
+  }
+  [[nodiscard]] Tag tag(NodeId id) const { return m_nodes[id].tag; }
+  // empty for text
+  [[nodiscard]] std::string_view name(NodeId id) const {
+    return m_nodes[id].is_element ? m_nodes[id].data : std::string_view();
+  }
+  // empty for elements
+  [[nodiscard]] std::string_view text(NodeId id) const {
+    return m_nodes[id].is_element ? std::string_view() : m_nodes[id].data;
+  }
+  // sorted by name
+  [[nodiscard]] std::span<const Attribute> attributes(NodeId id) const {
+    const auto &node = m_nodes[id];
+    return {m_attributes.data() + node.attributes_begin,
+            node.attributes_end - node.attributes_begin};
+  }
+  [[nodiscard]] std::optional<std::string_view>
+  attribute(NodeId id, std::string_view name) const;
+
+  [[nodiscard]] NodeId parent(NodeId id) const { return m_nodes[id].parent; }
+  [[nodiscard]] NodeId first_child(NodeId id) const {
+    return m_nodes[id].first_child;
+  }
+  [[nodiscard]] NodeId next_sibling(NodeId id) const {
+    return m_nodes[id].next_sibling;
+  }
+  // one past the last descendant, so the descendants of `id` are exactly the
+  // ids in (id, subtree_end(id))
+  [[nodiscard]] NodeId subtree_end(NodeId id) const {
+    return m_nodes[id].subtree_end;
+  }
+
+  [[nodiscard]] SourceRange source_range(NodeId id) const {
+    return m_nodes[id].source_range;
+  }
+  // empty unless the document was parsed with track_positions
+  [[nodiscard]] std::string_view source() const { return m_source; }
+  [[nodiscard]] SourcePosition position(NodeId id) const;
+  [[nodiscard]] const LimitsExceeded &limits_exceeded() const {
+    return m_limits_exceeded;
+  }
+
+private:
+  friend FrozenDocument freeze(const Document &document);
+
+  struct Node {
+    // the element name or the text, in m_strings
+    std::string_view data;
+    NodeId parent = no_node;
+    NodeId first_child = no_node;
+    NodeId next_sibling = no_node;
+    NodeId subtree_end = 0;
+    uint32_t attributes_begin = 0;
+    uint32_t attributes_end = 0;
+    SourceRange source_range;
+    Tag tag = Tag::Unknown;
+    bool is_element = false;
+  };
+
+  std::vector<Node> m_nodes;
+  std::vector<Attribute> m_attributes;
+  // every name, value and text, in one allocation that never moves
+  std::unique_ptr<char[]> m_strings;
+  std::string m_source;
+  // built up front, unlike Document's, since it can't be built lazily
+  // without a lock
+  std::optional<LineTable> m_line_table;
+  LimitsExceeded m_limits_exceeded;
+};
+
+// copies a parsed document into a FrozenDocument. the document is left as it
+// is and can be dropped afterwards.
+[[nodiscard]] FrozenDocument freeze(const Document &document);
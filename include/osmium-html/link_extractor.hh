@@ -0,0 +1,63 @@
+#pragma once
+
+#include "options.hh"
+#include "tags.hh"
+#include "tokenizer.hh"
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// the outgoing URLs of a page straight from the tokenizer, without building a
+// tree: a[href], link[href], img[src], script[src], iframe[src] and the
+// candidates of img and source srcset. they are resolved against the first
+// <base href>, or the document's own URL without one, with resolve_url().
+// fragments are dropped, an empty href or src links to the base itself, and
+// every URL is returned once, tagged with the element it was first seen on,
+// in document order.
+//
+// an extractor is meant to be reused, its buffers keep their capacity from one
+// document to the next.
+class LinkExtractor : private TokenSink {
+public:
+  struct Link {
+    std::string_view url;
+    Tag tag;
+  };
+
+  // only the tokenizer's limits apply
+  explicit LinkExtractor(const ParseOptions &options = {})
+      : m_options(options) {}
+
+  // `document_url` is where the page was fetched from. the links are valid
+  // until the next call.
+  std::span<const Link> extract(std::string_view html,
+                                std::string_view document_url);
+
+  // what relative links were resolved against in the last call
+  [[nodiscard]] std::string_view base_url() const { return m_base; }
+
+private:
+  // an attribute value as it was in the page, before it is resolved
+  struct RawLink {
+    size_t offset;
+    size_t length;
+    Tag tag;
+  };
+
+  ParseOptions m_options;
+  std::string m_raw;
+  std::vector<RawLink> m_raw_links;
+  std::string m_base_href;
+  bool m_saw_base = false;
+
+  std::string m_base;
+  std::string m_urls;
+  std::vector<Link> m_links;
+  std::unordered_set<std::string_view> m_seen;
+
+  void emit(Token &token) override;
+  void add(std::string_view value, Tag tag);
+  void add_srcset(std::string_view srcset, Tag tag);
+};
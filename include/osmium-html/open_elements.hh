@@ -0,0 +1,71 @@
+#pragma once
+
+#include "dom.hh"
+#include "tags.hh"
+#include <array>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-stack-of-open-elements
+//
+// index 0 is the html element and top() is the current node. the positions of
+// every tag atom and of every scope boundary are indexed as well, so scope
+// checks compare two indices instead of walking the stack.
+class OpenElementStack {
+public:
+  // https://html.spec.whatwg.org/multipage/parsing.html#has-an-element-in-the-specific-scope
+  enum class Scope {
+    Default,
+    ListItem,
+    Button,
+    Table,
+    Select,
+  };
+
+  [[nodiscard]] bool empty() const { return m_elements.empty(); }
+  [[nodiscard]] size_t size() const { return m_elements.size(); }
+  [[nodiscard]] const ElementPtr &top() const { return m_elements.back(); }
+  [[nodiscard]] const ElementPtr &operator[](size_t i) const {
+    return m_elements[i];
+  }
+
+  void push(const ElementPtr &element);
+  ElementPtr pop();
+  void insert(size_t i, const ElementPtr &element);
+  ElementPtr erase(size_t i);
+  void replace(size_t i, const ElementPtr &element);
+
+  [[nodiscard]] bool contains(Tag tag) const {
+    return !m_positions[static_cast<size_t>(tag)].empty();
+  }
+  [[nodiscard]] bool contains(const Element *element) const {
+    return index_of(element).has_value();
+  }
+  [[nodiscard]] std::optional<size_t> index_of(const Element *element) const;
+  // index of the topmost element with the given tag
+  [[nodiscard]] std::optional<size_t> last_index_of(Tag tag) const;
+
+  [[nodiscard]] bool has_in_scope(Tag tag, Scope scope = Scope::Default) const;
+  [[nodiscard]] bool has_any_in_scope(std::initializer_list<Tag> tags,
+                                      Scope scope = Scope::Default) const;
+  [[nodiscard]] bool has_in_scope(const Element *element,
+                                  Scope scope = Scope::Default) const;
+
+private:
+  static constexpr size_t scope_count = 5;
+
+  std::vector<ElementPtr> m_elements;
+  // ascending stack indices of the elements with each tag atom
+  std::array<std::vector<uint32_t>, static_cast<size_t>(Tag::Count)>
+      m_positions;
+  // ascending stack indices of the boundary elements of each scope
+  std::array<std::vector<uint32_t>, scope_count> m_boundaries;
+
+  void index(size_t i);
+  void unindex(size_t i);
+  void reindex();
+  [[nodiscard]] bool above_boundary(size_t i, Scope scope) const;
+
+  static bool is_scope_boundary(const Element &element, Scope scope);
+};
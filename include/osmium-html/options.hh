@@ -0,0 +1,77 @@
+#pragma once
+
+#include "encoding.hh"
+#include "errors.hh"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+class SubtreeSink;
+
+// limits for untrusted input, 0 means unlimited
+struct ParseLimits {
+  // longer input is truncated before it is tokenized. parse_document() cuts
+  // the raw bytes before sniffing and decoding them, and the decoded UTF-8
+  // again if it came out longer, both times at the start of a character.
+  size_t max_input_size = 0;
+  // attributes past this many on a single tag are dropped
+  size_t max_attributes = 0;
+  // once this many nodes exist, parsing stops as if the input ended there
+  size_t max_nodes = 0;
+  // elements opened deeper than this are attached to the deepest open element
+  // without being pushed, which bounds both the tree depth and every walk of
+  // the stack of open elements. same default as blink.
+  size_t max_depth = 512;
+  // text past this many bytes in total is dropped
+  size_t max_text_bytes = 0;
+};
+
+// which limits were hit while parsing a document
+struct LimitsExceeded {
+  bool input_size = false;
+  bool attributes = false;
+  bool nodes = false;
+  bool depth = false;
+  bool text_bytes = false;
+
+  [[nodiscard]] bool any() const {
+    return input_size || attributes || nodes || depth || text_bytes;
+  }
+};
+
+// what the tree builder does with text that is nothing but whitespace, outside
+// of pre, textarea, script, foreign content and the like where it matters
+enum class WhitespaceText : uint8_t {
+  // kept as it is
+  Keep,
+  // replaced by a single space that all such nodes share, which renders the
+  // same and takes no memory of its own
+  Collapse,
+  // collapsed, and dropped altogether where it touches the start or end of a
+  // block, e.g. between two <div>s or <li>s, where it doesn't render either
+  Drop,
+};
+
+struct ParseOptions {
+  // record the byte range of every token and node. line/column are only
+  // computed on demand, see Document::position()
+  bool track_positions = false;
+  // receives every parse error, may be null
+  ErrorSink *error_sink = nullptr;
+  // compute Element::subtree_hash() as elements are closed, see SubtreeIndex
+  bool hash_subtrees = false;
+  // the encoding the input is known to be in, e.g. from the charset of a
+  // Content-Type header. used by parse_document(), which otherwise sniffs it,
+  // see sniff_encoding(). a byte order mark overrides it.
+  std::optional<Encoding> encoding;
+  // takes closed elements out of the tree as they are completed, may be null
+  SubtreeSink *subtree_sink = nullptr;
+  // Collapse and Drop save most of the text nodes of indented markup. with
+  // Keep, each of those is a node of its own, and the newline and few spaces
+  // it holds take room in a text pool block, where a std::string would have
+  // kept text this short inline. that costs indented pages a few percent of
+  // memory, while every longer text saves an allocation. Collapse points
+  // them all at one static space, see Document::estimate_memory_usage().
+  WhitespaceText whitespace_text = WhitespaceText::Keep;
+  ParseLimits limits;
+};
@@ -1,27 +1,279 @@
 #pragma once
 
+#include "document.hh"
 #include "dom.hh"
+#include "open_elements.hh"
+#include "options.hh"
 #include "tokenizer.hh"
+#include <bitset>
+#include <initializer_list>
 #include <memory>
-#include <stack>
 
-class Parser {
+// gets elements as soon as they are closed, for documents too big to keep in
+// memory whole but made of records, such as <article> or <tr> elements, that
+// are each small enough. see ParseOptions::subtree_sink.
+class SubtreeSink {
 public:
-  explicit Parser(std::vector<Token> tokens) : m_tokens(std::move(tokens)) {}
+  SubtreeSink() = default;
+  // wants the elements with one of these tags
+  SubtreeSink(std::initializer_list<Tag> tags) {
+    for (Tag tag : tags) {
+      m_tags.set(static_cast<size_t>(tag));
+    }
+  }
+  virtual ~SubtreeSink() = default;
+
+  // whether an element that was just closed is handed over. its whole
+  // subtree has been parsed by then, so this can look at its content.
+  [[nodiscard]] virtual bool wants(const Element &element) const {
+    return m_tags.test(static_cast<size_t>(element.tag()));
+  }
+
+  // gets the element after it has been removed from the document, so unless
+  // the sink keeps it, it is freed on return and memory use is bounded by the
+  // largest record rather than the document. a wanted element nested in
+  // another wanted one is handed over first and is gone from the outer one.
+  // the text that follows a removed element is not merged into the text in
+  // front of it, and dropped if it is only whitespace, so that what is left
+  // between the records doesn't grow with them either.
+  // elements that misnested markup takes off the stack of open elements out
+  // of order, like those the adoption agency moves, stay in the document.
+  virtual void subtree_complete(ElementPtr element) = 0;
+
+private:
+  std::bitset<256> m_tags;
+};
+
+// https://html.spec.whatwg.org/multipage/parsing.html#tree-construction
+//
+// either built from all tokens up front and run with parse(), or used as the
+// sink of a Tokenizer, which hands it each token with emit(), and then
+// completed with finish()
+class Parser : public TokenSink {
+public:
+  explicit Parser(const ParseOptions &options = {})
+      : m_root(std::make_shared<Element>("root")), m_limits(options.limits),
+        m_hash_subtrees(options.hash_subtrees),
+        m_subtree_sink(options.subtree_sink),
+        m_whitespace_text(options.whitespace_text),
+        m_error_sink(options.error_sink) {}
+  explicit Parser(std::vector<Token> tokens, const ParseOptions &options = {})
+      : m_tokens(std::move(tokens)), m_root(std::make_shared<Element>("root")),
+        m_limits(options.limits), m_hash_subtrees(options.hash_subtrees),
+        m_subtree_sink(options.subtree_sink),
+        m_whitespace_text(options.whitespace_text),
+        m_error_sink(options.error_sink) {}
 
   std::shared_ptr<Node> parse();
 
+  void emit(Token &t) override;
+  // the tokenizer is told which state to read the content of raw text
+  // elements in, see insert_raw_text_element()
+  bool attach(Tokenizer &tokenizer) override;
+  [[nodiscard]] bool stopped() const override { return m_stopped; }
+  // https://html.spec.whatwg.org/multipage/parsing.html#stop-parsing
+  std::shared_ptr<Node> finish();
+
+  [[nodiscard]] const LimitsExceeded &limits_exceeded() const {
+    return m_limits_exceeded;
+  }
+  [[nodiscard]] QuirksMode quirks_mode() const { return m_quirks_mode; }
+
 private:
+  // https://html.spec.whatwg.org/multipage/parsing.html#the-insertion-mode
+  enum class InsertionMode {
+    Initial,
+    BeforeHtml,
+    BeforeHead,
+    InHead,
+    InHeadNoscript,
+    AfterHead,
+    InBody,
+    Text,
+    InTable,
+    InTableText,
+    InCaption,
+    InColumnGroup,
+    InTableBody,
+    InRow,
+    InCell,
+    InSelect,
+    InSelectInTable,
+    InTemplate,
+    AfterBody,
+    InFrameset,
+    AfterFrameset,
+    AfterAfterBody,
+    AfterAfterFrameset,
+  };
+
+  using Scope = OpenElementStack::Scope;
+
+  // where a new node goes: appended to parent, or inserted before `before`
+  struct InsertionLocation {
+    Element *parent;
+    const Node *before;
+  };
+
   size_t m_current = 0;
   std::vector<Token> m_tokens;
-  std::stack<std::shared_ptr<Element>> m_open_elements;
+  // null when the tokens were collected up front
+  Tokenizer *m_tokenizer = nullptr;
+  const Token *m_current_token = nullptr;
+  // where an EndOfFile token made up by finish() goes
+  SourceRange m_last_token_range;
+  bool m_saw_eof = false;
+  // set once the node limit is hit, the remaining tokens are ignored
+  bool m_stopped = false;
+
+  ElementPtr m_root;
+  ParseLimits m_limits;
+  LimitsExceeded m_limits_exceeded;
+  size_t m_node_count = 0;
+  size_t m_text_bytes = 0;
+  bool m_hash_subtrees;
+  SubtreeSink *m_subtree_sink;
+  WhitespaceText m_whitespace_text;
+  ErrorSink *m_error_sink;
+  // https://html.spec.whatwg.org/multipage/parsing.html#acknowledge-self-closing-flag
+  // set by insert_void_element(), the only way a start tag's trailing
+  // solidus is acknowledged
+  bool m_self_closing_acknowledged = false;
+
+  QuirksMode m_quirks_mode = QuirksMode::NoQuirks;
+  InsertionMode m_mode = InsertionMode::Initial;
+  InsertionMode m_original_mode = InsertionMode::Initial;
+  // https://html.spec.whatwg.org/multipage/parsing.html#stack-of-template-insertion-modes
+  // one entry for each template element on the stack of open elements
+  std::vector<InsertionMode> m_template_modes;
+  ElementPtr m_head;
+  ElementPtr m_form;
+  OpenElementStack m_open_elements;
+  // https://html.spec.whatwg.org/multipage/parsing.html#list-of-active-formatting-elements
+  // null entries are markers
+  std::vector<ElementPtr> m_active_formatting;
+
+  bool m_frameset_ok = true;
+  bool m_foster_parenting = false;
+  bool m_skip_newline = false;
+  // the list of active formatting elements can only change between two
+  // character tokens if something else ran, so reconstruct once per text run
+  bool m_formatting_reconstructed = false;
+
   std::string text;
+  TextPool m_text_pool;
+  SourceRange m_text_range;
+  InsertionLocation m_text_location{};
+  // see index_of_child()
+  struct {
+    const Element *parent = nullptr;
+    const Node *child = nullptr;
+    size_t index = 0;
+  } m_before_hint;
+  // where the element handed to the SubtreeSink last was, given by its parent
+  // and the child that was in front of it. text is not merged across it.
+  struct {
+    const Element *parent = nullptr;
+    const Node *previous = nullptr;
+  } m_hand_over_gap;
+  std::string m_pending_table_text;
+  SourceRange m_pending_table_text_range;
+
+  void process_token(Token &t);
+  void process_in_current_mode(Token &t);
+
+  void handle_initial(Token &t);
+  void handle_before_html(Token &t);
+  void handle_before_head(Token &t);
+  void handle_in_head(Token &t);
+  void handle_in_head_noscript(Token &t);
+  void handle_after_head(Token &t);
+  void handle_in_body(Token &t);
+  void handle_in_body_start_tag(Token &t);
+  void handle_in_body_end_tag(Token &t);
+  void handle_text(Token &t);
+  void handle_in_table(Token &t);
+  void handle_in_table_text(Token &t);
+  void handle_in_caption(Token &t);
+  void handle_in_column_group(Token &t);
+  void handle_in_table_body(Token &t);
+  void handle_in_row(Token &t);
+  void handle_in_cell(Token &t);
+  void handle_in_select(Token &t);
+  void handle_in_select_in_table(Token &t);
+  void handle_in_template(Token &t);
+  void handle_in_foreign_content(Token &t);
+  void handle_after_body(Token &t);
+  void handle_in_frameset(Token &t);
+  void handle_after_frameset(Token &t);
+  void handle_after_after_body(Token &t);
+  void handle_after_after_frameset(Token &t);
+
+  InsertionLocation appropriate_insertion_location(Element *target = nullptr);
+  void insert_node(const NodePtr &node, InsertionLocation location);
+  Node *child_before(const Element &parent, const Node *before);
+  size_t index_of_child(const Element &parent, const Node *child);
+  ElementPtr create_element(const Token &t, Namespace ns = Namespace::Html);
+  ElementPtr insert_element(const Token &t, Namespace ns = Namespace::Html);
+  ElementPtr insert_element(const std::string &name);
+  ElementPtr insert_void_element(const Token &t,
+                                 Namespace ns = Namespace::Html);
+  // elements deeper than max_depth are attached but not pushed, and then
+  // neither switch the insertion mode nor get popped
+  [[nodiscard]] bool was_pushed(const ElementPtr &element) const {
+    return !m_open_elements.empty() &&
+           m_open_elements.top().get() == element.get();
+  }
+  void insert_text(std::string_view data, SourceRange range);
+  void flush_text();
+  [[nodiscard]] bool preserves_whitespace() const;
+  [[nodiscard]] bool drops_whitespace(const Element &parent,
+                                      const Node *previous) const;
+  void drop_collapsed_whitespace(Element &parent, const Node *child);
+  void insert_raw_text_element(const Token &t, TextState state);
+  void switch_tokenizer_to(TextState state);
+  bool allow_node();
+  void invalidate_subtree_hash(Element *element);
+
+  void pop();
+  void close_source_range(Element &element);
+  void hand_over(const ElementPtr &element);
+  void pop_until(Tag tag);
+  void pop_until_any(std::initializer_list<Tag> tags);
+  void remove_from_stack(size_t i);
+  void generate_implied_end_tags(Tag except = Tag::Unknown);
+  void generate_all_implied_end_tags_thoroughly();
+  void close_template_element();
+  void close_p_element();
+  void close_p_element_in_button_scope();
+  void close_cell();
+  void clear_stack_back_to(std::initializer_list<Tag> tags);
+  void reset_insertion_mode();
+
+  void push_active_formatting_element(const ElementPtr &element);
+  void reconstruct_active_formatting_elements();
+  void clear_active_formatting_to_last_marker();
+  std::optional<size_t> active_formatting_index_of(const Element *element);
+  bool run_adoption_agency(Token &t);
+  void handle_any_other_end_tag(Token &t);
+
+  [[nodiscard]] bool uses_foreign_content_rules(const Token &t);
+  static bool is_html_integration_point(const Element &element);
+  static bool is_mathml_text_integration_point(const Element &element);
 
-  static bool is_void_element(const std::string &name);
+  static bool is_special(Tag tag);
+  static bool is_whitespace(char c) {
+    return c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+  }
+  static Token split_leading_whitespace(Token &t);
 
-  std::shared_ptr<Element> current_node() { return m_open_elements.top(); }
+  Element *current_node() {
+    return m_open_elements.empty() ? m_root.get()
+                                   : m_open_elements.top().get();
+  }
   Token &consume() { return m_tokens[m_current++]; }
   [[nodiscard]] bool eof() const { return m_current >= m_tokens.size(); }
 };
 
-std::shared_ptr<Node> parse(const std::string &s);
\ No newline at end of file
+std::shared_ptr<Node> parse(const std::string &s);
+Document parse_document(std::string source, const ParseOptions &options = {});
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// byte range of a token or node in the original input. offsets are 32-bit to
+// keep tokens and nodes small, so positions past 4 GiB are not tracked.
+struct SourceRange {
+  static constexpr uint32_t invalid_offset =
+      std::numeric_limits<uint32_t>::max();
+
+  uint32_t offset = invalid_offset;
+  uint32_t length = 0;
+
+  [[nodiscard]] bool is_valid() const { return offset != invalid_offset; }
+  [[nodiscard]] uint32_t end() const { return offset + length; }
+};
+
+// https://html.spec.whatwg.org/multipage/parsing.html#preprocessing-the-input-stream
+// every CR LF pair and every CR on its own becomes a LF before anything is
+// tokenized, so the tokenizer never sees a CR and source ranges refer to the
+// normalized input.
+//
+// appends `chunk` to `out`. a CR at the end of a chunk is written as a LF
+// right away and remembered in `pending_cr`, so that a LF at the start of
+// the next chunk is dropped.
+void append_normalized_newlines(std::string &out, std::string_view chunk,
+                                bool &pending_cr);
+// the same in place, for input that is complete
+void normalize_newlines(std::string &text);
+
+// 1-based line and column, column counted in bytes
+struct SourcePosition {
+  uint32_t line = 0;
+  uint32_t column = 0;
+};
+
+class LineTable {
+public:
+  explicit LineTable(std::string_view source);
+
+  [[nodiscard]] SourcePosition position(uint32_t offset) const;
+  [[nodiscard]] size_t line_count() const { return m_line_starts.size(); }
+  [[nodiscard]] size_t memory_usage() const {
+    return sizeof(*this) + m_line_starts.capacity() * sizeof(uint32_t);
+  }
+
+private:
+  std::vector<uint32_t> m_line_starts;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "document.hh"
+#include "options.hh"
+#include "parser.hh"
+#include "tokenizer.hh"
+#include <coroutine>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// builds a document from input that arrives in chunks, e.g. from a socket on
+// an event loop. each chunk is parsed as far as it can be right away, and only
+// the input that hasn't been tokenized yet is buffered.
+//
+// unlike parse_document(), this doesn't sniff the encoding or decode: the
+// chunks have to be UTF-8 already, and ParseOptions::encoding is ignored.
+// decode_to_utf8() can convert a body that was buffered whole.
+class StreamParser {
+public:
+  explicit StreamParser(const ParseOptions &options = {})
+      : m_parser(options), m_tokenizer(m_parser, options),
+        m_keep_source(options.track_positions),
+        m_max_input_size(options.limits.max_input_size) {}
+
+  // the tokenizer refers to the parser
+  StreamParser(const StreamParser &) = delete;
+  StreamParser &operator=(const StreamParser &) = delete;
+
+  // ignored once finish() has been called
+  void feed(std::string_view chunk);
+  // the document's source is only kept when positions are tracked, since
+  // that is what Document::position() needs. the document can only be taken
+  // once, calling this again gives an empty one.
+  Document finish();
+
+private:
+  Parser m_parser;
+  Tokenizer m_tokenizer;
+  bool m_keep_source;
+  size_t m_max_input_size;
+  std::string m_source;
+  bool m_source_pending_cr = false;
+  bool m_finished = false;
+};
+
+// tokens of input that arrives in chunks, for a coroutine to co_await one at a
+// time:
+//
+//   while (auto token = co_await stream.next()) { ... }
+//
+// a reader that has used up the tokens so far is suspended, and resumed from
+// feed() or finish() once there are more. the last token is EndOfFile, after
+// which next() gives nullopt. so a single thread can interleave any number of
+// streams without buffering whole bodies.
+class TokenStream : private TokenSink {
+public:
+  explicit TokenStream(const ParseOptions &options = {})
+      : m_tokenizer(*this, options) {}
+
+  TokenStream(const TokenStream &) = delete;
+  TokenStream &operator=(const TokenStream &) = delete;
+
+  // both are ignored once finish() has been called
+  void feed(std::string_view chunk);
+  void finish();
+
+  class NextToken {
+  public:
+    explicit NextToken(TokenStream &stream) : m_stream(stream) {}
+
+    [[nodiscard]] bool await_ready() const {
+      return !m_stream.m_tokens.empty() || m_stream.m_done;
+    }
+    void await_suspend(std::coroutine_handle<> reader) {
+      m_stream.m_reader = reader;
+    }
+    std::optional<Token> await_resume();
+
+  private:
+    TokenStream &m_stream;
+  };
+
+  [[nodiscard]] NextToken next() { return NextToken(*this); }
+
+private:
+  Tokenizer m_tokenizer;
+  std::deque<Token> m_tokens;
+  std::coroutine_handle<> m_reader;
+  // EndOfFile has been emitted
+  bool m_done = false;
+
+  void emit(Token &token) override;
+  void resume_reader();
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "document.hh"
+#include "dom.hh"
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+// https://en.wikipedia.org/wiki/Merkle_tree
+// hash of an element's tag, attributes and children, where child elements
+// contribute their own subtree hash, so equal subtrees hash the same no matter
+// where they are. attributes are unordered in the DOM and are combined order
+// independently. returns 0 if a child element has no hash yet. not meant to
+// resist collisions crafted on purpose.
+[[nodiscard]] uint64_t compute_subtree_hash(const Element &element);
+
+// sets the subtree hash of every element under `root` that doesn't have one
+void fill_subtree_hashes(Element &root);
+
+// finds equal subtrees within a document or across many, by their hash. see
+// ParseOptions::hash_subtrees.
+class SubtreeIndex {
+public:
+  struct Entry {
+    // whatever the caller passed to add()
+    size_t document;
+    const Element *element;
+  };
+
+  // indexes every element of the document that has a subtree hash. the
+  // document has to outlive the index.
+  void add(const Document &document, size_t document_id = 0);
+
+  // every indexed subtree with this hash, in the order they were added
+  [[nodiscard]] std::span<const Entry> find(uint64_t hash) const;
+  [[nodiscard]] std::span<const Entry> find(const Element &element) const {
+    return find(element.subtree_hash());
+  }
+
+  // calls visit(hash, entries) for every hash that occurs more than once
+  template <typename F> void for_each_duplicate(F &&visit) const {
+    for (const auto &[hash, entries] : m_entries) {
+      if (entries.size() > 1) {
+        visit(hash, std::span<const Entry>(entries));
+      }
+    }
+  }
+
+  [[nodiscard]] size_t size() const { return m_entries.size(); }
+
+private:
+  std::unordered_map<uint64_t, std::vector<Entry>> m_entries;
+};
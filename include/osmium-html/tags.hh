@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// atoms for the tag names the tree builder needs to recognize. anything else
+// is Tag::Unknown and has to be compared by name
+enum class Tag : uint8_t {
+  Unknown,
+  A,
+  Address,
+  Applet,
+  Area,
+  Article,
+  Aside,
+  B,
+  Base,
+  Basefont,
+  Bgsound,
+  Big,
+  Blockquote,
+  Body,
+  Br,
+  Button,
+  Caption,
+  Center,
+  Code,
+  Col,
+  Colgroup,
+  Dd,
+  Details,
+  Dialog,
+  Dir,
+  Div,
+  Dl,
+  Dt,
+  Em,
+  Embed,
+  Fieldset,
+  Figcaption,
+  Figure,
+  Font,
+  Footer,
+  Form,
+  Frame,
+  Frameset,
+  H1,
+  H2,
+  H3,
+  H4,
+  H5,
+  H6,
+  Head,
+  Header,
+  Hgroup,
+  Hr,
+  Html,
+  I,
+  Iframe,
+  Image,
+  Img,
+  Input,
+  Keygen,
+  Li,
+  Link,
+  Listing,
+  Main,
+  Marquee,
+  Math,
+  Menu,
+  Meta,
+  Nav,
+  Nobr,
+  Noembed,
+  Noframes,
+  Noscript,
+  Object,
+  Ol,
+  Optgroup,
+  Option,
+  P,
+  Param,
+  Plaintext,
+  Pre,
+  Rb,
+  Rp,
+  Rt,
+  Rtc,
+  Ruby,
+  S,
+  Script,
+  Search,
+  Section,
+  Select,
+  Small,
+  Source,
+  Span,
+  Strike,
+  Strong,
+  Style,
+  Sub,
+  Summary,
+  Sup,
+  Svg,
+  Table,
+  Tbody,
+  Td,
+  Template,
+  Textarea,
+  Tfoot,
+  Th,
+  Thead,
+  Title,
+  Tr,
+  Track,
+  Tt,
+  U,
+  Ul,
+  Wbr,
+  Xmp,
+  Count,
+};
+
+// https://infra.spec.whatwg.org/#namespaces
+// the elements inside <svg> and <math> are in their own namespaces
+enum class Namespace : uint8_t {
+  Html,
+  Svg,
+  MathMl,
+};
+
+[[nodiscard]] Tag lookup_tag(std::string_view name);
+// only the svg and math elements themselves have an atom in their namespace,
+// so that e.g. an svg <a> or <title> is never taken for the html one
+[[nodiscard]] Tag lookup_tag(std::string_view name, Namespace ns);
+[[nodiscard]] std::string_view tag_name(Tag tag);
+// elements that start on a line of their own when rendered
+[[nodiscard]] bool is_block_level(Tag tag);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "options.hh"
+#include "tags.hh"
+#include "tokenizer.hh"
+#include <string>
+#include <string_view>
+
+// readable plain text straight from the tokenizer, without building a tree.
+// script, style, title, template and the rest of head are skipped, block
+// elements start a new line and whitespace is collapsed the way a browser
+// would render it, except inside pre. character references are decoded by
+// the tokenizer.
+//
+// an extractor is meant to be reused, its output buffer keeps its capacity
+// from one document to the next.
+class TextExtractor : private TokenSink {
+public:
+  // only the tokenizer's limits apply
+  explicit TextExtractor(const ParseOptions &options = {})
+      : m_options(options) {}
+
+  // the returned text is valid until the next call
+  std::string_view extract(std::string_view html);
+
+private:
+  // whitespace seen since the last text, written out lazily so that it can
+  // be dropped at the start and end of lines
+  enum class Break {
+    None,
+    Space,
+    Line,
+  };
+
+  ParseOptions m_options;
+  std::string m_text;
+  Break m_pending = Break::None;
+  // the element whose content is being skipped and how deeply it is nested
+  Tag m_skip_tag = Tag::Unknown;
+  size_t m_skip_depth = 0;
+  size_t m_pre_depth = 0;
+  // the start tag just seen was one whose first newline is dropped
+  bool m_skip_newline = false;
+  bool m_in_head = false;
+
+  void emit(Token &token) override;
+  void start_tag(const Token &token);
+  void end_tag(const Token &token);
+  void characters(std::string_view data);
+  void flush_pending();
+
+  static bool is_whitespace(char c) {
+    return c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+  }
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+// text copied into a few large blocks, so that text nodes don't each allocate
+// their own string. every text holds on to its block, so a pool can be
+// destroyed before the nodes using it, and a block is freed once none of its
+// texts are left, e.g. after a SubtreeSink dropped them.
+class TextPool {
+public:
+  struct Text {
+    std::string_view content;
+    std::shared_ptr<const char[]> block;
+    // the room from the start of the content to the end of its block, for
+    // text that append() moved to a block of its own. 0 otherwise.
+    size_t capacity = 0;
+  };
+
+  explicit TextPool(size_t block_size = 16 * 1024) : m_block_size(block_size) {}
+
+  // texts bigger than a quarter block get a block of their own
+  [[nodiscard]] Text store(std::string_view text);
+  // `text` followed by `more`, grown in place if `text` is what was stored
+  // last and there is room behind it, copied otherwise. text that outgrows a
+  // quarter block is copied to a block of its own that is twice as big as
+  // needed, and grown in place from then on as long as nothing else shares
+  // it, so text that is merged over and over again, like the whitespace
+  // between the records a SubtreeSink takes out, is copied a logarithmic
+  // number of times.
+  [[nodiscard]] Text append(const Text &text, std::string_view more);
+
+  // the bytes allocated for the block a text lives in, including what other
+  // texts use of it and what is left over. 0 for text that isn't in a block.
+  [[nodiscard]] static size_t block_size(const Text &text);
+
+private:
+  size_t m_block_size;
+  std::shared_ptr<char[]> m_block;
+  size_t m_used = 0;
+  size_t m_capacity = 0;
+
+  char *allocate(size_t size, std::shared_ptr<const char[]> &block);
+  // a block starts with its size, see block_size()
+  static std::shared_ptr<char[]> new_block(size_t size);
+};
@@ -1,22 +1,24 @@
 #pragma once
 
-#include <iostream>
+#include "errors.hh"
+#include "options.hh"
+#include "source.hh"
+#include <optional>
+#include <ostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
-#define UNIMPLEMENTED()                                                        \
-  std::cerr << "UNIMPLEMENTED() reached on " << __FILE__ << ", line "          \
-            << __LINE__ << "\n";                                               \
-  exit(1)
-
 enum class TokenType {
   StartTag,
   EndTag,
   Character,
   Doctype,
   Comment,
+  EndOfFile,
 };
 
 inline std::ostream &operator<<(std::ostream &os, const TokenType e) {
@@ -36,8 +38,9 @@ inline std::ostream &operator<<(std::ostream &os, const TokenType e) {
   case TokenType::Comment:
     os << "Comment";
     break;
-  default:
-    UNIMPLEMENTED();
+  case TokenType::EndOfFile:
+    os << "EndOfFile";
+    break;
   }
   return os;
 }
@@ -54,10 +57,33 @@ public:
 
   [[nodiscard]] TokenType type() const { return m_type; }
   [[nodiscard]] std::string &data() { return m_data; }
+  [[nodiscard]] const std::string &data() const { return m_data; }
   [[nodiscard]] std::vector<Attribute> &attributes() { return m_attributes; }
+  [[nodiscard]] const std::vector<Attribute> &attributes() const {
+    return m_attributes;
+  }
   [[nodiscard]] bool is_self_closing() const { return m_is_self_closing; }
   void set_is_self_closing(bool v) { m_is_self_closing = v; }
 
+  // doctype tokens only. an identifier that isn't there is missing, which is
+  // not the same as an empty one.
+  [[nodiscard]] std::optional<std::string> &public_identifier() {
+    return m_public_identifier;
+  }
+  [[nodiscard]] const std::optional<std::string> &public_identifier() const {
+    return m_public_identifier;
+  }
+  [[nodiscard]] std::optional<std::string> &system_identifier() {
+    return m_system_identifier;
+  }
+  [[nodiscard]] const std::optional<std::string> &system_identifier() const {
+    return m_system_identifier;
+  }
+  [[nodiscard]] bool force_quirks() const { return m_force_quirks; }
+  void set_force_quirks(bool v) { m_force_quirks = v; }
+  [[nodiscard]] SourceRange source_range() const { return m_source_range; }
+  void set_source_range(SourceRange range) { m_source_range = range; }
+
   [[nodiscard]] std::string dump() const {
     std::stringstream ss;
     ss << "Token(" << m_type << ", \"" << m_data << "\"";
@@ -73,13 +99,90 @@ private:
   std::string m_data;
   std::vector<Attribute> m_attributes;
   bool m_is_self_closing = false;
+  bool m_force_quirks = false;
+  std::optional<std::string> m_public_identifier;
+  std::optional<std::string> m_system_identifier;
+  SourceRange m_source_range;
+};
+
+class Tokenizer;
+
+// receives each token as soon as it is complete, see Tokenizer::run()
+class TokenSink {
+public:
+  virtual ~TokenSink() = default;
+  virtual void emit(Token &token) = 0;
+  // called once the tokenizer is ready to hand over tokens. a sink that
+  // returns true switches the text state itself with
+  // Tokenizer::switch_to(), otherwise the tokenizer picks it by tag name.
+  virtual bool attach(Tokenizer & /*tokenizer*/) { return false; }
+  // a sink that wants no more tokens returns true, and the tokenizer stops
+  // reading the input, including input fed to it later
+  [[nodiscard]] virtual bool stopped() const { return false; }
+};
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-html-fragments
+// how the text after a start tag is tokenized, which only the tree builder
+// knows for sure: "<title>" in svg is an ordinary element
+enum class TextState {
+  Data,
+  Rcdata,
+  Rawtext,
+  ScriptData,
+  Plaintext,
 };
 
 class Tokenizer {
 public:
-  explicit Tokenizer(std::string data) : m_data(std::move(data)) {}
+  // the input is not copied and has to outlive the tokenizer, unless it has
+  // a CR in it, see normalize_newlines(). source ranges then refer to the
+  // normalized copy.
+  explicit Tokenizer(std::string_view data, const ParseOptions &options = {})
+      : m_data(data), m_track_positions(options.track_positions),
+        m_error_sink(options.error_sink), m_limits(options.limits) {
+    if (m_limits.max_input_size != 0 &&
+        m_data.size() > m_limits.max_input_size) {
+      m_data = m_data.substr(0, m_limits.max_input_size);
+      m_limits_exceeded.input_size = true;
+    }
+    if (m_data.find('\r') != std::string_view::npos) {
+      append_normalized_newlines(m_buffer, m_data, m_pending_cr);
+      m_data = m_buffer;
+    }
+  }
+
+  // for input that arrives in chunks, see feed() and finish()
+  explicit Tokenizer(TokenSink &sink, const ParseOptions &options = {})
+      : m_track_positions(options.track_positions),
+        m_error_sink(options.error_sink), m_limits(options.limits),
+        m_input_finished(false), m_sink(&sink),
+        m_sink_switches_state(sink.attach(*this)) {}
 
+  // tokenizes the whole input and returns every token
   std::vector<Token> parse();
+  // hands tokens to the sink as they are completed instead of collecting
+  // them, so memory use doesn't grow with the input
+  void run(TokenSink &sink);
+
+  // tokenizes as much of the input so far as can be done without seeing
+  // what comes next, and hands the completed tokens to the sink. only the
+  // unconsumed tail of the input is kept between calls.
+  void feed(std::string_view chunk);
+  // the input is complete, tokenizes the rest and emits EndOfFile
+  void finish();
+
+  // switches to the state that the content of the element the last start
+  // tag opened is read in. only takes effect between two tokens, so it is
+  // meant to be called by the sink from emit().
+  void switch_to(TextState state);
+  // https://html.spec.whatwg.org/multipage/parsing.html#markup-declaration-open-state
+  // whether "<![CDATA[" starts a CDATA section, which depends on the
+  // adjusted current node being in svg or math. a comment otherwise.
+  void set_cdata_allowed(bool allowed) { m_cdata_allowed = allowed; }
+
+  [[nodiscard]] const LimitsExceeded &limits_exceeded() const {
+    return m_limits_exceeded;
+  }
 
 private:
   enum class State {
@@ -88,6 +191,7 @@ private:
     TagName,
     EndTagOpen,
     MarkupDeclarationOpen,
+    BogusComment,
     Doctype,
     BeforeDoctypeName,
     DoctypeName,
@@ -95,10 +199,15 @@ private:
     AfterDoctypePublicKeyword,
     BeforeDoctypePublicIdentifier,
     DoctypePublicIdentifierDoubleQuoted,
+    DoctypePublicIdentifierSingleQuoted,
     AfterDoctypePublicIdentifier,
     BetweenDoctypePublicAndSystemIdentifiers,
+    AfterDoctypeSystemKeyword,
+    BeforeDoctypeSystemIdentifier,
     DoctypeSystemIdentifierDoubleQuoted,
+    DoctypeSystemIdentifierSingleQuoted,
     AfterDoctypeSystemIdentifier,
+    BogusDoctype,
     BeforeAttributeName,
     AttributeName,
     AfterAttributeName,
@@ -116,24 +225,90 @@ private:
     CommentLessThanSignBangDashDash,
     CommentEndDash,
     CommentEnd,
+    CommentEndBang,
     SelfClosingStartTag,
+    Rcdata,
+    Rawtext,
     ScriptData,
-    StyleData,
+    Plaintext,
+    CdataSection,
   };
 
+  // no state looks further ahead than "doctype" or the longest character
+  // reference name with the character after it
+  static constexpr size_t max_lookahead = 64;
+
   State m_state{State::Data};
-  std::string m_data;
+  std::string_view m_data;
+  // the unconsumed input, when it is fed in chunks
+  std::string m_buffer;
+  // the last chunk ended in a CR, see append_normalized_newlines()
+  bool m_pending_cr = false;
+  // offset of m_data[0] in the whole input, which grows as consumed input is
+  // dropped from m_buffer
+  size_t m_base = 0;
   size_t m_current = 0;
   std::vector<Token> m_tokens;
+  bool m_track_positions;
+  ErrorSink *m_error_sink;
+  ParseLimits m_limits;
+  LimitsExceeded m_limits_exceeded;
+  Token::Attribute m_discarded_attribute;
+  bool m_discard_attribute = false;
+  // the names of the current tag's attributes, once it has too many to
+  // compare each new one with all of them
+  std::unordered_set<std::string> m_attribute_names;
+  bool m_input_finished = true;
+  // a numeric character reference ran into the end of the buffered input
+  bool m_need_input = false;
+  // how far the digits of that reference were read, so that the next chunk
+  // continues from there instead of reading them all again. offsets are from
+  // the start of the input.
+  struct PartialReference {
+    size_t digits_start = 0;
+    size_t end = 0;
+    uint32_t code_point = 0;
+  };
+  std::optional<PartialReference> m_partial_reference;
+  TokenSink *m_sink = nullptr;
+  // see TokenSink::attach()
+  bool m_sink_switches_state = false;
+  // the end tag that ends RCDATA, RAWTEXT and script data
+  std::string m_last_start_tag;
+  // https://html.spec.whatwg.org/multipage/parsing.html#script-data-escaped-state
+  // inside "<!--" in script data, and inside "<script>" within that, where
+  // "</script>" doesn't end the script
+  enum class ScriptEscape {
+    None,
+    Escaped,
+    DoubleEscaped,
+  };
+  ScriptEscape m_script_escape = ScriptEscape::None;
+  // how many of the escaped characters just before were '-', up to two
+  int m_script_dashes = 0;
+  bool m_cdata_allowed = false;
+  // offset of the '<' that opened the tag, comment or doctype being built
+  size_t m_token_start = 0;
+
+  void tokenize();
+  void tokenize_available();
+  void step();
+  void flush_to_sink();
+  [[nodiscard]] bool sink_stopped() const {
+    return m_sink != nullptr && m_sink->stopped();
+  }
 
   void handle_data();
   void handle_tag_open();
   void handle_tag_name();
   void handle_end_tag_open();
   void handle_markup_declaration_open();
+  void handle_bogus_comment();
+  void handle_cdata_section();
   void handle_self_closing_start_tag();
-  void handle_script_data();
-  void handle_style_data();
+  void handle_raw_text();
+  void handle_script_data_escaped();
+  bool next_chars_are_appropriate_end_tag();
 
   void handle_doctype();
   void handle_before_doctype_name();
@@ -141,11 +316,17 @@ private:
   void handle_after_doctype_name();
   void handle_after_doctype_public_keyword();
   void handle_before_doctype_public_identifier();
-  void handle_doctype_public_identifier_double_quoted();
+  void handle_doctype_public_identifier_quoted(char quote);
+  void handle_doctype_identifier_quoted(char quote, std::string &identifier,
+                                        State after,
+                                        ParseErrorCode abrupt);
   void handle_after_doctype_public_identifier();
   void handle_between_doctype_public_and_system_identifiers();
-  void handle_doctype_system_identifier_double_quoted();
+  void handle_after_doctype_system_keyword();
+  void handle_before_doctype_system_identifier();
+  void handle_doctype_system_identifier_quoted(char quote);
   void handle_after_doctype_system_identifier();
+  void handle_bogus_doctype();
 
   void handle_before_attribute_name();
   void handle_attribute_name();
@@ -165,11 +346,53 @@ private:
   void handle_comment_less_than_sign_bang_dash_dash();
   void handle_comment_end_dash();
   void handle_comment_end();
+  void handle_comment_end_bang();
+
+  void handle_eof();
+
+  void consume_character_reference(std::string &out, bool in_attribute);
+  void consume_numeric_character_reference(std::string &out);
+
+  void begin_token(TokenType type, size_t offset, std::string data = "");
+  void end_token();
+  void emit_characters(size_t offset, std::string_view data);
+  void emit_tag();
+  [[nodiscard]] bool in_text_state() const;
+  void error(ParseErrorCode code);
+  void error(ParseErrorCode code, size_t offset);
+  bool next_chars_are(std::string_view s, bool case_insensitive);
+
+  void begin_attribute(std::string name = "");
+  void end_attribute_name();
 
   [[nodiscard]] Token &current_token() { return m_tokens.back(); }
+  [[nodiscard]] Token::Attribute &current_attribute() {
+    return m_discard_attribute ? m_discarded_attribute
+                               : current_token().attributes().back();
+  }
   char consume() { return m_data[m_current++]; }
-  char peek(long i) {
-    return m_data[static_cast<size_t>(static_cast<long>(m_current) + i)];
+  // out of range lookahead reads as '\0', which never completes a keyword
+  [[nodiscard]] char peek(long i) const {
+    long at = static_cast<long>(m_current) + i;
+    if (at < 0 || static_cast<size_t>(at) >= m_data.length()) {
+      return '\0';
+    }
+    return m_data[static_cast<size_t>(at)];
   }
   [[nodiscard]] bool eof() const { return m_current >= m_data.length(); }
+
+  // the ctype functions are locale dependent and undefined for negative chars
+  static bool is_ascii_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  }
+  static bool is_ascii_digit(char c) { return c >= '0' && c <= '9'; }
+  static bool is_ascii_alphanumeric(char c) {
+    return is_ascii_alpha(c) || is_ascii_digit(c);
+  }
+  static bool is_whitespace(char c) {
+    return c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+  }
+  static char to_ascii_lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+  }
 };
\ No newline at end of file
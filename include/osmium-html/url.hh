@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// https://www.rfc-editor.org/rfc/rfc3986#section-5.2
+// resolves `reference` against the absolute URL `base` and appends the result
+// to `out`, which is the only thing that allocates. handles what shows up in
+// HTML attributes the way browsers do: surrounding whitespace and control
+// characters are trimmed, tabs and newlines dropped, and backslashes count as
+// slashes in http(s) and other special URLs. dot segments are removed, the
+// scheme and host lowercased, default ports dropped, and a special URL gets
+// "/" for an empty path, so "HTTPS://a.com:443" comes out as "https://a.com/".
+// there is no percent-encoding or IDNA, so this is not a full WHATWG URL
+// parser.
+//
+// an empty reference, like href="", resolves to the base without its
+// fragment. `base` must not point into `out`.
+void resolve_url(std::string_view base, std::string_view reference,
+                 std::string &out);
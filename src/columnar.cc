@@ -0,0 +1,141 @@
+#include "columnar.hh"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace {
+
+constexpr char magic[8] = {'O', 'S', 'M', 'C', 'O', 'L', '1', '\0'};
+constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+// offsets are 32-bit, so a block is written before any heap can overflow them
+constexpr size_t max_heap_bytes = size_t{1} << 31;
+
+template <typename T> T to_little_endian(T value) {
+  if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+    T swapped = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      swapped = static_cast<T>((swapped << 8) | ((value >> (8 * i)) & 0xFF));
+    }
+    return swapped;
+  }
+  return value;
+}
+
+} // namespace
+
+void ColumnarWriter::add(const Document &document) {
+  if (!document.root()) {
+    return;
+  }
+  if (m_document_nodes.empty()) {
+    m_document_nodes.push_back(0);
+    m_text_offsets.push_back(0);
+    m_attributes.push_back(0);
+    m_attribute_name_offsets.push_back(0);
+    m_attribute_value_offsets.push_back(0);
+  }
+
+  // document order without recursion. children are pushed in reverse so
+  // they come off the stack first to last.
+  m_stack.clear();
+  m_stack.push_back({document.root().get(), no_parent, 0});
+  while (!m_stack.empty()) {
+    auto pending = m_stack.back();
+    m_stack.pop_back();
+    auto index = static_cast<uint32_t>(m_kind.size());
+    m_depth.push_back(pending.depth);
+    m_parent.push_back(pending.parent);
+
+    if (!pending.node->is_element()) {
+      m_kind.push_back(1);
+      m_tag.push_back(0);
+      m_text += static_cast<const TextNode *>(pending.node)->content();
+    } else {
+      const auto *element = static_cast<const Element *>(pending.node);
+      m_kind.push_back(0);
+      m_tag.push_back(static_cast<uint8_t>(element->tag()));
+      if (element->tag() == Tag::Unknown) {
+        m_text += element->name();
+      }
+      for (const auto &[name, value] : element->attributes()) {
+        m_attribute_names += name;
+        m_attribute_values += value;
+        m_attribute_name_offsets.push_back(
+            static_cast<uint32_t>(m_attribute_names.size()));
+        m_attribute_value_offsets.push_back(
+            static_cast<uint32_t>(m_attribute_values.size()));
+      }
+      const auto &children = element->children();
+      for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        m_stack.push_back({it->get(), index, pending.depth + 1});
+      }
+    }
+
+    m_text_offsets.push_back(static_cast<uint32_t>(m_text.size()));
+    m_attributes.push_back(
+        static_cast<uint32_t>(m_attribute_name_offsets.size() - 1));
+  }
+  m_document_nodes.push_back(static_cast<uint32_t>(m_kind.size()));
+
+  if (m_kind.size() >= m_block_nodes ||
+      std::max({m_text.size(), m_attribute_names.size(),
+                m_attribute_values.size()}) >= max_heap_bytes) {
+    flush();
+  }
+}
+
+bool ColumnarWriter::flush() {
+  if (m_kind.empty()) {
+    return static_cast<bool>(m_out);
+  }
+
+  auto documents = static_cast<uint32_t>(m_document_nodes.size() - 1);
+  auto nodes = static_cast<uint32_t>(m_kind.size());
+  auto attributes = static_cast<uint32_t>(m_attribute_name_offsets.size() - 1);
+  write(magic, sizeof(magic));
+  for (uint32_t count : {documents, nodes, attributes, uint32_t{0}}) {
+    count = to_little_endian(count);
+    write(&count, sizeof(count));
+  }
+  for (uint64_t bytes : {m_text.size(), m_attribute_names.size(),
+                         m_attribute_values.size()}) {
+    bytes = to_little_endian(bytes);
+    write(&bytes, sizeof(bytes));
+  }
+
+  write_column(m_document_nodes);
+  write_column(m_kind);
+  write_column(m_tag);
+  write_column(m_depth);
+  write_column(m_parent);
+  write_column(m_text_offsets);
+  write_column(m_attributes);
+  write_column(m_attribute_name_offsets);
+  write_column(m_attribute_value_offsets);
+  for (auto *heap : {&m_text, &m_attribute_names, &m_attribute_values}) {
+    write(heap->data(), heap->size());
+    constexpr char padding[8] = {};
+    write(padding, (8 - heap->size() % 8) % 8);
+    heap->clear();
+  }
+
+  return static_cast<bool>(m_out);
+}
+
+void ColumnarWriter::write(const void *data, size_t size) {
+  m_out.write(static_cast<const char *>(data),
+              static_cast<std::streamsize>(size));
+}
+
+// every column is written in one piece and then emptied for the next block
+template <typename T> void ColumnarWriter::write_column(std::vector<T> &column) {
+  if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+    for (auto &value : column) {
+      value = to_little_endian(value);
+    }
+  }
+  write(column.data(), column.size() * sizeof(T));
+  constexpr char padding[8] = {};
+  write(padding, (8 - (column.size() * sizeof(T)) % 8) % 8);
+  column.clear();
+}
@@ -0,0 +1,91 @@
+#include "document.hh"
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+// strings short enough for the small string buffer don't allocate
+size_t heap_size(const std::string &s) {
+  const auto *begin = reinterpret_cast<const char *>(&s);
+  if (s.data() >= begin && s.data() < begin + sizeof(s)) {
+    return 0;
+  }
+  return s.capacity() + 1;
+}
+
+// make_shared puts the object and its reference counts in one allocation
+template <typename T> constexpr size_t shared_size() {
+  return sizeof(T) + 2 * sizeof(long) + sizeof(void *);
+}
+
+size_t attributes_size(const Element::Attributes &attributes) {
+  // every entry is a separately allocated hash node: next pointer, the pair
+  // and the cached hash
+  using Entry = Element::Attributes::value_type;
+  size_t size = attributes.bucket_count() * sizeof(void *);
+  for (const auto &[name, value] : attributes) {
+    size += sizeof(void *) + sizeof(Entry) + sizeof(size_t);
+    size += heap_size(name) + heap_size(value);
+  }
+  return size;
+}
+
+} // namespace
+
+const LineTable &Document::line_table() const {
+  if (!m_line_table) {
+    m_line_table = std::make_unique<LineTable>(m_source);
+  }
+  return *m_line_table;
+}
+
+SourcePosition Document::position(uint32_t offset) const {
+  return line_table().position(offset);
+}
+
+SourcePosition Document::position(const Node &node) const {
+  if (!node.source_range().is_valid()) {
+    return {};
+  }
+  return position(node.source_range().offset);
+}
+
+MemoryEstimate Document::estimate_memory_usage() const {
+  MemoryEstimate usage;
+  usage.source = heap_size(m_source);
+  if (m_line_table) {
+    usage.source += m_line_table->memory_usage();
+  }
+
+  std::unordered_set<const char *> blocks;
+  std::vector<const Node *> stack;
+  if (m_root) {
+    stack.push_back(m_root.get());
+  }
+  while (!stack.empty()) {
+    const auto *node = stack.back();
+    stack.pop_back();
+
+    if (!node->is_element()) {
+      const auto &text = static_cast<const TextNode *>(node)->text();
+      usage.nodes += shared_size<TextNode>();
+      if (text.block && blocks.insert(text.block.get()).second) {
+        // allocated with make_shared too
+        usage.text += TextPool::block_size(text) + 2 * sizeof(long) +
+                      sizeof(void *);
+      }
+      continue;
+    }
+
+    const auto *element = static_cast<const Element *>(node);
+    usage.nodes += shared_size<Element>();
+    usage.nodes += heap_size(element->name());
+    usage.nodes += element->children().capacity() * sizeof(NodePtr);
+    usage.attributes += attributes_size(element->attributes());
+    for (const auto &child : element->children()) {
+      stack.push_back(child.get());
+    }
+  }
+
+  return usage;
+}
@@ -0,0 +1,936 @@
+#include "encoding.hh"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the SSSE3 kernel is compiled for its own target and picked at runtime, so
+// the library still runs on plain x86-64
+#if defined(__x86_64__) && defined(__GNUC__)
+#define OSMIUM_HTML_UTF8_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace {
+
+struct Label {
+  std::string_view label;
+  Encoding encoding;
+};
+
+// https://encoding.spec.whatwg.org/#names-and-labels, sorted for the lookup
+constexpr Label labels[] = {
+    {"ansi_x3.4-1968", Encoding::Windows1252},
+    {"arabic", Encoding::Iso8859_6},
+    {"ascii", Encoding::Windows1252},
+    {"asmo-708", Encoding::Iso8859_6},
+    {"cp1252", Encoding::Windows1252},
+    {"cp819", Encoding::Windows1252},
+    {"csiso88596e", Encoding::Iso8859_6},
+    {"csiso88596i", Encoding::Iso8859_6},
+    {"csiso88598e", Encoding::Iso8859_8},
+    {"csiso88598i", Encoding::Iso8859_8},
+    {"csisolatin1", Encoding::Windows1252},
+    {"csisolatin2", Encoding::Iso8859_2},
+    {"csisolatin3", Encoding::Iso8859_3},
+    {"csisolatin4", Encoding::Iso8859_4},
+    {"csisolatin6", Encoding::Iso8859_10},
+    {"csisolatin9", Encoding::Iso8859_15},
+    {"csisolatinarabic", Encoding::Iso8859_6},
+    {"csisolatincyrillic", Encoding::Iso8859_5},
+    {"csisolatingreek", Encoding::Iso8859_7},
+    {"csisolatinhebrew", Encoding::Iso8859_8},
+    {"csunicode", Encoding::Utf16Le},
+    {"cyrillic", Encoding::Iso8859_5},
+    {"ecma-114", Encoding::Iso8859_6},
+    {"ecma-118", Encoding::Iso8859_7},
+    {"elot_928", Encoding::Iso8859_7},
+    {"greek", Encoding::Iso8859_7},
+    {"greek8", Encoding::Iso8859_7},
+    {"hebrew", Encoding::Iso8859_8},
+    {"ibm819", Encoding::Windows1252},
+    {"iso-10646-ucs-2", Encoding::Utf16Le},
+    {"iso-8859-1", Encoding::Windows1252},
+    {"iso-8859-10", Encoding::Iso8859_10},
+    {"iso-8859-13", Encoding::Iso8859_13},
+    {"iso-8859-14", Encoding::Iso8859_14},
+    {"iso-8859-15", Encoding::Iso8859_15},
+    {"iso-8859-16", Encoding::Iso8859_16},
+    {"iso-8859-2", Encoding::Iso8859_2},
+    {"iso-8859-3", Encoding::Iso8859_3},
+    {"iso-8859-4", Encoding::Iso8859_4},
+    {"iso-8859-5", Encoding::Iso8859_5},
+    {"iso-8859-6", Encoding::Iso8859_6},
+    {"iso-8859-6-e", Encoding::Iso8859_6},
+    {"iso-8859-6-i", Encoding::Iso8859_6},
+    {"iso-8859-7", Encoding::Iso8859_7},
+    {"iso-8859-8", Encoding::Iso8859_8},
+    {"iso-8859-8-e", Encoding::Iso8859_8},
+    {"iso-8859-8-i", Encoding::Iso8859_8},
+    {"iso-ir-100", Encoding::Windows1252},
+    {"iso-ir-101", Encoding::Iso8859_2},
+    {"iso-ir-109", Encoding::Iso8859_3},
+    {"iso-ir-110", Encoding::Iso8859_4},
+    {"iso-ir-126", Encoding::Iso8859_7},
+    {"iso-ir-127", Encoding::Iso8859_6},
+    {"iso-ir-138", Encoding::Iso8859_8},
+    {"iso-ir-144", Encoding::Iso8859_5},
+    {"iso-ir-157", Encoding::Iso8859_10},
+    {"iso8859-1", Encoding::Windows1252},
+    {"iso8859-10", Encoding::Iso8859_10},
+    {"iso8859-13", Encoding::Iso8859_13},
+    {"iso8859-14", Encoding::Iso8859_14},
+    {"iso8859-15", Encoding::Iso8859_15},
+    {"iso8859-2", Encoding::Iso8859_2},
+    {"iso8859-3", Encoding::Iso8859_3},
+    {"iso8859-4", Encoding::Iso8859_4},
+    {"iso8859-5", Encoding::Iso8859_5},
+    {"iso8859-6", Encoding::Iso8859_6},
+    {"iso8859-7", Encoding::Iso8859_7},
+    {"iso8859-8", Encoding::Iso8859_8},
+    {"iso88591", Encoding::Windows1252},
+    {"iso885910", Encoding::Iso8859_10},
+    {"iso885913", Encoding::Iso8859_13},
+    {"iso885914", Encoding::Iso8859_14},
+    {"iso885915", Encoding::Iso8859_15},
+    {"iso88592", Encoding::Iso8859_2},
+    {"iso88593", Encoding::Iso8859_3},
+    {"iso88594", Encoding::Iso8859_4},
+    {"iso88595", Encoding::Iso8859_5},
+    {"iso88596", Encoding::Iso8859_6},
+    {"iso88597", Encoding::Iso8859_7},
+    {"iso88598", Encoding::Iso8859_8},
+    {"iso_8859-1", Encoding::Windows1252},
+    {"iso_8859-15", Encoding::Iso8859_15},
+    {"iso_8859-1:1987", Encoding::Windows1252},
+    {"iso_8859-2", Encoding::Iso8859_2},
+    {"iso_8859-2:1987", Encoding::Iso8859_2},
+    {"iso_8859-3", Encoding::Iso8859_3},
+    {"iso_8859-3:1988", Encoding::Iso8859_3},
+    {"iso_8859-4", Encoding::Iso8859_4},
+    {"iso_8859-4:1988", Encoding::Iso8859_4},
+    {"iso_8859-5", Encoding::Iso8859_5},
+    {"iso_8859-5:1988", Encoding::Iso8859_5},
+    {"iso_8859-6", Encoding::Iso8859_6},
+    {"iso_8859-6:1987", Encoding::Iso8859_6},
+    {"iso_8859-7", Encoding::Iso8859_7},
+    {"iso_8859-7:1987", Encoding::Iso8859_7},
+    {"iso_8859-8", Encoding::Iso8859_8},
+    {"iso_8859-8:1988", Encoding::Iso8859_8},
+    {"l1", Encoding::Windows1252},
+    {"l2", Encoding::Iso8859_2},
+    {"l3", Encoding::Iso8859_3},
+    {"l4", Encoding::Iso8859_4},
+    {"l6", Encoding::Iso8859_10},
+    {"l9", Encoding::Iso8859_15},
+    {"latin1", Encoding::Windows1252},
+    {"latin2", Encoding::Iso8859_2},
+    {"latin3", Encoding::Iso8859_3},
+    {"latin4", Encoding::Iso8859_4},
+    {"latin6", Encoding::Iso8859_10},
+    {"logical", Encoding::Iso8859_8},
+    {"sun_eu_greek", Encoding::Iso8859_7},
+    {"ucs-2", Encoding::Utf16Le},
+    {"unicode", Encoding::Utf16Le},
+    {"unicode-1-1-utf-8", Encoding::Utf8},
+    {"unicode11utf8", Encoding::Utf8},
+    {"unicode20utf8", Encoding::Utf8},
+    {"unicodefeff", Encoding::Utf16Le},
+    {"unicodefffe", Encoding::Utf16Be},
+    {"us-ascii", Encoding::Windows1252},
+    {"utf-16", Encoding::Utf16Le},
+    {"utf-16be", Encoding::Utf16Be},
+    {"utf-16le", Encoding::Utf16Le},
+    {"utf-8", Encoding::Utf8},
+    {"utf8", Encoding::Utf8},
+    {"visual", Encoding::Iso8859_8},
+    {"windows-1252", Encoding::Windows1252},
+    {"x-cp1252", Encoding::Windows1252},
+    {"x-unicode20utf8", Encoding::Utf8},
+};
+
+constexpr size_t max_label_length = 20;
+
+// the whitespace of the encoding and prescan algorithms, which unlike the
+// tokenizer's includes CR
+bool is_space(char c) {
+  return c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+char to_ascii_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool is_ascii_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool starts_with_ignoring_case(std::string_view s, std::string_view prefix) {
+  if (s.size() < prefix.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < prefix.size(); ++i) {
+    if (to_ascii_lower(s[i]) != prefix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// https://encoding.spec.whatwg.org/#bom-sniff
+std::optional<std::pair<Encoding, size_t>> sniff_bom(std::string_view input) {
+  if (input.starts_with("\xEF\xBB\xBF")) {
+    return std::pair{Encoding::Utf8, size_t{3}};
+  }
+  if (input.starts_with("\xFE\xFF")) {
+    return std::pair{Encoding::Utf16Be, size_t{2}};
+  }
+  if (input.starts_with("\xFF\xFE")) {
+    return std::pair{Encoding::Utf16Le, size_t{2}};
+  }
+  return std::nullopt;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#concept-get-attributes-when-sniffing
+// false once there are no more attributes, `i` then points at the '>' or the
+// end. names and values are lowercased.
+bool get_attribute(std::string_view input, size_t &i, std::string &name,
+                   std::string &value) {
+  size_t size = input.size();
+  while (i < size && (is_space(input[i]) || input[i] == '/')) {
+    ++i;
+  }
+  if (i >= size || input[i] == '>') {
+    return false;
+  }
+  name.clear();
+  value.clear();
+
+  for (;; ++i) {
+    if (i >= size) {
+      return false;
+    }
+    char c = input[i];
+    if (c == '=' && !name.empty()) {
+      ++i;
+      break;
+    }
+    if (is_space(c)) {
+      while (i < size && is_space(input[i])) {
+        ++i;
+      }
+      if (i >= size) {
+        return false;
+      }
+      if (input[i] != '=') {
+        return true;
+      }
+      ++i;
+      break;
+    }
+    if (c == '/' || c == '>') {
+      return true;
+    }
+    name += to_ascii_lower(c);
+  }
+
+  while (i < size && is_space(input[i])) {
+    ++i;
+  }
+  if (i >= size) {
+    return false;
+  }
+  char quote = input[i];
+  if (quote == '"' || quote == '\'') {
+    for (++i; i < size; ++i) {
+      if (input[i] == quote) {
+        ++i;
+        return true;
+      }
+      value += to_ascii_lower(input[i]);
+    }
+    return false;
+  }
+  for (; i < size; ++i) {
+    char c = input[i];
+    if (is_space(c) || c == '>') {
+      return true;
+    }
+    value += to_ascii_lower(c);
+  }
+  return false;
+}
+
+// https://html.spec.whatwg.org/multipage/urls-and-fetching.html#algorithm-for-extracting-a-character-encoding-from-a-meta-element
+// `content` is already lowercase
+std::optional<Encoding> extract_meta_charset(std::string_view content) {
+  size_t i = 0;
+  for (;;) {
+    i = content.find("charset", i);
+    if (i == std::string_view::npos) {
+      return std::nullopt;
+    }
+    i += 7;
+    while (i < content.size() && is_space(content[i])) {
+      ++i;
+    }
+    if (i < content.size() && content[i] == '=') {
+      break;
+    }
+  }
+  ++i;
+  while (i < content.size() && is_space(content[i])) {
+    ++i;
+  }
+  if (i >= content.size()) {
+    return std::nullopt;
+  }
+  char quote = content[i];
+  if (quote == '"' || quote == '\'') {
+    size_t end = content.find(quote, i + 1);
+    if (end == std::string_view::npos) {
+      return std::nullopt;
+    }
+    return lookup_encoding(content.substr(i + 1, end - i - 1));
+  }
+  size_t end = i;
+  while (end < content.size() && !is_space(content[end]) &&
+         content[end] != ';') {
+    ++end;
+  }
+  return lookup_encoding(content.substr(i, end - i));
+}
+
+// the length of the leading run of ASCII bytes
+size_t ascii_prefix_length(std::string_view input) {
+  const char *data = input.data();
+  size_t size = input.size();
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(chunk));
+    if (mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+  }
+#endif
+  while (i < size && static_cast<unsigned char>(data[i]) < 0x80) {
+    ++i;
+  }
+  return i;
+}
+
+// https://encoding.spec.whatwg.org/#utf-8-decoder
+// the length of the well-formed sequence starting with a non-ASCII byte at
+// `i`, or 0 if it is malformed. `lead` tells how many bytes the lead byte
+// itself promised.
+size_t utf8_sequence_length(const unsigned char *data, size_t size, size_t i,
+                            size_t &lead) {
+  unsigned char b = data[i];
+  unsigned char lower = 0x80;
+  unsigned char upper = 0xBF;
+  if (b >= 0xC2 && b <= 0xDF) {
+    lead = 2;
+  } else if (b >= 0xE0 && b <= 0xEF) {
+    lead = 3;
+    lower = b == 0xE0 ? 0xA0 : lower;
+    upper = b == 0xED ? 0x9F : upper;
+  } else if (b >= 0xF0 && b <= 0xF4) {
+    lead = 4;
+    lower = b == 0xF0 ? 0x90 : lower;
+    upper = b == 0xF4 ? 0x8F : upper;
+  } else {
+    lead = 1;
+    return 0;
+  }
+  for (size_t k = 1; k < lead; ++k) {
+    if (i + k >= size) {
+      return 0;
+    }
+    unsigned char c = data[i + k];
+    if (c < lower || c > upper) {
+      // the replacement covers the bytes up to here, see decode_utf8()
+      lead = k;
+      return 0;
+    }
+    lower = 0x80;
+    upper = 0xBF;
+  }
+  return lead;
+}
+
+bool is_valid_utf8_scalar(std::string_view input) {
+  const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+  size_t size = input.size();
+  size_t i = 0;
+  while (i < size) {
+    i += ascii_prefix_length(input.substr(i));
+    if (i >= size) {
+      break;
+    }
+    size_t lead = 0;
+    size_t length = utf8_sequence_length(data, size, i, lead);
+    if (length == 0) {
+      return false;
+    }
+    i += length;
+  }
+  return true;
+}
+
+#if defined(OSMIUM_HTML_UTF8_SSSE3)
+
+// https://arxiv.org/abs/2010.03090, "Validating UTF-8 In Less Than One
+// Instruction Per Byte". three nibble lookups classify every pair of adjacent
+// bytes, and the bits left set after and-ing them name the error. the
+// continuation bytes of 3 and 4 byte sequences are checked separately.
+constexpr uint8_t too_short = 1 << 0;
+constexpr uint8_t too_long = 1 << 1;
+constexpr uint8_t overlong_3 = 1 << 2;
+constexpr uint8_t too_large = 1 << 3;
+constexpr uint8_t surrogate = 1 << 4;
+constexpr uint8_t overlong_2 = 1 << 5;
+constexpr uint8_t too_large_1000 = 1 << 6;
+constexpr uint8_t overlong_4 = 1 << 6;
+constexpr uint8_t two_conts = 1 << 7;
+constexpr uint8_t carry = too_short | too_long | two_conts;
+
+// indexed by the high nibble of the first byte
+alignas(16) constexpr uint8_t byte_1_high[16] = {
+    too_long,
+    too_long,
+    too_long,
+    too_long,
+    too_long,
+    too_long,
+    too_long,
+    too_long,
+    two_conts,
+    two_conts,
+    two_conts,
+    two_conts,
+    too_short | overlong_2,
+    too_short,
+    too_short | overlong_3 | surrogate,
+    too_short | too_large | too_large_1000 | overlong_4,
+};
+
+// indexed by the low nibble of the first byte
+alignas(16) constexpr uint8_t byte_1_low[16] = {
+    carry | overlong_3 | overlong_2 | overlong_4,
+    carry | overlong_2,
+    carry,
+    carry,
+    carry | too_large,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000 | surrogate,
+    carry | too_large | too_large_1000,
+    carry | too_large | too_large_1000,
+};
+
+// indexed by the high nibble of the second byte
+alignas(16) constexpr uint8_t byte_2_high[16] = {
+    too_short,
+    too_short,
+    too_short,
+    too_short,
+    too_short,
+    too_short,
+    too_short,
+    too_short,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 |
+        overlong_4,
+    too_long | overlong_2 | two_conts | overlong_3 | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_long | overlong_2 | two_conts | surrogate | too_large,
+    too_short,
+    too_short,
+    too_short,
+    too_short,
+};
+
+// a block is incomplete if it ends in a lead byte that needs more bytes than
+// are left in it
+alignas(16) constexpr uint8_t incomplete_max[16] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+__attribute__((target("ssse3"))) bool
+is_valid_utf8_ssse3(std::string_view input) {
+  const auto load = [](const uint8_t *table) {
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(table));
+  };
+  const __m128i table_1_high = load(byte_1_high);
+  const __m128i table_1_low = load(byte_1_low);
+  const __m128i table_2_high = load(byte_2_high);
+  const __m128i max = load(incomplete_max);
+  const __m128i low_nibble = _mm_set1_epi8(0x0F);
+
+  __m128i error = _mm_setzero_si128();
+  __m128i previous = _mm_setzero_si128();
+  __m128i previous_incomplete = _mm_setzero_si128();
+
+  const char *data = input.data();
+  size_t size = input.size();
+  // the last block is padded with zeros, which are ASCII and so end any
+  // truncated sequence with an error. a full last block is followed by one
+  // made only of padding.
+  for (size_t i = 0; i <= size; i += 16) {
+    __m128i block;
+    if (i + 16 <= size) {
+      block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    } else {
+      alignas(16) char tail[16] = {};
+      std::memcpy(tail, data + i, size - i);
+      block = _mm_load_si128(reinterpret_cast<const __m128i *>(tail));
+    }
+
+    if (_mm_movemask_epi8(block) == 0) {
+      error = _mm_or_si128(error, previous_incomplete);
+      previous_incomplete = _mm_setzero_si128();
+    } else {
+      __m128i prev1 = _mm_alignr_epi8(block, previous, 15);
+      __m128i special = _mm_and_si128(
+          _mm_and_si128(
+              _mm_shuffle_epi8(table_1_high, _mm_and_si128(
+                                                 _mm_srli_epi16(prev1, 4),
+                                                 low_nibble)),
+              _mm_shuffle_epi8(table_1_low, _mm_and_si128(prev1, low_nibble))),
+          _mm_shuffle_epi8(table_2_high,
+                           _mm_and_si128(_mm_srli_epi16(block, 4),
+                                         low_nibble)));
+
+      __m128i prev2 = _mm_alignr_epi8(block, previous, 14);
+      __m128i prev3 = _mm_alignr_epi8(block, previous, 13);
+      __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+      __m128i fourth =
+          _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+      __m128i must_continue = _mm_and_si128(
+          _mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+      error = _mm_or_si128(error, _mm_xor_si128(must_continue, special));
+      previous_incomplete = _mm_subs_epu8(block, max);
+    }
+    previous = block;
+  }
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) ==
+         0xFFFF;
+}
+
+#endif
+
+char *write_utf8(char *out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    *out++ = static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    *out++ = static_cast<char>(0xC0 | (code_point >> 6));
+    *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    *out++ = static_cast<char>(0xE0 | (code_point >> 12));
+    *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    *out++ = static_cast<char>(0xF0 | (code_point >> 18));
+    *out++ = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+    *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+  return out;
+}
+
+// how far copy_ascii() may write past the bytes it copies
+constexpr size_t copy_slack = 16;
+
+// copies the leading run of ASCII bytes and returns its length
+size_t copy_ascii(const char *in, size_t size, char *out) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), chunk);
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(chunk));
+    if (mask != 0) {
+      return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+  }
+#endif
+  for (; i < size && static_cast<unsigned char>(in[i]) < 0x80; ++i) {
+    out[i] = in[i];
+  }
+  return i;
+}
+
+// the decoders write straight into a buffer sized for the worst case, which
+// is 3 bytes of UTF-8 per input byte, and shrink it to fit once done
+char *reserve_output(std::string &buffer, size_t input_size) {
+  buffer.resize(input_size * 3 + copy_slack);
+  return buffer.data();
+}
+
+// U+FFFD REPLACEMENT CHARACTER
+constexpr std::string_view replacement_character = "\xEF\xBF\xBD";
+
+char *write_replacement(char *out) {
+  std::memcpy(out, replacement_character.data(), replacement_character.size());
+  return out + replacement_character.size();
+}
+
+// https://encoding.spec.whatwg.org/#utf-8-decoder
+// well-formed sequences are copied as they are, each maximal malformed
+// subsequence becomes one U+FFFD
+void decode_utf8(std::string_view input, std::string &buffer) {
+  const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+  size_t size = input.size();
+  char *out = reserve_output(buffer, size);
+  size_t i = 0;
+  while (i < size) {
+    size_t ascii = copy_ascii(input.data() + i, size - i, out);
+    out += ascii;
+    i += ascii;
+    if (i >= size) {
+      break;
+    }
+    size_t lead = 0;
+    size_t length = utf8_sequence_length(data, size, i, lead);
+    if (length == 0) {
+      out = write_replacement(out);
+      i = std::min(i + lead, size);
+    } else {
+      std::memcpy(out, input.data() + i, length);
+      out += length;
+      i += length;
+    }
+  }
+  buffer.resize(static_cast<size_t>(out - buffer.data()));
+}
+
+// https://encoding.spec.whatwg.org/#single-byte-decoder
+void decode_single_byte(std::string_view input,
+                        const std::array<uint16_t, 128> &index,
+                        std::string &buffer) {
+  // the UTF-8 form of every high byte, worked out once per call. the first
+  // byte is the length.
+  std::array<std::array<char, 4>, 128> high{};
+  for (size_t b = 0; b < 128; ++b) {
+    char *end = write_utf8(high[b].data() + 1, index[b]);
+    high[b][0] = static_cast<char>(end - high[b].data() - 1);
+  }
+
+  size_t size = input.size();
+  char *out = reserve_output(buffer, size);
+  size_t i = 0;
+  while (i < size) {
+    size_t ascii = copy_ascii(input.data() + i, size - i, out);
+    out += ascii;
+    i += ascii;
+    for (; i < size; ++i) {
+      auto b = static_cast<unsigned char>(input[i]);
+      if (b < 0x80) {
+        break;
+      }
+      const auto &encoded = high[b - 0x80];
+      // always 3 bytes, only the encoded length counts
+      std::memcpy(out, encoded.data() + 1, 3);
+      out += encoded[0];
+    }
+  }
+  buffer.resize(static_cast<size_t>(out - buffer.data()));
+}
+
+// https://encoding.spec.whatwg.org/#shared-utf-16-decoder
+void decode_utf16(std::string_view input, bool big_endian,
+                  std::string &buffer) {
+  const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+  size_t units = input.size() / 2;
+  auto unit = [&](size_t i) -> uint32_t {
+    uint32_t first = data[2 * i];
+    uint32_t second = data[2 * i + 1];
+    return big_endian ? (first << 8) | second : (second << 8) | first;
+  };
+
+  char *out = reserve_output(buffer, input.size());
+  for (size_t i = 0; i < units; ++i) {
+    uint32_t code_unit = unit(i);
+    if (code_unit < 0x80) {
+      *out++ = static_cast<char>(code_unit);
+    } else if (code_unit < 0xD800 || code_unit > 0xDFFF) {
+      out = write_utf8(out, code_unit);
+    } else if (code_unit <= 0xDBFF && i + 1 < units &&
+               unit(i + 1) >= 0xDC00 && unit(i + 1) <= 0xDFFF) {
+      out = write_utf8(out, 0x10000 + ((code_unit - 0xD800) << 10) +
+                                (unit(i + 1) - 0xDC00));
+      ++i;
+    } else if (code_unit > 0xDBFF || i + 1 < units ||
+               input.size() % 2 == 0) {
+      // a lone surrogate, the unit after it is decoded on its own
+      out = write_replacement(out);
+    }
+  }
+  // a trailing odd byte, or half a pair cut short by one
+  if (input.size() % 2 != 0) {
+    out = write_replacement(out);
+  }
+  buffer.resize(static_cast<size_t>(out - buffer.data()));
+}
+
+} // namespace
+
+std::optional<Encoding> lookup_encoding(std::string_view label) {
+  while (!label.empty() && is_space(label.front())) {
+    label.remove_prefix(1);
+  }
+  while (!label.empty() && is_space(label.back())) {
+    label.remove_suffix(1);
+  }
+  if (label.empty() || label.size() > max_label_length) {
+    return std::nullopt;
+  }
+  char lowered[max_label_length];
+  std::transform(label.begin(), label.end(), lowered, to_ascii_lower);
+  std::string_view key(lowered, label.size());
+
+  const auto *it = std::lower_bound(
+      std::begin(labels), std::end(labels), key,
+      [](const Label &l, std::string_view k) { return l.label < k; });
+  if (it == std::end(labels) || it->label != key) {
+    return std::nullopt;
+  }
+  return it->encoding;
+}
+
+std::string_view encoding_name(Encoding encoding) {
+  switch (encoding) {
+  case Encoding::Utf8:
+    return "UTF-8";
+  case Encoding::Utf16Le:
+    return "UTF-16LE";
+  case Encoding::Utf16Be:
+    return "UTF-16BE";
+  case Encoding::Windows1252:
+    return "windows-1252";
+  case Encoding::Iso8859_2:
+    return "ISO-8859-2";
+  case Encoding::Iso8859_3:
+    return "ISO-8859-3";
+  case Encoding::Iso8859_4:
+    return "ISO-8859-4";
+  case Encoding::Iso8859_5:
+    return "ISO-8859-5";
+  case Encoding::Iso8859_6:
+    return "ISO-8859-6";
+  case Encoding::Iso8859_7:
+    return "ISO-8859-7";
+  case Encoding::Iso8859_8:
+    return "ISO-8859-8";
+  case Encoding::Iso8859_10:
+    return "ISO-8859-10";
+  case Encoding::Iso8859_13:
+    return "ISO-8859-13";
+  case Encoding::Iso8859_14:
+    return "ISO-8859-14";
+  case Encoding::Iso8859_15:
+    return "ISO-8859-15";
+  case Encoding::Iso8859_16:
+    return "ISO-8859-16";
+  }
+  return {};
+}
+
+Encoding sniff_encoding(std::string_view input, std::optional<Encoding> hint) {
+  return sniff(input, hint).encoding;
+}
+
+SniffResult sniff(std::string_view input, std::optional<Encoding> hint) {
+  if (auto bom = sniff_bom(input)) {
+    return {bom->first};
+  }
+  if (hint) {
+    return {*hint};
+  }
+  if (auto declared = prescan_encoding(input)) {
+    return {*declared};
+  }
+  if (is_valid_utf8(input)) {
+    return {Encoding::Utf8, true};
+  }
+  return {Encoding::Windows1252};
+}
+
+std::optional<Encoding> prescan_encoding(std::string_view input) {
+  input = input.substr(0, std::min<size_t>(input.size(), 1024));
+  std::string name;
+  std::string value;
+  std::vector<std::string> seen;
+
+  for (size_t i = 0; i < input.size(); ++i) {
+    std::string_view rest = input.substr(i);
+    if (rest.starts_with("<!--")) {
+      // "<!-->" closes too, the dashes may be those of the opening
+      size_t end = input.find("-->", i + 2);
+      if (end == std::string_view::npos) {
+        break;
+      }
+      i = end + 2;
+    } else if (starts_with_ignoring_case(rest, "<meta") && rest.size() > 5 &&
+               (is_space(rest[5]) || rest[5] == '/')) {
+      i += 6;
+      seen.clear();
+      bool got_pragma = false;
+      // unset until a charset or content attribute says which
+      std::optional<bool> need_pragma;
+      bool charset_seen = false;
+      std::optional<Encoding> charset;
+      while (get_attribute(input, i, name, value)) {
+        if (std::find(seen.begin(), seen.end(), name) != seen.end()) {
+          continue;
+        }
+        seen.push_back(name);
+        if (name == "http-equiv") {
+          got_pragma = got_pragma || value == "content-type";
+        } else if (name == "content") {
+          if (!charset_seen) {
+            if (auto extracted = extract_meta_charset(value)) {
+              charset = extracted;
+              charset_seen = true;
+              need_pragma = true;
+            }
+          }
+        } else if (name == "charset") {
+          charset = lookup_encoding(value);
+          charset_seen = true;
+          need_pragma = false;
+        }
+      }
+      if (need_pragma && (!*need_pragma || got_pragma) && charset) {
+        // a document that could declare it isn't UTF-16, since the
+        // declaration itself was read as ASCII
+        if (*charset == Encoding::Utf16Le || *charset == Encoding::Utf16Be) {
+          return Encoding::Utf8;
+        }
+        return charset;
+      }
+    } else if (rest.size() >= 2 && rest[0] == '<' &&
+               (is_ascii_alpha(rest[1]) ||
+                (rest[1] == '/' && rest.size() >= 3 &&
+                 is_ascii_alpha(rest[2])))) {
+      while (i < input.size() && !is_space(input[i]) && input[i] != '>') {
+        ++i;
+      }
+      while (get_attribute(input, i, name, value)) {
+      }
+    } else if (rest.starts_with("<!") || rest.starts_with("</") ||
+               rest.starts_with("<?")) {
+      size_t end = input.find('>', i + 2);
+      if (end == std::string_view::npos) {
+        break;
+      }
+      i = end;
+    }
+  }
+  return std::nullopt;
+}
+
+bool is_valid_utf8(std::string_view input) {
+#if defined(OSMIUM_HTML_UTF8_SSSE3)
+  static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+  if (has_ssse3) {
+    return is_valid_utf8_ssse3(input);
+  }
+#endif
+  return is_valid_utf8_scalar(input);
+}
+
+std::string_view decode_to_utf8(std::string_view input, Encoding encoding,
+                                std::string &buffer) {
+  // https://encoding.spec.whatwg.org/#decode
+  // a byte order mark wins over the encoding passed in
+  if (auto bom = sniff_bom(input)) {
+    encoding = bom->first;
+    input.remove_prefix(bom->second);
+  }
+
+  buffer.clear();
+  switch (encoding) {
+  case Encoding::Utf8:
+    if (is_valid_utf8(input)) {
+      return input;
+    }
+    decode_utf8(input, buffer);
+    return buffer;
+  case Encoding::Utf16Le:
+  case Encoding::Utf16Be:
+    decode_utf16(input, encoding == Encoding::Utf16Be, buffer);
+    return buffer;
+  default:
+    break;
+  }
+
+  // ASCII means the same in every single-byte encoding
+  if (ascii_prefix_length(input) == input.size()) {
+    return input;
+  }
+  decode_single_byte(input, *single_byte_index(encoding), buffer);
+  return buffer;
+}
+
+std::string_view decode_to_utf8(std::string_view input,
+                                const SniffResult &sniffed,
+                                std::string &buffer) {
+  // there is no byte order mark either, it would have been sniffed
+  if (sniffed.valid_utf8) {
+    buffer.clear();
+    return input;
+  }
+  return decode_to_utf8(input, sniffed.encoding, buffer);
+}
+
+size_t character_boundary(std::string_view input, Encoding encoding) {
+  const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+  size_t size = input.size();
+  switch (encoding) {
+  case Encoding::Utf8: {
+    // back to the lead byte of the last sequence, which is cut off if it
+    // promised more bytes than there are
+    size_t continuations = 0;
+    while (continuations < 3 && continuations < size &&
+           (data[size - 1 - continuations] & 0xC0) == 0x80) {
+      ++continuations;
+    }
+    if (continuations == size) {
+      return size;
+    }
+    unsigned char b = data[size - 1 - continuations];
+    size_t length = b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : b >= 0xC0 ? 2 : 1;
+    return continuations + 1 < length ? size - 1 - continuations : size;
+  }
+  case Encoding::Utf16Le:
+  case Encoding::Utf16Be: {
+    size -= size % 2;
+    if (size >= 2) {
+      unsigned char high =
+          encoding == Encoding::Utf16Be ? data[size - 2] : data[size - 1];
+      // the first half of a surrogate pair
+      if (high >= 0xD8 && high <= 0xDB) {
+        size -= 2;
+      }
+    }
+    return size;
+  }
+  default:
+    return size;
+  }
+}
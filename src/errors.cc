@@ -0,0 +1,99 @@
+#include "errors.hh"
+
+std::string_view to_string(ParseErrorCode code) {
+  switch (code) {
+  case ParseErrorCode::AbruptClosingOfEmptyComment:
+    return "abrupt-closing-of-empty-comment";
+  case ParseErrorCode::AbruptDoctypePublicIdentifier:
+    return "abrupt-doctype-public-identifier";
+  case ParseErrorCode::AbruptDoctypeSystemIdentifier:
+    return "abrupt-doctype-system-identifier";
+  case ParseErrorCode::AbsenceOfDigitsInNumericCharacterReference:
+    return "absence-of-digits-in-numeric-character-reference";
+  case ParseErrorCode::CdataInHtmlContent:
+    return "cdata-in-html-content";
+  case ParseErrorCode::CharacterReferenceOutsideUnicodeRange:
+    return "character-reference-outside-unicode-range";
+  case ParseErrorCode::ControlCharacterReference:
+    return "control-character-reference";
+  case ParseErrorCode::DuplicateAttribute:
+    return "duplicate-attribute";
+  case ParseErrorCode::EndTagWithAttributes:
+    return "end-tag-with-attributes";
+  case ParseErrorCode::EndTagWithTrailingSolidus:
+    return "end-tag-with-trailing-solidus";
+  case ParseErrorCode::EofBeforeTagName:
+    return "eof-before-tag-name";
+  case ParseErrorCode::EofInCdata:
+    return "eof-in-cdata";
+  case ParseErrorCode::EofInComment:
+    return "eof-in-comment";
+  case ParseErrorCode::EofInDoctype:
+    return "eof-in-doctype";
+  case ParseErrorCode::EofInScriptHtmlCommentLikeText:
+    return "eof-in-script-html-comment-like-text";
+  case ParseErrorCode::EofInTag:
+    return "eof-in-tag";
+  case ParseErrorCode::IncorrectlyClosedComment:
+    return "incorrectly-closed-comment";
+  case ParseErrorCode::IncorrectlyOpenedComment:
+    return "incorrectly-opened-comment";
+  case ParseErrorCode::InvalidCharacterSequenceAfterDoctypeName:
+    return "invalid-character-sequence-after-doctype-name";
+  case ParseErrorCode::InvalidFirstCharacterOfTagName:
+    return "invalid-first-character-of-tag-name";
+  case ParseErrorCode::MissingAttributeValue:
+    return "missing-attribute-value";
+  case ParseErrorCode::MissingDoctypeName:
+    return "missing-doctype-name";
+  case ParseErrorCode::MissingDoctypePublicIdentifier:
+    return "missing-doctype-public-identifier";
+  case ParseErrorCode::MissingDoctypeSystemIdentifier:
+    return "missing-doctype-system-identifier";
+  case ParseErrorCode::MissingEndTagName:
+    return "missing-end-tag-name";
+  case ParseErrorCode::MissingQuoteBeforeDoctypePublicIdentifier:
+    return "missing-quote-before-doctype-public-identifier";
+  case ParseErrorCode::MissingQuoteBeforeDoctypeSystemIdentifier:
+    return "missing-quote-before-doctype-system-identifier";
+  case ParseErrorCode::MissingSemicolonAfterCharacterReference:
+    return "missing-semicolon-after-character-reference";
+  case ParseErrorCode::MissingWhitespaceAfterDoctypePublicKeyword:
+    return "missing-whitespace-after-doctype-public-keyword";
+  case ParseErrorCode::MissingWhitespaceAfterDoctypeSystemKeyword:
+    return "missing-whitespace-after-doctype-system-keyword";
+  case ParseErrorCode::MissingWhitespaceBeforeDoctypeName:
+    return "missing-whitespace-before-doctype-name";
+  case ParseErrorCode::MissingWhitespaceBetweenAttributes:
+    return "missing-whitespace-between-attributes";
+  case ParseErrorCode::MissingWhitespaceBetweenDoctypePublicAndSystemIdentifiers:
+    return "missing-whitespace-between-doctype-public-and-system-identifiers";
+  case ParseErrorCode::NestedComment:
+    return "nested-comment";
+  case ParseErrorCode::NonVoidHtmlElementStartTagWithTrailingSolidus:
+    return "non-void-html-element-start-tag-with-trailing-solidus";
+  case ParseErrorCode::NoncharacterCharacterReference:
+    return "noncharacter-character-reference";
+  case ParseErrorCode::NullCharacterReference:
+    return "null-character-reference";
+  case ParseErrorCode::SurrogateCharacterReference:
+    return "surrogate-character-reference";
+  case ParseErrorCode::UnexpectedCharacterAfterDoctypeSystemIdentifier:
+    return "unexpected-character-after-doctype-system-identifier";
+  case ParseErrorCode::UnexpectedCharacterInAttributeName:
+    return "unexpected-character-in-attribute-name";
+  case ParseErrorCode::UnexpectedCharacterInUnquotedAttributeValue:
+    return "unexpected-character-in-unquoted-attribute-value";
+  case ParseErrorCode::UnexpectedEqualsSignBeforeAttributeName:
+    return "unexpected-equals-sign-before-attribute-name";
+  case ParseErrorCode::UnexpectedNullCharacter:
+    return "unexpected-null-character";
+  case ParseErrorCode::UnexpectedQuestionMarkInsteadOfTagName:
+    return "unexpected-question-mark-instead-of-tag-name";
+  case ParseErrorCode::UnexpectedSolidusInTag:
+    return "unexpected-solidus-in-tag";
+  case ParseErrorCode::UnknownNamedCharacterReference:
+    return "unknown-named-character-reference";
+  }
+  return "";
+}
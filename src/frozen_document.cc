@@ -0,0 +1,150 @@
+#include "frozen_document.hh"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+std::optional<std::string_view>
+FrozenDocument::attribute(NodeId id, std::string_view name) const {
+  auto attributes = this->attributes(id);
+  auto it = std::lower_bound(
+      attributes.begin(), attributes.end(), name,
+      [](const Attribute &a, std::string_view n) { return a.name < n; });
+  if (it == attributes.end() || it->name != name) {
+    return std::nullopt;
+  }
+  return it->value;
+}
+
+SourcePosition FrozenDocument::position(NodeId id) const {
+  auto range = m_nodes[id].source_range;
+  if (!range.is_valid() || !m_line_table) {
+    return {};
+  }
+  return m_line_table->position(range.offset);
+}
+
+namespace {
+
+// document order, without recursion since trees can be deep
+template <typename F> void walk(const NodePtr &root, F &&visit) {
+  std::vector<std::pair<const ::Node *, FrozenDocument::NodeId>> stack;
+  stack.emplace_back(root.get(), FrozenDocument::no_node);
+  while (!stack.empty()) {
+    auto [node, parent] = stack.back();
+    stack.pop_back();
+    auto id = visit(*node, parent);
+    if (node->is_element()) {
+      const auto &children = static_cast<const Element *>(node)->children();
+      for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        stack.emplace_back(it->get(), id);
+      }
+    }
+  }
+}
+
+} // namespace
+
+FrozenDocument freeze(const Document &document) {
+  FrozenDocument frozen;
+  frozen.m_limits_exceeded = document.limits_exceeded();
+  if (!document.root()) {
+    return frozen;
+  }
+
+  // sized up front so that the string views into it stay valid
+  size_t nodes = 0;
+  size_t attributes = 0;
+  size_t bytes = 0;
+  bool has_positions = false;
+  walk(document.root(), [&](const ::Node &node, FrozenDocument::NodeId) {
+    nodes++;
+    has_positions = has_positions || node.source_range().is_valid();
+    if (!node.is_element()) {
+      bytes += static_cast<const TextNode &>(node).content().size();
+      return FrozenDocument::no_node;
+    }
+    const auto &element = static_cast<const Element &>(node);
+    bytes += element.name().size();
+    for (const auto &[name, value] : element.attributes()) {
+      attributes++;
+      bytes += name.size() + value.size();
+    }
+    return FrozenDocument::no_node;
+  });
+
+  // the source is only there to look up positions in, which a document
+  // parsed without track_positions has none of
+  if (has_positions) {
+    frozen.m_source = document.source();
+    frozen.m_line_table.emplace(frozen.m_source);
+  }
+
+  frozen.m_nodes.reserve(nodes);
+  frozen.m_attributes.reserve(attributes);
+  frozen.m_strings = std::make_unique<char[]>(std::max<size_t>(bytes, 1));
+  char *strings = frozen.m_strings.get();
+  size_t used = 0;
+  auto store = [&](std::string_view s) {
+    std::memcpy(strings + used, s.data(), s.size());
+    std::string_view stored(strings + used, s.size());
+    used += s.size();
+    return stored;
+  };
+
+  // the last child seen so far of each node, to link up siblings
+  std::vector<FrozenDocument::NodeId> last_child;
+  last_child.reserve(nodes);
+  walk(document.root(), [&](const ::Node &node,
+                            FrozenDocument::NodeId parent) {
+    auto id = static_cast<FrozenDocument::NodeId>(frozen.m_nodes.size());
+    auto &frozen_node = frozen.m_nodes.emplace_back();
+    last_child.push_back(FrozenDocument::no_node);
+    frozen_node.parent = parent;
+    frozen_node.source_range = node.source_range();
+    if (parent != FrozenDocument::no_node) {
+      if (last_child[parent] == FrozenDocument::no_node) {
+        frozen.m_nodes[parent].first_child = id;
+      } else {
+        frozen.m_nodes[last_child[parent]].next_sibling = id;
+      }
+      last_child[parent] = id;
+    }
+
+    if (!node.is_element()) {
+      frozen_node.data = store(static_cast<const TextNode &>(node).content());
+      return id;
+    }
+
+    const auto &element = static_cast<const Element &>(node);
+    frozen_node.is_element = true;
+    frozen_node.tag = element.tag();
+    frozen_node.data = store(element.name());
+    auto begin = frozen.m_attributes.size();
+    for (const auto &[name, value] : element.attributes()) {
+      frozen.m_attributes.push_back({store(name), store(value)});
+    }
+    std::sort(frozen.m_attributes.begin() + static_cast<long>(begin),
+              frozen.m_attributes.end(),
+              [](const FrozenDocument::Attribute &a,
+                 const FrozenDocument::Attribute &b) { return a.name < b.name; });
+    frozen_node.attributes_begin = static_cast<uint32_t>(begin);
+    frozen_node.attributes_end =
+        static_cast<uint32_t>(frozen.m_attributes.size());
+    return id;
+  });
+
+  // a subtree ends where the next sibling of its root, or of the nearest
+  // ancestor that has one, begins. parents come first, so theirs is known.
+  auto size = static_cast<FrozenDocument::NodeId>(frozen.m_nodes.size());
+  for (auto &node : frozen.m_nodes) {
+    if (node.next_sibling != FrozenDocument::no_node) {
+      node.subtree_end = node.next_sibling;
+    } else if (node.parent != FrozenDocument::no_node) {
+      node.subtree_end = frozen.m_nodes[node.parent].subtree_end;
+    } else {
+      node.subtree_end = size;
+    }
+  }
+
+  return frozen;
+}
@@ -0,0 +1,156 @@
+#include "link_extractor.hh"
+#include "url.hh"
+
+namespace {
+
+bool is_whitespace(char c) {
+  return c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+// the attribute of a tag that holds a URL, empty for other tags
+std::string_view url_attribute(Tag tag) {
+  switch (tag) {
+  case Tag::A:
+  case Tag::Link:
+    return "href";
+  case Tag::Img:
+  case Tag::Script:
+  case Tag::Iframe:
+    return "src";
+  default:
+    return {};
+  }
+}
+
+} // namespace
+
+std::span<const LinkExtractor::Link>
+LinkExtractor::extract(std::string_view html, std::string_view document_url) {
+  m_raw.clear();
+  m_raw_links.clear();
+  m_base_href.clear();
+  m_saw_base = false;
+
+  ParseOptions options = m_options;
+  options.track_positions = false;
+  Tokenizer tokenizer(html, options);
+  tokenizer.run(*this);
+
+  // https://html.spec.whatwg.org/multipage/urls-and-fetching.html#document-base-url
+  // the base applies to links before it too, so resolving waits until the
+  // whole page has been seen. the document's own URL goes through
+  // resolve_url() as well, so that it is written the same way as the links.
+  m_base.clear();
+  resolve_url(document_url, m_saw_base ? m_base_href : std::string_view(),
+              m_base);
+
+  // each raw link is turned into the range of its resolved URL, the views
+  // are only taken once the buffer has stopped growing
+  m_urls.clear();
+  for (auto &link : m_raw_links) {
+    size_t start = m_urls.size();
+    std::string_view raw(m_raw.data() + link.offset, link.length);
+    // href="" is a link to the base
+    resolve_url(m_base, raw, m_urls);
+    if (size_t hash = m_urls.find('#', start); hash != std::string::npos) {
+      m_urls.resize(hash);
+    }
+    link.offset = start;
+    link.length = m_urls.size() - start;
+  }
+
+  m_links.clear();
+  m_seen.clear();
+  for (const auto &link : m_raw_links) {
+    std::string_view url(m_urls.data() + link.offset, link.length);
+    if (m_seen.insert(url).second) {
+      m_links.push_back({url, link.tag});
+    }
+  }
+  return m_links;
+}
+
+void LinkExtractor::emit(Token &token) {
+  if (token.type() != TokenType::StartTag) {
+    return;
+  }
+  Tag tag = lookup_tag(token.data());
+  if (tag == Tag::Base) {
+    // https://html.spec.whatwg.org/multipage/semantics.html#frozen-base-url
+    // only the first base with an href counts
+    if (m_saw_base) {
+      return;
+    }
+    for (const auto &attribute : token.attributes()) {
+      if (attribute.name == "href") {
+        m_base_href = attribute.value;
+        m_saw_base = true;
+        break;
+      }
+    }
+    return;
+  }
+
+  std::string_view name = url_attribute(tag);
+  bool has_srcset = tag == Tag::Img || tag == Tag::Source;
+  if (name.empty() && !has_srcset) {
+    return;
+  }
+  // the tokenizer has dropped all but the first of attributes with the same
+  // name already
+  for (const auto &attribute : token.attributes()) {
+    if (!name.empty() && attribute.name == name) {
+      add(attribute.value, tag);
+    } else if (has_srcset && attribute.name == "srcset") {
+      add_srcset(attribute.value, tag);
+    }
+  }
+}
+
+void LinkExtractor::add(std::string_view value, Tag tag) {
+  m_raw_links.push_back({m_raw.size(), value.size(), tag});
+  m_raw.append(value);
+}
+
+// https://html.spec.whatwg.org/multipage/images.html#parse-a-srcset-attribute
+// only the URLs are of interest, the descriptors after each are skipped
+void LinkExtractor::add_srcset(std::string_view srcset, Tag tag) {
+  size_t i = 0;
+  size_t size = srcset.size();
+  while (i < size) {
+    while (i < size && (is_whitespace(srcset[i]) || srcset[i] == ',')) {
+      ++i;
+    }
+    size_t start = i;
+    while (i < size && !is_whitespace(srcset[i])) {
+      ++i;
+    }
+    std::string_view url = srcset.substr(start, i - start);
+    if (url.empty()) {
+      break;
+    }
+
+    if (url.back() == ',') {
+      // "a.png, b.png" has no descriptors, the comma ends the candidate
+      while (!url.empty() && url.back() == ',') {
+        url.remove_suffix(1);
+      }
+    } else {
+      // descriptors run to the next comma outside parentheses
+      bool in_parens = false;
+      for (; i < size; ++i) {
+        char c = srcset[i];
+        if (c == '(') {
+          in_parens = true;
+        } else if (c == ')') {
+          in_parens = false;
+        } else if (c == ',' && !in_parens) {
+          break;
+        }
+      }
+    }
+    if (!url.empty()) {
+      add(url, tag);
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#include "open_elements.hh"
+#include <algorithm>
+
+void OpenElementStack::push(const ElementPtr &element) {
+  m_elements.push_back(element);
+  index(m_elements.size() - 1);
+}
+
+ElementPtr OpenElementStack::pop() {
+  unindex(m_elements.size() - 1);
+  auto element = m_elements.back();
+  m_elements.pop_back();
+  return element;
+}
+
+// inserting or removing in the middle shifts every index above it. this only
+// happens in the adoption agency algorithm and when closing forms, and the
+// stack is bounded by ParseLimits::max_depth, so a rebuild is cheap enough.
+void OpenElementStack::insert(size_t i, const ElementPtr &element) {
+  m_elements.insert(m_elements.begin() + static_cast<long>(i), element);
+  reindex();
+}
+
+ElementPtr OpenElementStack::erase(size_t i) {
+  auto element = m_elements[i];
+  m_elements.erase(m_elements.begin() + static_cast<long>(i));
+  reindex();
+  return element;
+}
+
+void OpenElementStack::replace(size_t i, const ElementPtr &element) {
+  if (m_elements[i]->tag() == element->tag()) {
+    m_elements[i] = element;
+    return;
+  }
+  m_elements[i] = element;
+  reindex();
+}
+
+std::optional<size_t>
+OpenElementStack::index_of(const Element *element) const {
+  const auto &positions = m_positions[static_cast<size_t>(element->tag())];
+  for (auto it = positions.rbegin(); it != positions.rend(); it++) {
+    if (m_elements[*it].get() == element) {
+      return *it;
+    }
+  }
+  return std::nullopt;
+}
+
+std::optional<size_t> OpenElementStack::last_index_of(Tag tag) const {
+  const auto &positions = m_positions[static_cast<size_t>(tag)];
+  if (positions.empty()) {
+    return std::nullopt;
+  }
+  return positions.back();
+}
+
+bool OpenElementStack::has_in_scope(Tag tag, Scope scope) const {
+  auto i = last_index_of(tag);
+  return i && above_boundary(*i, scope);
+}
+
+bool OpenElementStack::has_any_in_scope(std::initializer_list<Tag> tags,
+                                        Scope scope) const {
+  return std::any_of(tags.begin(), tags.end(),
+                     [this, scope](Tag tag) { return has_in_scope(tag, scope); });
+}
+
+bool OpenElementStack::has_in_scope(const Element *element,
+                                    Scope scope) const {
+  auto i = index_of(element);
+  return i && above_boundary(*i, scope);
+}
+
+void OpenElementStack::index(size_t i) {
+  const Element &element = *m_elements[i];
+  m_positions[static_cast<size_t>(element.tag())].push_back(
+      static_cast<uint32_t>(i));
+  for (size_t scope = 0; scope < scope_count; scope++) {
+    if (is_scope_boundary(element, static_cast<Scope>(scope))) {
+      m_boundaries[scope].push_back(static_cast<uint32_t>(i));
+    }
+  }
+}
+
+void OpenElementStack::unindex(size_t i) {
+  const Element &element = *m_elements[i];
+  m_positions[static_cast<size_t>(element.tag())].pop_back();
+  for (size_t scope = 0; scope < scope_count; scope++) {
+    if (is_scope_boundary(element, static_cast<Scope>(scope))) {
+      m_boundaries[scope].pop_back();
+    }
+  }
+}
+
+void OpenElementStack::reindex() {
+  for (auto &positions : m_positions) {
+    positions.clear();
+  }
+  for (auto &boundaries : m_boundaries) {
+    boundaries.clear();
+  }
+  for (size_t i = 0; i < m_elements.size(); i++) {
+    index(i);
+  }
+}
+
+// an element at index i is in scope if no boundary element sits above it. the
+// element itself may be a boundary, e.g. a table in table scope.
+bool OpenElementStack::above_boundary(size_t i, Scope scope) const {
+  const auto &boundaries = m_boundaries[static_cast<size_t>(scope)];
+  return boundaries.empty() || i >= boundaries.back();
+}
+
+bool OpenElementStack::is_scope_boundary(const Element &element, Scope scope) {
+  Tag tag = element.tag();
+  switch (scope) {
+  case Scope::Select:
+    return tag != Tag::Optgroup && tag != Tag::Option;
+  case Scope::Table:
+    return tag == Tag::Html || tag == Tag::Table || tag == Tag::Template;
+  case Scope::ListItem:
+    if (tag == Tag::Ol || tag == Tag::Ul) {
+      return true;
+    }
+    break;
+  case Scope::Button:
+    if (tag == Tag::Button) {
+      return true;
+    }
+    break;
+  case Scope::Default:
+    break;
+  }
+  if (element.ns() == Namespace::MathMl) {
+    const std::string &name = element.name();
+    return name == "mi" || name == "mo" || name == "mn" || name == "ms" ||
+           name == "mtext" || name == "annotation-xml";
+  }
+  if (element.ns() == Namespace::Svg) {
+    const std::string &name = element.name();
+    return name == "foreignObject" || name == "desc" || name == "title";
+  }
+  return tag == Tag::Applet || tag == Tag::Caption || tag == Tag::Html ||
+         tag == Tag::Table || tag == Tag::Td || tag == Tag::Th ||
+         tag == Tag::Marquee || tag == Tag::Object || tag == Tag::Template;
+}
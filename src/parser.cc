@@ -1,86 +1,3137 @@
 #include "parser.hh"
+#include "subtree_hash.hh"
 #include "tokenizer.hh"
+#include <algorithm>
 #include <cassert>
+#include <initializer_list>
+#include <iterator>
 #include <memory>
+#include <unordered_map>
+
+namespace {
+
+// U+FFFD REPLACEMENT CHARACTER
+constexpr std::string_view replacement_character = "\xEF\xBF\xBD";
+
+// the tokenizer lowercases names, these get their case back in svg and math
+class CaseTable {
+public:
+  CaseTable(std::initializer_list<std::string_view> names) {
+    for (auto name : names) {
+      std::string lowercase(name);
+      std::transform(lowercase.begin(), lowercase.end(), lowercase.begin(),
+                     [](char c) {
+                       return c >= 'A' && c <= 'Z'
+                                  ? static_cast<char>(c + ('a' - 'A'))
+                                  : c;
+                     });
+      m_names.emplace(std::move(lowercase), name);
+    }
+  }
+
+  void adjust(std::string &name) const {
+    auto it = m_names.find(name);
+    if (it != m_names.end()) {
+      name = it->second;
+    }
+  }
+
+private:
+  std::unordered_map<std::string, std::string_view> m_names;
+};
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inforeign
+const CaseTable &svg_tag_names() {
+  static const CaseTable table = {
+      "altGlyph",         "altGlyphDef",       "altGlyphItem",
+      "animateColor",     "animateMotion",     "animateTransform",
+      "clipPath",         "feBlend",           "feColorMatrix",
+      "feComponentTransfer", "feComposite",    "feConvolveMatrix",
+      "feDiffuseLighting", "feDisplacementMap", "feDistantLight",
+      "feDropShadow",     "feFlood",           "feFuncA",
+      "feFuncB",          "feFuncG",           "feFuncR",
+      "feGaussianBlur",   "feImage",           "feMerge",
+      "feMergeNode",      "feMorphology",      "feOffset",
+      "fePointLight",     "feSpecularLighting", "feSpotLight",
+      "feTile",           "feTurbulence",      "foreignObject",
+      "glyphRef",         "linearGradient",    "radialGradient",
+      "textPath",
+  };
+  return table;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#adjust-svg-attributes
+const CaseTable &svg_attribute_names() {
+  static const CaseTable table = {
+      "attributeName",    "attributeType",     "baseFrequency",
+      "baseProfile",      "calcMode",          "clipPathUnits",
+      "diffuseConstant",  "edgeMode",          "filterUnits",
+      "glyphRef",         "gradientTransform", "gradientUnits",
+      "kernelMatrix",     "kernelUnitLength",  "keyPoints",
+      "keySplines",       "keyTimes",          "lengthAdjust",
+      "limitingConeAngle", "markerHeight",     "markerUnits",
+      "markerWidth",      "maskContentUnits",  "maskUnits",
+      "numOctaves",       "pathLength",        "patternContentUnits",
+      "patternTransform", "patternUnits",      "pointsAtX",
+      "pointsAtY",        "pointsAtZ",         "preserveAlpha",
+      "preserveAspectRatio", "primitiveUnits", "refX",
+      "refY",             "repeatCount",       "repeatDur",
+      "requiredExtensions", "requiredFeatures", "specularConstant",
+      "specularExponent", "spreadMethod",      "startOffset",
+      "stdDeviation",     "stitchTiles",       "surfaceScale",
+      "systemLanguage",   "tableValues",       "targetX",
+      "targetY",          "textLength",        "viewBox",
+      "viewTarget",       "xChannelSelector",  "yChannelSelector",
+      "zoomAndPan",
+  };
+  return table;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#adjust-mathml-attributes
+const CaseTable &mathml_attribute_names() {
+  static const CaseTable table = {"definitionURL"};
+  return table;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inforeign
+// start tags that can't be in svg or math and close them instead
+bool breaks_out_of_foreign_content(const Token &t) {
+  switch (lookup_tag(t.data())) {
+  case Tag::B:
+  case Tag::Big:
+  case Tag::Blockquote:
+  case Tag::Body:
+  case Tag::Br:
+  case Tag::Center:
+  case Tag::Code:
+  case Tag::Dd:
+  case Tag::Div:
+  case Tag::Dl:
+  case Tag::Dt:
+  case Tag::Em:
+  case Tag::Embed:
+  case Tag::H1:
+  case Tag::H2:
+  case Tag::H3:
+  case Tag::H4:
+  case Tag::H5:
+  case Tag::H6:
+  case Tag::Head:
+  case Tag::Hr:
+  case Tag::I:
+  case Tag::Img:
+  case Tag::Li:
+  case Tag::Listing:
+  case Tag::Menu:
+  case Tag::Meta:
+  case Tag::Nobr:
+  case Tag::Ol:
+  case Tag::P:
+  case Tag::Pre:
+  case Tag::Ruby:
+  case Tag::S:
+  case Tag::Small:
+  case Tag::Span:
+  case Tag::Strike:
+  case Tag::Strong:
+  case Tag::Sub:
+  case Tag::Sup:
+  case Tag::Table:
+  case Tag::Tt:
+  case Tag::U:
+  case Tag::Ul:
+    return true;
+  case Tag::Font:
+    return std::any_of(t.attributes().begin(), t.attributes().end(),
+                       [](const Token::Attribute &attr) {
+                         return attr.name == "color" || attr.name == "face" ||
+                                attr.name == "size";
+                       });
+  default:
+    return t.data() == "var";
+  }
+}
+
+bool equals_ignoring_ascii_case(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           auto lower = [](char c) {
+             return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A'))
+                                         : c;
+           };
+           return lower(x) == lower(y);
+         });
+}
+
+bool starts_with_ignoring_ascii_case(std::string_view s,
+                                     std::string_view prefix) {
+  return s.size() >= prefix.size() &&
+         equals_ignoring_ascii_case(s.substr(0, prefix.size()), prefix);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-initial-insertion-mode
+QuirksMode quirks_mode_of(const Token &doctype) {
+  static constexpr std::string_view quirky_public_prefixes[] = {
+      "+//Silmaril//dtd html Pro v0r11 19970101//",
+      "-//AS//DTD HTML 3.0 asWedit + extensions//",
+      "-//AdvaSoft Ltd//DTD HTML 3.0 asWedit + extensions//",
+      "-//IETF//DTD HTML 2.0 Level 1//",
+      "-//IETF//DTD HTML 2.0 Level 2//",
+      "-//IETF//DTD HTML 2.0 Strict Level 1//",
+      "-//IETF//DTD HTML 2.0 Strict Level 2//",
+      "-//IETF//DTD HTML 2.0 Strict//",
+      "-//IETF//DTD HTML 2.0//",
+      "-//IETF//DTD HTML 2.1E//",
+      "-//IETF//DTD HTML 3.0//",
+      "-//IETF//DTD HTML 3.2 Final//",
+      "-//IETF//DTD HTML 3.2//",
+      "-//IETF//DTD HTML 3//",
+      "-//IETF//DTD HTML Level 0//",
+      "-//IETF//DTD HTML Level 1//",
+      "-//IETF//DTD HTML Level 2//",
+      "-//IETF//DTD HTML Level 3//",
+      "-//IETF//DTD HTML Strict Level 0//",
+      "-//IETF//DTD HTML Strict Level 1//",
+      "-//IETF//DTD HTML Strict Level 2//",
+      "-//IETF//DTD HTML Strict Level 3//",
+      "-//IETF//DTD HTML Strict//",
+      "-//IETF//DTD HTML//",
+      "-//Metrius//DTD Metrius Presentational//",
+      "-//Microsoft//DTD Internet Explorer 2.0 HTML Strict//",
+      "-//Microsoft//DTD Internet Explorer 2.0 HTML//",
+      "-//Microsoft//DTD Internet Explorer 2.0 Tables//",
+      "-//Microsoft//DTD Internet Explorer 3.0 HTML Strict//",
+      "-//Microsoft//DTD Internet Explorer 3.0 HTML//",
+      "-//Microsoft//DTD Internet Explorer 3.0 Tables//",
+      "-//Netscape Comm. Corp.//DTD HTML//",
+      "-//Netscape Comm. Corp.//DTD Strict HTML//",
+      "-//O'Reilly and Associates//DTD HTML 2.0//",
+      "-//O'Reilly and Associates//DTD HTML Extended 1.0//",
+      "-//O'Reilly and Associates//DTD HTML Extended Relaxed 1.0//",
+      "-//SQ//DTD HTML 2.0 HoTMetaL + extensions//",
+      "-//SoftQuad Software//DTD HoTMetaL PRO "
+      "6.0::19990601::extensions to HTML 4.0//",
+      "-//SoftQuad//DTD HoTMetaL PRO 4.0::19971010::extensions to HTML 4.0//",
+      "-//Spyglass//DTD HTML 2.0 Extended//",
+      "-//Sun Microsystems Corp.//DTD HotJava HTML//",
+      "-//Sun Microsystems Corp.//DTD HotJava Strict HTML//",
+      "-//W3C//DTD HTML 3 1995-03-24//",
+      "-//W3C//DTD HTML 3.2 Draft//",
+      "-//W3C//DTD HTML 3.2 Final//",
+      "-//W3C//DTD HTML 3.2//",
+      "-//W3C//DTD HTML 3.2S Draft//",
+      "-//W3C//DTD HTML 4.0 Frameset//",
+      "-//W3C//DTD HTML 4.0 Transitional//",
+      "-//W3C//DTD HTML Experimental 19960712//",
+      "-//W3C//DTD HTML Experimental 970421//",
+      "-//W3C//DTD W3 HTML//",
+      "-//W3O//DTD W3 HTML 3.0//",
+      "-//WebTechs//DTD Mozilla HTML 2.0//",
+      "-//WebTechs//DTD Mozilla HTML//",
+  };
+
+  if (doctype.force_quirks() || doctype.data() != "html") {
+    return QuirksMode::Quirks;
+  }
+  const auto &public_id = doctype.public_identifier();
+  const auto &system_id = doctype.system_identifier();
+  if (system_id && equals_ignoring_ascii_case(
+                       *system_id, "http://www.ibm.com/data/dtd/v11/"
+                                   "ibmxhtml1-transitional.dtd")) {
+    return QuirksMode::Quirks;
+  }
+  if (!public_id) {
+    return QuirksMode::NoQuirks;
+  }
+  if (equals_ignoring_ascii_case(*public_id,
+                                 "-//W3O//DTD W3 HTML Strict 3.0//EN//") ||
+      equals_ignoring_ascii_case(*public_id,
+                                 "-/W3C/DTD HTML 4.0 Transitional/EN") ||
+      equals_ignoring_ascii_case(*public_id, "HTML")) {
+    return QuirksMode::Quirks;
+  }
+  for (auto prefix : quirky_public_prefixes) {
+    if (starts_with_ignoring_ascii_case(*public_id, prefix)) {
+      return QuirksMode::Quirks;
+    }
+  }
+  bool html4 =
+      starts_with_ignoring_ascii_case(*public_id,
+                                      "-//W3C//DTD HTML 4.01 Frameset//") ||
+      starts_with_ignoring_ascii_case(*public_id,
+                                      "-//W3C//DTD HTML 4.01 Transitional//");
+  if (html4 && !system_id) {
+    return QuirksMode::Quirks;
+  }
+  if (html4 ||
+      starts_with_ignoring_ascii_case(*public_id,
+                                      "-//W3C//DTD XHTML 1.0 Frameset//") ||
+      starts_with_ignoring_ascii_case(*public_id,
+                                      "-//W3C//DTD XHTML 1.0 Transitional//")) {
+    return QuirksMode::LimitedQuirks;
+  }
+  return QuirksMode::NoQuirks;
+}
+
+// the text of every whitespace-only node that was collapsed
+constexpr std::string_view collapsed_whitespace = " ";
+
+bool is_collapsed_whitespace(const Node &node) {
+  return !node.is_element() &&
+         static_cast<const TextNode &>(node).content().data() ==
+             collapsed_whitespace.data();
+}
+
+// whitespace next to these doesn't render with the default styles
+bool is_whitespace_boundary(Tag tag) {
+  switch (tag) {
+  case Tag::Html:
+  case Tag::Head:
+  case Tag::Body:
+  case Tag::Br:
+  case Tag::Td:
+  case Tag::Th:
+  case Tag::Colgroup:
+  case Tag::Col:
+  case Tag::Select:
+  case Tag::Optgroup:
+    return true;
+  default:
+    return is_block_level(tag);
+  }
+}
+
+} // namespace
 
-// TODO: actually implement the spec
 std::shared_ptr<Node> Parser::parse() {
-  auto root = std::make_shared<Element>("root");
-  m_open_elements.push(root);
+  while (!eof() && !m_stopped) {
+    emit(consume());
+  }
+  return finish();
+}
 
-  while (!eof()) {
-    auto t = consume();
+void Parser::emit(Token &t) {
+  if (m_stopped || m_saw_eof) {
+    return;
+  }
+  m_self_closing_acknowledged = false;
+  process_token(t);
+  if (t.type() == TokenType::StartTag && t.is_self_closing() &&
+      !m_self_closing_acknowledged && m_error_sink != nullptr) {
+    m_error_sink->report(
+        {ParseErrorCode::NonVoidHtmlElementStartTagWithTrailingSolidus,
+         t.source_range().offset});
+  }
+  if (m_tokenizer != nullptr) {
+    m_tokenizer->set_cdata_allowed(!m_open_elements.empty() &&
+                                   current_node()->ns() != Namespace::Html);
+  }
+  m_current_token = nullptr;
+  m_last_token_range = t.source_range();
+  m_saw_eof = t.type() == TokenType::EndOfFile;
+  if (m_limits_exceeded.nodes) {
+    // treat the rest of the input as if it wasn't there
+    m_stopped = true;
+  }
+}
 
-    switch (t.type()) {
-    case TokenType::StartTag: {
-      if (!text.empty()) {
-        if (current_node()->name() != "head") {
-          current_node()->append(std::make_shared<TextNode>(text));
-        }
-        text = "";
+bool Parser::attach(Tokenizer &tokenizer) {
+  m_tokenizer = &tokenizer;
+  return true;
+}
+
+std::shared_ptr<Node> Parser::finish() {
+  if (!m_saw_eof) {
+    Token eof_token(TokenType::EndOfFile, "");
+    if (m_last_token_range.is_valid()) {
+      eof_token.set_source_range({m_last_token_range.end(), 0});
+    }
+    process_token(eof_token);
+    m_current_token = nullptr;
+    m_saw_eof = true;
+  }
+
+  // https://html.spec.whatwg.org/multipage/parsing.html#stop-parsing
+  flush_text();
+  while (!m_open_elements.empty()) {
+    pop();
+  }
+
+  // whatever wasn't hashed when it was popped: elements that never made it
+  // onto the stack, ones the adoption agency took off it, and the root
+  if (m_hash_subtrees) {
+    fill_subtree_hashes(*m_root);
+  }
+
+  return m_root;
+}
+
+void Parser::process_token(Token &t) {
+  m_current_token = &t;
+  if (t.type() != TokenType::Character) {
+    flush_text();
+    m_formatting_reconstructed = false;
+  }
+
+  if (m_skip_newline) {
+    m_skip_newline = false;
+    if (t.type() == TokenType::Character && !t.data().empty() &&
+        t.data()[0] == '\n') {
+      t.data().erase(0, 1);
+      SourceRange range = t.source_range();
+      if (range.is_valid() && range.length > 0) {
+        t.set_source_range({range.offset + 1, range.length - 1});
+      }
+      if (t.data().empty()) {
+        return;
       }
+    }
+  }
 
-      auto el = std::make_shared<Element>(t.data());
+  // https://html.spec.whatwg.org/multipage/parsing.html#tree-construction-dispatcher
+  if (uses_foreign_content_rules(t)) {
+    handle_in_foreign_content(t);
+  } else {
+    process_in_current_mode(t);
+  }
+}
 
-      for (const auto &attr : t.attributes()) {
-        el->attributes()[attr.name] = attr.value;
+void Parser::process_in_current_mode(Token &t) {
+  switch (m_mode) {
+  case InsertionMode::Initial:
+    handle_initial(t);
+    break;
+  case InsertionMode::BeforeHtml:
+    handle_before_html(t);
+    break;
+  case InsertionMode::BeforeHead:
+    handle_before_head(t);
+    break;
+  case InsertionMode::InHead:
+    handle_in_head(t);
+    break;
+  case InsertionMode::InHeadNoscript:
+    handle_in_head_noscript(t);
+    break;
+  case InsertionMode::AfterHead:
+    handle_after_head(t);
+    break;
+  case InsertionMode::InBody:
+    handle_in_body(t);
+    break;
+  case InsertionMode::Text:
+    handle_text(t);
+    break;
+  case InsertionMode::InTable:
+    handle_in_table(t);
+    break;
+  case InsertionMode::InTableText:
+    handle_in_table_text(t);
+    break;
+  case InsertionMode::InCaption:
+    handle_in_caption(t);
+    break;
+  case InsertionMode::InColumnGroup:
+    handle_in_column_group(t);
+    break;
+  case InsertionMode::InTableBody:
+    handle_in_table_body(t);
+    break;
+  case InsertionMode::InRow:
+    handle_in_row(t);
+    break;
+  case InsertionMode::InCell:
+    handle_in_cell(t);
+    break;
+  case InsertionMode::InSelect:
+    handle_in_select(t);
+    break;
+  case InsertionMode::InSelectInTable:
+    handle_in_select_in_table(t);
+    break;
+  case InsertionMode::InTemplate:
+    handle_in_template(t);
+    break;
+  case InsertionMode::AfterBody:
+    handle_after_body(t);
+    break;
+  case InsertionMode::InFrameset:
+    handle_in_frameset(t);
+    break;
+  case InsertionMode::AfterFrameset:
+    handle_after_frameset(t);
+    break;
+  case InsertionMode::AfterAfterBody:
+    handle_after_after_body(t);
+    break;
+  case InsertionMode::AfterAfterFrameset:
+    handle_after_after_frameset(t);
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-initial-insertion-mode
+void Parser::handle_initial(Token &t) {
+  if (t.type() == TokenType::Character) {
+    split_leading_whitespace(t);
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::Comment) {
+    return;
+  } else if (t.type() == TokenType::Doctype) {
+    // the DOM's DocumentType node, with its name and identifiers as
+    // attributes
+    auto doctype = std::make_shared<Element>("DOCTYPE");
+    doctype->set_source_range(t.source_range());
+    auto &attributes = doctype->attributes();
+    attributes.emplace("name", t.data());
+    if (t.public_identifier()) {
+      attributes.emplace("publicId", *t.public_identifier());
+    }
+    if (t.system_identifier()) {
+      attributes.emplace("systemId", *t.system_identifier());
+    }
+    if (allow_node()) {
+      m_root->append(doctype);
+    }
+    m_quirks_mode = quirks_mode_of(t);
+    m_mode = InsertionMode::BeforeHtml;
+    return;
+  }
+
+  m_quirks_mode = QuirksMode::Quirks;
+  m_mode = InsertionMode::BeforeHtml;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-before-html-insertion-mode
+void Parser::handle_before_html(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  if (t.type() == TokenType::Doctype || t.type() == TokenType::Comment) {
+    return;
+  }
+  if (t.type() == TokenType::Character) {
+    split_leading_whitespace(t);
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::StartTag && tag == Tag::Html) {
+    insert_element(t);
+    m_mode = InsertionMode::BeforeHead;
+    return;
+  } else if (t.type() == TokenType::EndTag && tag != Tag::Head &&
+             tag != Tag::Body && tag != Tag::Html && tag != Tag::Br) {
+    return;
+  }
+
+  insert_element("html");
+  m_mode = InsertionMode::BeforeHead;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-before-head-insertion-mode
+void Parser::handle_before_head(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  if (t.type() == TokenType::Doctype || t.type() == TokenType::Comment) {
+    return;
+  }
+  if (t.type() == TokenType::Character) {
+    split_leading_whitespace(t);
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::StartTag && tag == Tag::Html) {
+    handle_in_body(t);
+    return;
+  } else if (t.type() == TokenType::StartTag && tag == Tag::Head) {
+    m_head = insert_element(t);
+    m_mode = InsertionMode::InHead;
+    return;
+  } else if (t.type() == TokenType::EndTag && tag != Tag::Head &&
+             tag != Tag::Body && tag != Tag::Html && tag != Tag::Br) {
+    return;
+  }
+
+  m_head = insert_element("head");
+  m_mode = InsertionMode::InHead;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inhead
+void Parser::handle_in_head(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  if (t.type() == TokenType::Character) {
+    auto whitespace = split_leading_whitespace(t);
+    if (!whitespace.data().empty()) {
+      insert_text(whitespace.data(), whitespace.source_range());
+    }
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::Doctype ||
+             t.type() == TokenType::Comment) {
+    return;
+  } else if (t.type() == TokenType::StartTag) {
+    switch (tag) {
+    case Tag::Html:
+      handle_in_body(t);
+      return;
+    case Tag::Base:
+    case Tag::Basefont:
+    case Tag::Bgsound:
+    case Tag::Link:
+    case Tag::Meta:
+      insert_void_element(t);
+      return;
+    case Tag::Title:
+      insert_raw_text_element(t, TextState::Rcdata);
+      return;
+    case Tag::Noframes:
+    case Tag::Style:
+      insert_raw_text_element(t, TextState::Rawtext);
+      return;
+    case Tag::Script:
+      insert_raw_text_element(t, TextState::ScriptData);
+      return;
+    case Tag::Noscript:
+      // the scripting flag is disabled
+      if (was_pushed(insert_element(t))) {
+        m_mode = InsertionMode::InHeadNoscript;
       }
+      return;
+    case Tag::Template:
+      m_frameset_ok = false;
+      if (was_pushed(insert_element(t))) {
+        m_active_formatting.emplace_back(nullptr);
+        m_mode = InsertionMode::InTemplate;
+        m_template_modes.push_back(InsertionMode::InTemplate);
+      }
+      return;
+    case Tag::Head:
+      return;
+    default:
+      break;
+    }
+  } else if (t.type() == TokenType::EndTag) {
+    if (tag == Tag::Head) {
+      pop();
+      m_mode = InsertionMode::AfterHead;
+      return;
+    }
+    if (tag == Tag::Template) {
+      close_template_element();
+      return;
+    }
+    if (tag != Tag::Body && tag != Tag::Html && tag != Tag::Br) {
+      return;
+    }
+  }
+
+  pop();
+  m_mode = InsertionMode::AfterHead;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inheadnoscript
+void Parser::handle_in_head_noscript(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  if (t.type() == TokenType::Doctype) {
+    return;
+  }
+  if (t.type() == TokenType::Character) {
+    auto whitespace = split_leading_whitespace(t);
+    if (!whitespace.data().empty()) {
+      insert_text(whitespace.data(), whitespace.source_range());
+    }
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::Comment) {
+    return;
+  } else if (t.type() == TokenType::StartTag) {
+    switch (tag) {
+    case Tag::Html:
+      handle_in_body(t);
+      return;
+    case Tag::Basefont:
+    case Tag::Bgsound:
+    case Tag::Link:
+    case Tag::Meta:
+    case Tag::Noframes:
+    case Tag::Style:
+      handle_in_head(t);
+      return;
+    case Tag::Head:
+    case Tag::Noscript:
+      return;
+    default:
+      break;
+    }
+  } else if (t.type() == TokenType::EndTag) {
+    if (tag == Tag::Noscript) {
+      pop();
+      m_mode = InsertionMode::InHead;
+      return;
+    }
+    if (tag != Tag::Br) {
+      return;
+    }
+  }
 
-      current_node()->append(el);
+  pop();
+  m_mode = InsertionMode::InHead;
+  process_token(t);
+}
 
-      if (!t.is_self_closing() && !is_void_element(t.data())) {
-        m_open_elements.push(el);
+// https://html.spec.whatwg.org/multipage/parsing.html#the-after-head-insertion-mode
+void Parser::handle_after_head(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  if (t.type() == TokenType::Character) {
+    auto whitespace = split_leading_whitespace(t);
+    if (!whitespace.data().empty()) {
+      insert_text(whitespace.data(), whitespace.source_range());
+    }
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::Doctype ||
+             t.type() == TokenType::Comment) {
+    return;
+  } else if (t.type() == TokenType::StartTag) {
+    switch (tag) {
+    case Tag::Html:
+      handle_in_body(t);
+      return;
+    case Tag::Body:
+      insert_element(t);
+      m_frameset_ok = false;
+      m_mode = InsertionMode::InBody;
+      return;
+    case Tag::Frameset:
+      insert_element(t);
+      m_mode = InsertionMode::InFrameset;
+      return;
+    case Tag::Base:
+    case Tag::Basefont:
+    case Tag::Bgsound:
+    case Tag::Link:
+    case Tag::Meta:
+    case Tag::Noframes:
+    case Tag::Script:
+    case Tag::Style:
+    case Tag::Template:
+    case Tag::Title: {
+      // parse error, but the element still goes into the head
+      if (!m_head) {
+        break;
       }
-    }; break;
-    case TokenType::EndTag:
-      if (!text.empty()) {
-        if (current_node()->name() != "head") {
-          current_node()->append(std::make_shared<TextNode>(text));
-        }
-        text = "";
+      m_open_elements.push(m_head);
+      handle_in_head(t);
+      if (auto i = m_open_elements.index_of(m_head.get())) {
+        m_open_elements.erase(*i);
       }
+      return;
+    }
+    case Tag::Head:
+      return;
+    default:
+      break;
+    }
+  } else if (t.type() == TokenType::EndTag && tag == Tag::Template) {
+    handle_in_head(t);
+    return;
+  } else if (t.type() == TokenType::EndTag && tag != Tag::Body &&
+             tag != Tag::Html && tag != Tag::Br) {
+    return;
+  }
 
-      if (current_node()->name() != t.data()) {
-        // TODO: we really should handle this but there is like a thousand
-        // different insertion modes in the spec
-      } else {
-        m_open_elements.pop();
+  insert_element("body");
+  m_mode = InsertionMode::InBody;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inbody
+void Parser::handle_in_body(Token &t) {
+  switch (t.type()) {
+  case TokenType::Character: {
+    std::string &data = t.data();
+    if (data.find('\0') != std::string::npos) {
+      data.erase(std::remove(data.begin(), data.end(), '\0'), data.end());
+      if (data.empty()) {
+        return;
+      }
+    }
+    if (!m_formatting_reconstructed) {
+      reconstruct_active_formatting_elements();
+      m_formatting_reconstructed = true;
+    }
+    insert_text(data, t.source_range());
+    if (m_frameset_ok && std::any_of(data.begin(), data.end(), [](char c) {
+          return !is_whitespace(c);
+        })) {
+      m_frameset_ok = false;
+    }
+  }; break;
+  case TokenType::Comment:
+  case TokenType::Doctype:
+    break;
+  case TokenType::StartTag:
+    handle_in_body_start_tag(t);
+    break;
+  case TokenType::EndTag:
+    handle_in_body_end_tag(t);
+    break;
+  case TokenType::EndOfFile:
+    if (!m_template_modes.empty()) {
+      handle_in_template(t);
+    }
+    break;
+  }
+}
+
+void Parser::handle_in_body_start_tag(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (tag) {
+  case Tag::Html:
+    if (!m_open_elements.empty() && !m_open_elements.contains(Tag::Template)) {
+      auto &attributes = m_open_elements[0]->attributes();
+      for (const auto &attr : t.attributes()) {
+        attributes.emplace(attr.name, attr.value);
+      }
+    }
+    break;
+  case Tag::Base:
+  case Tag::Basefont:
+  case Tag::Bgsound:
+  case Tag::Link:
+  case Tag::Meta:
+  case Tag::Noframes:
+  case Tag::Script:
+  case Tag::Style:
+  case Tag::Template:
+  case Tag::Title:
+    handle_in_head(t);
+    break;
+  case Tag::Body:
+    if (m_open_elements.size() < 2 ||
+        m_open_elements[1]->tag() != Tag::Body ||
+        m_open_elements.contains(Tag::Template)) {
+      break;
+    }
+    m_frameset_ok = false;
+    for (const auto &attr : t.attributes()) {
+      m_open_elements[1]->attributes().emplace(attr.name, attr.value);
+    }
+    break;
+  case Tag::Frameset:
+    if (m_open_elements.size() < 2 ||
+        m_open_elements[1]->tag() != Tag::Body || !m_frameset_ok) {
+      break;
+    }
+    if (auto *parent = m_open_elements[1]->parent()) {
+      parent->remove(m_open_elements[1].get());
+    }
+    while (m_open_elements.size() > 1) {
+      pop();
+    }
+    if (was_pushed(insert_element(t))) {
+      m_mode = InsertionMode::InFrameset;
+    }
+    break;
+  case Tag::Address:
+  case Tag::Article:
+  case Tag::Aside:
+  case Tag::Blockquote:
+  case Tag::Center:
+  case Tag::Details:
+  case Tag::Dialog:
+  case Tag::Dir:
+  case Tag::Div:
+  case Tag::Dl:
+  case Tag::Fieldset:
+  case Tag::Figcaption:
+  case Tag::Figure:
+  case Tag::Footer:
+  case Tag::Header:
+  case Tag::Hgroup:
+  case Tag::Main:
+  case Tag::Menu:
+  case Tag::Nav:
+  case Tag::Ol:
+  case Tag::P:
+  case Tag::Search:
+  case Tag::Section:
+  case Tag::Summary:
+  case Tag::Ul:
+    close_p_element_in_button_scope();
+    insert_element(t);
+    break;
+  case Tag::H1:
+  case Tag::H2:
+  case Tag::H3:
+  case Tag::H4:
+  case Tag::H5:
+  case Tag::H6: {
+    close_p_element_in_button_scope();
+    Tag current = current_node()->tag();
+    if (current == Tag::H1 || current == Tag::H2 || current == Tag::H3 ||
+        current == Tag::H4 || current == Tag::H5 || current == Tag::H6) {
+      pop();
+    }
+    insert_element(t);
+  }; break;
+  case Tag::Pre:
+  case Tag::Listing:
+    close_p_element_in_button_scope();
+    insert_element(t);
+    m_skip_newline = true;
+    m_frameset_ok = false;
+    break;
+  case Tag::Form: {
+    // a form in a template doesn't become the form element pointer
+    bool in_template = m_open_elements.contains(Tag::Template);
+    if (m_form && !in_template) {
+      break;
+    }
+    close_p_element_in_button_scope();
+    auto form = insert_element(t);
+    if (!in_template) {
+      m_form = form;
+    }
+  }; break;
+  case Tag::Li:
+  case Tag::Dd:
+  case Tag::Dt: {
+    m_frameset_ok = false;
+    for (size_t i = m_open_elements.size(); i > 0; i--) {
+      Tag node = m_open_elements[i - 1]->tag();
+      bool matches = tag == Tag::Li ? node == Tag::Li
+                                    : (node == Tag::Dd || node == Tag::Dt);
+      if (matches) {
+        generate_implied_end_tags(node);
+        pop_until(node);
+        break;
+      }
+      if (is_special(node) && node != Tag::Address && node != Tag::Div &&
+          node != Tag::P) {
+        break;
+      }
+    }
+    close_p_element_in_button_scope();
+    insert_element(t);
+  }; break;
+  case Tag::Plaintext:
+    close_p_element_in_button_scope();
+    insert_element(t);
+    // there is no end tag, the rest of the input is its text
+    switch_tokenizer_to(TextState::Plaintext);
+    break;
+  case Tag::Button:
+    if (m_open_elements.has_in_scope(Tag::Button)) {
+      generate_implied_end_tags();
+      pop_until(Tag::Button);
+    }
+    reconstruct_active_formatting_elements();
+    insert_element(t);
+    m_frameset_ok = false;
+    break;
+  case Tag::A: {
+    for (size_t i = m_active_formatting.size(); i > 0; i--) {
+      const auto &entry = m_active_formatting[i - 1];
+      if (!entry) {
+        break;
+      }
+      if (entry->tag() == Tag::A) {
+        auto element = entry;
+        Token end_tag(TokenType::EndTag, "a");
+        end_tag.set_source_range({t.source_range().offset, 0});
+        if (!run_adoption_agency(end_tag)) {
+          handle_any_other_end_tag(end_tag);
+        }
+        if (auto j = active_formatting_index_of(element.get())) {
+          m_active_formatting.erase(m_active_formatting.begin() +
+                                    static_cast<long>(*j));
+        }
+        if (auto j = m_open_elements.index_of(element.get())) {
+          remove_from_stack(*j);
+        }
+        m_current_token = &t;
+        break;
+      }
+    }
+    reconstruct_active_formatting_elements();
+    push_active_formatting_element(insert_element(t));
+  }; break;
+  case Tag::B:
+  case Tag::Big:
+  case Tag::Code:
+  case Tag::Em:
+  case Tag::Font:
+  case Tag::I:
+  case Tag::S:
+  case Tag::Small:
+  case Tag::Strike:
+  case Tag::Strong:
+  case Tag::Tt:
+  case Tag::U:
+    reconstruct_active_formatting_elements();
+    push_active_formatting_element(insert_element(t));
+    break;
+  case Tag::Nobr:
+    reconstruct_active_formatting_elements();
+    if (m_open_elements.has_in_scope(Tag::Nobr)) {
+      Token end_tag(TokenType::EndTag, "nobr");
+      end_tag.set_source_range({t.source_range().offset, 0});
+      if (!run_adoption_agency(end_tag)) {
+        handle_any_other_end_tag(end_tag);
       }
+      m_current_token = &t;
+      reconstruct_active_formatting_elements();
+    }
+    push_active_formatting_element(insert_element(t));
+    break;
+  case Tag::Applet:
+  case Tag::Marquee:
+  case Tag::Object:
+    reconstruct_active_formatting_elements();
+    insert_element(t);
+    m_active_formatting.emplace_back(nullptr);
+    m_frameset_ok = false;
+    break;
+  case Tag::Table:
+    // quirks mode keeps tables inside paragraphs, as old browsers did
+    if (m_quirks_mode != QuirksMode::Quirks) {
+      close_p_element_in_button_scope();
+    }
+    m_frameset_ok = false;
+    if (was_pushed(insert_element(t))) {
+      m_mode = InsertionMode::InTable;
+    }
+    break;
+  case Tag::Area:
+  case Tag::Br:
+  case Tag::Embed:
+  case Tag::Img:
+  case Tag::Keygen:
+  case Tag::Wbr:
+    reconstruct_active_formatting_elements();
+    insert_void_element(t);
+    m_frameset_ok = false;
+    break;
+  case Tag::Input: {
+    reconstruct_active_formatting_elements();
+    auto input = insert_void_element(t);
+    auto it = input->attributes().find("type");
+    if (it == input->attributes().end() || it->second != "hidden") {
+      m_frameset_ok = false;
+    }
+  }; break;
+  case Tag::Param:
+  case Tag::Source:
+  case Tag::Track:
+    insert_void_element(t);
+    break;
+  case Tag::Hr:
+    close_p_element_in_button_scope();
+    insert_void_element(t);
+    m_frameset_ok = false;
+    break;
+  case Tag::Image:
+    t.data() = "img";
+    handle_in_body_start_tag(t);
+    break;
+  case Tag::Textarea:
+    insert_raw_text_element(t, TextState::Rcdata);
+    m_skip_newline = true;
+    m_frameset_ok = false;
+    break;
+  case Tag::Xmp:
+    close_p_element_in_button_scope();
+    reconstruct_active_formatting_elements();
+    m_frameset_ok = false;
+    insert_raw_text_element(t, TextState::Rawtext);
+    break;
+  case Tag::Iframe:
+    m_frameset_ok = false;
+    insert_raw_text_element(t, TextState::Rawtext);
+    break;
+  case Tag::Noembed:
+    insert_raw_text_element(t, TextState::Rawtext);
+    break;
+  case Tag::Select:
+    reconstruct_active_formatting_elements();
+    m_frameset_ok = false;
+    if (!was_pushed(insert_element(t))) {
       break;
-    case TokenType::Character:
-      text += t.data();
+    }
+    if (m_mode == InsertionMode::InTable ||
+        m_mode == InsertionMode::InCaption ||
+        m_mode == InsertionMode::InTableBody ||
+        m_mode == InsertionMode::InRow || m_mode == InsertionMode::InCell) {
+      m_mode = InsertionMode::InSelectInTable;
+    } else {
+      m_mode = InsertionMode::InSelect;
+    }
+    break;
+  case Tag::Optgroup:
+  case Tag::Option:
+    if (current_node()->tag() == Tag::Option) {
+      pop();
+    }
+    reconstruct_active_formatting_elements();
+    insert_element(t);
+    break;
+  case Tag::Rb:
+  case Tag::Rtc:
+    if (m_open_elements.has_in_scope(Tag::Ruby)) {
+      generate_implied_end_tags();
+    }
+    insert_element(t);
+    break;
+  case Tag::Rp:
+  case Tag::Rt:
+    if (m_open_elements.has_in_scope(Tag::Ruby)) {
+      generate_implied_end_tags(Tag::Rtc);
+    }
+    insert_element(t);
+    break;
+  case Tag::Caption:
+  case Tag::Col:
+  case Tag::Colgroup:
+  case Tag::Frame:
+  case Tag::Head:
+  case Tag::Tbody:
+  case Tag::Td:
+  case Tag::Tfoot:
+  case Tag::Th:
+  case Tag::Thead:
+  case Tag::Tr:
+    break;
+  case Tag::Math:
+  case Tag::Svg: {
+    reconstruct_active_formatting_elements();
+    Namespace ns = tag == Tag::Svg ? Namespace::Svg : Namespace::MathMl;
+    if (t.is_self_closing()) {
+      insert_void_element(t, ns);
+    } else {
+      insert_element(t, ns);
+    }
+  }; break;
+  default:
+    reconstruct_active_formatting_elements();
+    insert_element(t);
+    break;
+  }
+}
+
+void Parser::handle_in_body_end_tag(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (tag) {
+  case Tag::Body:
+    if (m_open_elements.has_in_scope(Tag::Body)) {
+      m_mode = InsertionMode::AfterBody;
+    }
+    break;
+  case Tag::Html:
+    if (m_open_elements.has_in_scope(Tag::Body)) {
+      m_mode = InsertionMode::AfterBody;
+      process_token(t);
+    }
+    break;
+  case Tag::Address:
+  case Tag::Article:
+  case Tag::Aside:
+  case Tag::Blockquote:
+  case Tag::Button:
+  case Tag::Center:
+  case Tag::Details:
+  case Tag::Dialog:
+  case Tag::Dir:
+  case Tag::Div:
+  case Tag::Dl:
+  case Tag::Fieldset:
+  case Tag::Figcaption:
+  case Tag::Figure:
+  case Tag::Footer:
+  case Tag::Header:
+  case Tag::Hgroup:
+  case Tag::Listing:
+  case Tag::Main:
+  case Tag::Menu:
+  case Tag::Nav:
+  case Tag::Ol:
+  case Tag::Pre:
+  case Tag::Search:
+  case Tag::Section:
+  case Tag::Summary:
+  case Tag::Ul:
+    if (m_open_elements.has_in_scope(tag)) {
+      generate_implied_end_tags();
+      pop_until(tag);
+    }
+    break;
+  case Tag::Form: {
+    if (m_open_elements.contains(Tag::Template)) {
+      if (m_open_elements.has_in_scope(Tag::Form)) {
+        generate_implied_end_tags();
+        pop_until(Tag::Form);
+      }
       break;
-    case TokenType::Doctype:
-      // TODO
-      root->append(std::make_shared<Element>("DOCTYPE"));
+    }
+    auto node = m_form;
+    m_form = nullptr;
+    if (!node || !m_open_elements.has_in_scope(node.get())) {
       break;
-    case TokenType::Comment:
-      // TODO
+    }
+    generate_implied_end_tags();
+    if (auto i = m_open_elements.index_of(node.get())) {
+      remove_from_stack(*i);
+    }
+  }; break;
+  case Tag::P:
+    if (!m_open_elements.has_in_scope(Tag::P, Scope::Button)) {
+      insert_element("p");
+    }
+    close_p_element();
+    break;
+  case Tag::Li:
+    if (m_open_elements.has_in_scope(Tag::Li, Scope::ListItem)) {
+      generate_implied_end_tags(Tag::Li);
+      pop_until(Tag::Li);
+    }
+    break;
+  case Tag::Dd:
+  case Tag::Dt:
+    if (m_open_elements.has_in_scope(tag)) {
+      generate_implied_end_tags(tag);
+      pop_until(tag);
+    }
+    break;
+  case Tag::H1:
+  case Tag::H2:
+  case Tag::H3:
+  case Tag::H4:
+  case Tag::H5:
+  case Tag::H6:
+    if (m_open_elements.has_any_in_scope(
+            {Tag::H1, Tag::H2, Tag::H3, Tag::H4, Tag::H5, Tag::H6})) {
+      generate_implied_end_tags();
+      pop_until_any({Tag::H1, Tag::H2, Tag::H3, Tag::H4, Tag::H5, Tag::H6});
+    }
+    break;
+  case Tag::A:
+  case Tag::B:
+  case Tag::Big:
+  case Tag::Code:
+  case Tag::Em:
+  case Tag::Font:
+  case Tag::I:
+  case Tag::Nobr:
+  case Tag::S:
+  case Tag::Small:
+  case Tag::Strike:
+  case Tag::Strong:
+  case Tag::Tt:
+  case Tag::U:
+    if (!run_adoption_agency(t)) {
+      handle_any_other_end_tag(t);
+    }
+    break;
+  case Tag::Applet:
+  case Tag::Marquee:
+  case Tag::Object:
+    if (m_open_elements.has_in_scope(tag)) {
+      generate_implied_end_tags();
+      pop_until(tag);
+      clear_active_formatting_to_last_marker();
+    }
+    break;
+  case Tag::Template:
+    handle_in_head(t);
+    break;
+  case Tag::Br: {
+    Token start_tag(TokenType::StartTag, "br");
+    start_tag.set_source_range(t.source_range());
+    m_current_token = &start_tag;
+    handle_in_body_start_tag(start_tag);
+    m_current_token = &t;
+  }; break;
+  default:
+    handle_any_other_end_tag(t);
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-incdata
+void Parser::handle_text(Token &t) {
+  switch (t.type()) {
+  case TokenType::Character:
+    insert_text(t.data(), t.source_range());
+    break;
+  case TokenType::EndOfFile:
+    pop();
+    m_mode = m_original_mode;
+    process_token(t);
+    break;
+  case TokenType::EndTag:
+    // the tokenizer reads everything up to the element's own end tag as text
+    pop();
+    m_mode = m_original_mode;
+    break;
+  default:
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-intable
+void Parser::handle_in_table(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (t.type()) {
+  case TokenType::Character: {
+    Tag current = current_node()->tag();
+    if (current == Tag::Table || current == Tag::Tbody ||
+        current == Tag::Template || current == Tag::Tfoot ||
+        current == Tag::Thead || current == Tag::Tr) {
+      m_pending_table_text.clear();
+      m_pending_table_text_range = {};
+      m_original_mode = m_mode;
+      m_mode = InsertionMode::InTableText;
+      process_token(t);
+      return;
+    }
+  }; break;
+  case TokenType::Comment:
+  case TokenType::Doctype:
+    return;
+  case TokenType::StartTag:
+    switch (tag) {
+    case Tag::Caption:
+      clear_stack_back_to({Tag::Table, Tag::Template, Tag::Html});
+      if (was_pushed(insert_element(t))) {
+        m_active_formatting.emplace_back(nullptr);
+        m_mode = InsertionMode::InCaption;
+      }
+      return;
+    case Tag::Colgroup:
+      clear_stack_back_to({Tag::Table, Tag::Template, Tag::Html});
+      if (was_pushed(insert_element(t))) {
+        m_mode = InsertionMode::InColumnGroup;
+      }
+      return;
+    case Tag::Col:
+      clear_stack_back_to({Tag::Table, Tag::Template, Tag::Html});
+      if (was_pushed(insert_element("colgroup"))) {
+        m_mode = InsertionMode::InColumnGroup;
+        process_token(t);
+      }
+      return;
+    case Tag::Tbody:
+    case Tag::Tfoot:
+    case Tag::Thead:
+      clear_stack_back_to({Tag::Table, Tag::Template, Tag::Html});
+      if (was_pushed(insert_element(t))) {
+        m_mode = InsertionMode::InTableBody;
+      }
+      return;
+    case Tag::Td:
+    case Tag::Th:
+    case Tag::Tr:
+      clear_stack_back_to({Tag::Table, Tag::Template, Tag::Html});
+      if (was_pushed(insert_element("tbody"))) {
+        m_mode = InsertionMode::InTableBody;
+        process_token(t);
+      }
+      return;
+    case Tag::Table:
+      if (m_open_elements.has_in_scope(Tag::Table, Scope::Table)) {
+        pop_until(Tag::Table);
+        reset_insertion_mode();
+        process_token(t);
+      }
+      return;
+    case Tag::Style:
+    case Tag::Script:
+    case Tag::Template:
+      handle_in_head(t);
+      return;
+    case Tag::Input: {
+      bool hidden = false;
+      for (const auto &attr : t.attributes()) {
+        if (attr.name == "type") {
+          hidden = attr.value == "hidden";
+          break;
+        }
+      }
+      if (!hidden) {
+        break;
+      }
+      insert_void_element(t);
+      return;
+    }
+    case Tag::Form:
+      if (!m_form && !m_open_elements.contains(Tag::Template)) {
+        m_form = insert_void_element(t);
+      }
+      return;
+    default:
       break;
+    }
+    break;
+  case TokenType::EndTag:
+    switch (tag) {
+    case Tag::Table:
+      if (m_open_elements.has_in_scope(Tag::Table, Scope::Table)) {
+        pop_until(Tag::Table);
+        reset_insertion_mode();
+      }
+      return;
+    case Tag::Body:
+    case Tag::Caption:
+    case Tag::Col:
+    case Tag::Colgroup:
+    case Tag::Html:
+    case Tag::Tbody:
+    case Tag::Td:
+    case Tag::Tfoot:
+    case Tag::Th:
+    case Tag::Thead:
+    case Tag::Tr:
+      return;
+    case Tag::Template:
+      handle_in_head(t);
+      return;
     default:
-      UNIMPLEMENTED();
+      break;
+    }
+    break;
+  case TokenType::EndOfFile:
+    handle_in_body(t);
+    return;
+  }
+
+  m_foster_parenting = true;
+  handle_in_body(t);
+  m_foster_parenting = false;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-intabletext
+void Parser::handle_in_table_text(Token &t) {
+  if (t.type() == TokenType::Character) {
+    for (char c : t.data()) {
+      if (c != '\0') {
+        m_pending_table_text += c;
+      }
     }
+    if (!m_pending_table_text_range.is_valid()) {
+      m_pending_table_text_range = t.source_range();
+    } else if (t.source_range().is_valid()) {
+      m_pending_table_text_range.length =
+          t.source_range().end() - m_pending_table_text_range.offset;
+    }
+    return;
   }
 
-  if (!text.empty()) {
-    root->append(std::make_shared<TextNode>(text));
+  if (!m_pending_table_text.empty()) {
+    if (std::all_of(m_pending_table_text.begin(), m_pending_table_text.end(),
+                    is_whitespace)) {
+      insert_text(m_pending_table_text, m_pending_table_text_range);
+    } else {
+      // parse error, the text is foster parented out of the table
+      Token text_token(TokenType::Character, m_pending_table_text);
+      text_token.set_source_range(m_pending_table_text_range);
+      m_foster_parenting = true;
+      handle_in_body(text_token);
+      m_foster_parenting = false;
+    }
+    m_pending_table_text.clear();
   }
 
-  return root;
+  m_mode = m_original_mode;
+  process_token(t);
 }
 
-// https://html.spec.whatwg.org/multipage/syntax.html#void-elements
-bool Parser::is_void_element(const std::string &name) {
-  return name == "area" || name == "base" || name == "br" || name == "col" ||
-         name == "embed" || name == "hr" || name == "img" || name == "input" ||
-         name == "link" || name == "meta" || name == "source" ||
-         name == "track" || name == "wbr";
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-incaption
+void Parser::handle_in_caption(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  bool is_start = t.type() == TokenType::StartTag;
+  bool is_end = t.type() == TokenType::EndTag;
+
+  if ((is_end && (tag == Tag::Caption || tag == Tag::Table)) ||
+      (is_start && (tag == Tag::Caption || tag == Tag::Col ||
+                    tag == Tag::Colgroup || tag == Tag::Tbody ||
+                    tag == Tag::Td || tag == Tag::Tfoot || tag == Tag::Th ||
+                    tag == Tag::Thead || tag == Tag::Tr))) {
+    if (!m_open_elements.has_in_scope(Tag::Caption, Scope::Table)) {
+      return;
+    }
+    generate_implied_end_tags();
+    pop_until(Tag::Caption);
+    clear_active_formatting_to_last_marker();
+    m_mode = InsertionMode::InTable;
+    if (!(is_end && tag == Tag::Caption)) {
+      process_token(t);
+    }
+    return;
+  }
+
+  if (is_end && (tag == Tag::Body || tag == Tag::Col || tag == Tag::Colgroup ||
+                 tag == Tag::Html || tag == Tag::Tbody || tag == Tag::Td ||
+                 tag == Tag::Tfoot || tag == Tag::Th || tag == Tag::Thead ||
+                 tag == Tag::Tr)) {
+    return;
+  }
+
+  handle_in_body(t);
 }
 
-std::shared_ptr<Node> parse(const std::string &s) {
-  Tokenizer tokenizer(s);
-  auto tokens = tokenizer.parse();
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-incolgroup
+void Parser::handle_in_column_group(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (t.type()) {
+  case TokenType::Character: {
+    auto whitespace = split_leading_whitespace(t);
+    if (!whitespace.data().empty()) {
+      insert_text(whitespace.data(), whitespace.source_range());
+    }
+    if (t.data().empty()) {
+      return;
+    }
+  }; break;
+  case TokenType::Comment:
+  case TokenType::Doctype:
+    return;
+  case TokenType::StartTag:
+    if (tag == Tag::Html) {
+      handle_in_body(t);
+      return;
+    }
+    if (tag == Tag::Col) {
+      insert_void_element(t);
+      return;
+    }
+    if (tag == Tag::Template) {
+      handle_in_head(t);
+      return;
+    }
+    break;
+  case TokenType::EndTag:
+    if (tag == Tag::Template) {
+      handle_in_head(t);
+      return;
+    }
+    if (tag == Tag::Colgroup) {
+      if (current_node()->tag() == Tag::Colgroup) {
+        pop();
+        m_mode = InsertionMode::InTable;
+      }
+      return;
+    }
+    if (tag == Tag::Col) {
+      return;
+    }
+    break;
+  case TokenType::EndOfFile:
+    handle_in_body(t);
+    return;
+  }
+
+  if (current_node()->tag() != Tag::Colgroup) {
+    return;
+  }
+  pop();
+  m_mode = InsertionMode::InTable;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-intbody
+void Parser::handle_in_table_body(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  bool is_start = t.type() == TokenType::StartTag;
+  bool is_end = t.type() == TokenType::EndTag;
+
+  if (is_start && tag == Tag::Tr) {
+    clear_stack_back_to(
+        {Tag::Tbody, Tag::Tfoot, Tag::Thead, Tag::Template, Tag::Html});
+    if (was_pushed(insert_element(t))) {
+      m_mode = InsertionMode::InRow;
+    }
+  } else if (is_start && (tag == Tag::Th || tag == Tag::Td)) {
+    clear_stack_back_to(
+        {Tag::Tbody, Tag::Tfoot, Tag::Thead, Tag::Template, Tag::Html});
+    if (was_pushed(insert_element("tr"))) {
+      m_mode = InsertionMode::InRow;
+      process_token(t);
+    }
+  } else if (is_end &&
+             (tag == Tag::Tbody || tag == Tag::Tfoot || tag == Tag::Thead)) {
+    if (!m_open_elements.has_in_scope(tag, Scope::Table)) {
+      return;
+    }
+    clear_stack_back_to(
+        {Tag::Tbody, Tag::Tfoot, Tag::Thead, Tag::Template, Tag::Html});
+    pop();
+    m_mode = InsertionMode::InTable;
+  } else if ((is_start &&
+              (tag == Tag::Caption || tag == Tag::Col ||
+               tag == Tag::Colgroup || tag == Tag::Tbody ||
+               tag == Tag::Tfoot || tag == Tag::Thead)) ||
+             (is_end && tag == Tag::Table)) {
+    if (!m_open_elements.has_any_in_scope(
+            {Tag::Tbody, Tag::Thead, Tag::Tfoot}, Scope::Table)) {
+      return;
+    }
+    clear_stack_back_to(
+        {Tag::Tbody, Tag::Tfoot, Tag::Thead, Tag::Template, Tag::Html});
+    pop();
+    m_mode = InsertionMode::InTable;
+    process_token(t);
+  } else if (is_end && (tag == Tag::Body || tag == Tag::Caption ||
+                        tag == Tag::Col || tag == Tag::Colgroup ||
+                        tag == Tag::Html || tag == Tag::Td ||
+                        tag == Tag::Th || tag == Tag::Tr)) {
+    return;
+  } else {
+    handle_in_table(t);
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-intr
+void Parser::handle_in_row(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  bool is_start = t.type() == TokenType::StartTag;
+  bool is_end = t.type() == TokenType::EndTag;
+
+  if (is_start && (tag == Tag::Th || tag == Tag::Td)) {
+    clear_stack_back_to({Tag::Tr, Tag::Template, Tag::Html});
+    if (was_pushed(insert_element(t))) {
+      m_mode = InsertionMode::InCell;
+      m_active_formatting.emplace_back(nullptr);
+    }
+  } else if (is_end && tag == Tag::Tr) {
+    if (!m_open_elements.has_in_scope(Tag::Tr, Scope::Table)) {
+      return;
+    }
+    clear_stack_back_to({Tag::Tr, Tag::Template, Tag::Html});
+    pop();
+    m_mode = InsertionMode::InTableBody;
+  } else if ((is_start &&
+              (tag == Tag::Caption || tag == Tag::Col ||
+               tag == Tag::Colgroup || tag == Tag::Tbody ||
+               tag == Tag::Tfoot || tag == Tag::Thead || tag == Tag::Tr)) ||
+             (is_end && tag == Tag::Table)) {
+    if (!m_open_elements.has_in_scope(Tag::Tr, Scope::Table)) {
+      return;
+    }
+    clear_stack_back_to({Tag::Tr, Tag::Template, Tag::Html});
+    pop();
+    m_mode = InsertionMode::InTableBody;
+    process_token(t);
+  } else if (is_end &&
+             (tag == Tag::Tbody || tag == Tag::Tfoot || tag == Tag::Thead)) {
+    if (!m_open_elements.has_in_scope(tag, Scope::Table) ||
+        !m_open_elements.has_in_scope(Tag::Tr, Scope::Table)) {
+      return;
+    }
+    clear_stack_back_to({Tag::Tr, Tag::Template, Tag::Html});
+    pop();
+    m_mode = InsertionMode::InTableBody;
+    process_token(t);
+  } else if (is_end && (tag == Tag::Body || tag == Tag::Caption ||
+                        tag == Tag::Col || tag == Tag::Colgroup ||
+                        tag == Tag::Html || tag == Tag::Td ||
+                        tag == Tag::Th)) {
+    return;
+  } else {
+    handle_in_table(t);
+  }
+}
 
-  Parser parser(tokens);
-  return parser.parse();
-}
\ No newline at end of file
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-intd
+void Parser::handle_in_cell(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  bool is_start = t.type() == TokenType::StartTag;
+  bool is_end = t.type() == TokenType::EndTag;
+
+  if (is_end && (tag == Tag::Td || tag == Tag::Th)) {
+    if (!m_open_elements.has_in_scope(tag, Scope::Table)) {
+      return;
+    }
+    generate_implied_end_tags();
+    pop_until(tag);
+    clear_active_formatting_to_last_marker();
+    m_mode = InsertionMode::InRow;
+  } else if (is_start &&
+             (tag == Tag::Caption || tag == Tag::Col ||
+              tag == Tag::Colgroup || tag == Tag::Tbody || tag == Tag::Td ||
+              tag == Tag::Tfoot || tag == Tag::Th || tag == Tag::Thead ||
+              tag == Tag::Tr)) {
+    if (!m_open_elements.has_any_in_scope({Tag::Td, Tag::Th}, Scope::Table)) {
+      return;
+    }
+    close_cell();
+    process_token(t);
+  } else if (is_end && (tag == Tag::Body || tag == Tag::Caption ||
+                        tag == Tag::Col || tag == Tag::Colgroup ||
+                        tag == Tag::Html)) {
+    return;
+  } else if (is_end && (tag == Tag::Table || tag == Tag::Tbody ||
+                        tag == Tag::Tfoot || tag == Tag::Thead ||
+                        tag == Tag::Tr)) {
+    if (!m_open_elements.has_in_scope(tag, Scope::Table)) {
+      return;
+    }
+    close_cell();
+    process_token(t);
+  } else {
+    handle_in_body(t);
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inselect
+void Parser::handle_in_select(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (t.type()) {
+  case TokenType::Character: {
+    std::string &data = t.data();
+    data.erase(std::remove(data.begin(), data.end(), '\0'), data.end());
+    if (!data.empty()) {
+      insert_text(data, t.source_range());
+    }
+  }; break;
+  case TokenType::Comment:
+  case TokenType::Doctype:
+    break;
+  case TokenType::StartTag:
+    switch (tag) {
+    case Tag::Html:
+      handle_in_body(t);
+      break;
+    case Tag::Option:
+      if (current_node()->tag() == Tag::Option) {
+        pop();
+      }
+      insert_element(t);
+      break;
+    case Tag::Optgroup:
+    case Tag::Hr:
+      if (current_node()->tag() == Tag::Option) {
+        pop();
+      }
+      if (current_node()->tag() == Tag::Optgroup) {
+        pop();
+      }
+      if (tag == Tag::Hr) {
+        insert_void_element(t);
+      } else {
+        insert_element(t);
+      }
+      break;
+    case Tag::Select:
+      if (m_open_elements.has_in_scope(Tag::Select, Scope::Select)) {
+        pop_until(Tag::Select);
+        reset_insertion_mode();
+      }
+      break;
+    case Tag::Input:
+    case Tag::Keygen:
+    case Tag::Textarea:
+      if (m_open_elements.has_in_scope(Tag::Select, Scope::Select)) {
+        pop_until(Tag::Select);
+        reset_insertion_mode();
+        process_token(t);
+      }
+      break;
+    case Tag::Script:
+    case Tag::Template:
+      handle_in_head(t);
+      break;
+    default:
+      break;
+    }
+    break;
+  case TokenType::EndTag:
+    switch (tag) {
+    case Tag::Template:
+      handle_in_head(t);
+      break;
+    case Tag::Optgroup:
+      if (current_node()->tag() == Tag::Option &&
+          m_open_elements.size() >= 2 &&
+          m_open_elements[m_open_elements.size() - 2]->tag() ==
+              Tag::Optgroup) {
+        pop();
+      }
+      if (current_node()->tag() == Tag::Optgroup) {
+        pop();
+      }
+      break;
+    case Tag::Option:
+      if (current_node()->tag() == Tag::Option) {
+        pop();
+      }
+      break;
+    case Tag::Select:
+      if (m_open_elements.has_in_scope(Tag::Select, Scope::Select)) {
+        pop_until(Tag::Select);
+        reset_insertion_mode();
+      }
+      break;
+    default:
+      break;
+    }
+    break;
+  case TokenType::EndOfFile:
+    handle_in_body(t);
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inselectintable
+void Parser::handle_in_select_in_table(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  bool table_tag = tag == Tag::Caption || tag == Tag::Table ||
+                   tag == Tag::Tbody || tag == Tag::Tfoot ||
+                   tag == Tag::Thead || tag == Tag::Tr || tag == Tag::Td ||
+                   tag == Tag::Th;
+
+  if (t.type() == TokenType::StartTag && table_tag) {
+    pop_until(Tag::Select);
+    reset_insertion_mode();
+    process_token(t);
+  } else if (t.type() == TokenType::EndTag && table_tag) {
+    if (!m_open_elements.has_in_scope(tag, Scope::Table)) {
+      return;
+    }
+    pop_until(Tag::Select);
+    reset_insertion_mode();
+    process_token(t);
+  } else {
+    handle_in_select(t);
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-intemplate
+void Parser::handle_in_template(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (t.type()) {
+  case TokenType::Character:
+  case TokenType::Comment:
+  case TokenType::Doctype:
+    handle_in_body(t);
+    return;
+  case TokenType::StartTag: {
+    // the template's content decides which mode it is parsed in
+    InsertionMode mode = InsertionMode::InBody;
+    switch (tag) {
+    case Tag::Base:
+    case Tag::Basefont:
+    case Tag::Bgsound:
+    case Tag::Link:
+    case Tag::Meta:
+    case Tag::Noframes:
+    case Tag::Script:
+    case Tag::Style:
+    case Tag::Template:
+    case Tag::Title:
+      handle_in_head(t);
+      return;
+    case Tag::Caption:
+    case Tag::Colgroup:
+    case Tag::Tbody:
+    case Tag::Tfoot:
+    case Tag::Thead:
+      mode = InsertionMode::InTable;
+      break;
+    case Tag::Col:
+      mode = InsertionMode::InColumnGroup;
+      break;
+    case Tag::Tr:
+      mode = InsertionMode::InTableBody;
+      break;
+    case Tag::Td:
+    case Tag::Th:
+      mode = InsertionMode::InRow;
+      break;
+    default:
+      break;
+    }
+    m_template_modes.back() = mode;
+    m_mode = mode;
+    process_token(t);
+  }; break;
+  case TokenType::EndTag:
+    if (tag == Tag::Template) {
+      handle_in_head(t);
+    }
+    break;
+  case TokenType::EndOfFile:
+    if (!m_open_elements.contains(Tag::Template)) {
+      break;
+    }
+    // parse error. the spec closes one template and reprocesses the token,
+    // which comes back here for the next one, so closing them all at once
+    // is the same without recursing once per open template.
+    while (m_open_elements.contains(Tag::Template)) {
+      pop_until(Tag::Template);
+      clear_active_formatting_to_last_marker();
+      if (!m_template_modes.empty()) {
+        m_template_modes.pop_back();
+      }
+    }
+    reset_insertion_mode();
+    process_token(t);
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inforeign
+void Parser::handle_in_foreign_content(Token &t) {
+  switch (t.type()) {
+  case TokenType::Character: {
+    std::string &data = t.data();
+    for (size_t i = data.find('\0'); i != std::string::npos;
+         i = data.find('\0', i)) {
+      data.replace(i, 1, replacement_character);
+    }
+    insert_text(data, t.source_range());
+    if (m_frameset_ok && std::any_of(data.begin(), data.end(), [](char c) {
+          return !is_whitespace(c);
+        })) {
+      m_frameset_ok = false;
+    }
+  }; break;
+  case TokenType::Comment:
+  case TokenType::Doctype:
+  case TokenType::EndOfFile:
+    break;
+  case TokenType::StartTag:
+    if (breaks_out_of_foreign_content(t)) {
+      while (!m_open_elements.empty() && current_node()->ns() != Namespace::Html &&
+             !is_mathml_text_integration_point(*current_node()) &&
+             !is_html_integration_point(*current_node())) {
+        pop();
+      }
+      process_token(t);
+      return;
+    }
+    // in the namespace of the element it is in
+    if (t.is_self_closing()) {
+      insert_void_element(t, current_node()->ns());
+    } else {
+      insert_element(t, current_node()->ns());
+    }
+    break;
+  case TokenType::EndTag:
+    // closes the nearest foreign element of that name, unless an html
+    // element comes first, which then gets the token instead. svg names
+    // are matched without their case.
+    for (size_t i = m_open_elements.size() - 1; i > 0; i--) {
+      if (equals_ignoring_ascii_case(m_open_elements[i]->name(), t.data())) {
+        while (m_open_elements.size() > i) {
+          pop();
+        }
+        return;
+      }
+      if (m_open_elements[i - 1]->ns() == Namespace::Html) {
+        process_in_current_mode(t);
+        return;
+      }
+    }
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#tree-construction-dispatcher
+bool Parser::uses_foreign_content_rules(const Token &t) {
+  if (m_open_elements.empty() || t.type() == TokenType::EndOfFile) {
+    return false;
+  }
+  const Element &node = *current_node();
+  if (node.ns() == Namespace::Html) {
+    return false;
+  }
+  bool start_tag = t.type() == TokenType::StartTag;
+  bool character = t.type() == TokenType::Character;
+  if (is_mathml_text_integration_point(node) &&
+      ((start_tag && t.data() != "mglyph" && t.data() != "malignmark") ||
+       character)) {
+    return false;
+  }
+  if (node.ns() == Namespace::MathMl && node.name() == "annotation-xml" &&
+      start_tag && t.data() == "svg") {
+    return false;
+  }
+  return !(is_html_integration_point(node) && (start_tag || character));
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#html-integration-point
+bool Parser::is_html_integration_point(const Element &element) {
+  if (element.ns() == Namespace::Svg) {
+    const std::string &name = element.name();
+    return name == "foreignObject" || name == "desc" || name == "title";
+  }
+  if (element.ns() == Namespace::MathMl &&
+      element.name() == "annotation-xml") {
+    auto it = element.attributes().find("encoding");
+    return it != element.attributes().end() &&
+           (equals_ignoring_ascii_case(it->second, "text/html") ||
+            equals_ignoring_ascii_case(it->second, "application/xhtml+xml"));
+  }
+  return false;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#mathml-text-integration-point
+bool Parser::is_mathml_text_integration_point(const Element &element) {
+  if (element.ns() != Namespace::MathMl) {
+    return false;
+  }
+  const std::string &name = element.name();
+  return name == "mi" || name == "mo" || name == "mn" || name == "ms" ||
+         name == "mtext";
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-afterbody
+void Parser::handle_after_body(Token &t) {
+  if (t.type() == TokenType::Character) {
+    auto whitespace = split_leading_whitespace(t);
+    if (!whitespace.data().empty()) {
+      handle_in_body(whitespace);
+    }
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::Comment ||
+             t.type() == TokenType::Doctype ||
+             t.type() == TokenType::EndOfFile) {
+    return;
+  } else if (t.type() == TokenType::StartTag && t.data() == "html") {
+    handle_in_body(t);
+    return;
+  } else if (t.type() == TokenType::EndTag && t.data() == "html") {
+    m_mode = InsertionMode::AfterAfterBody;
+    return;
+  }
+
+  m_mode = InsertionMode::InBody;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inframeset
+void Parser::handle_in_frameset(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (t.type()) {
+  case TokenType::Character: {
+    std::string whitespace;
+    std::copy_if(t.data().begin(), t.data().end(),
+                 std::back_inserter(whitespace), is_whitespace);
+    if (!whitespace.empty()) {
+      insert_text(whitespace, {});
+    }
+  }; break;
+  case TokenType::StartTag:
+    if (tag == Tag::Html) {
+      handle_in_body(t);
+    } else if (tag == Tag::Frameset) {
+      insert_element(t);
+    } else if (tag == Tag::Frame) {
+      insert_void_element(t);
+    } else if (tag == Tag::Noframes) {
+      handle_in_head(t);
+    }
+    break;
+  case TokenType::EndTag:
+    if (tag == Tag::Frameset && current_node()->tag() != Tag::Html) {
+      pop();
+      if (current_node()->tag() != Tag::Frameset) {
+        m_mode = InsertionMode::AfterFrameset;
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-afterframeset
+void Parser::handle_after_frameset(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  switch (t.type()) {
+  case TokenType::Character: {
+    std::string whitespace;
+    std::copy_if(t.data().begin(), t.data().end(),
+                 std::back_inserter(whitespace), is_whitespace);
+    if (!whitespace.empty()) {
+      insert_text(whitespace, {});
+    }
+  }; break;
+  case TokenType::StartTag:
+    if (tag == Tag::Html) {
+      handle_in_body(t);
+    } else if (tag == Tag::Noframes) {
+      handle_in_head(t);
+    }
+    break;
+  case TokenType::EndTag:
+    if (tag == Tag::Html) {
+      m_mode = InsertionMode::AfterAfterFrameset;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-after-after-body-insertion-mode
+void Parser::handle_after_after_body(Token &t) {
+  if (t.type() == TokenType::Character) {
+    auto whitespace = split_leading_whitespace(t);
+    if (!whitespace.data().empty()) {
+      handle_in_body(whitespace);
+    }
+    if (t.data().empty()) {
+      return;
+    }
+  } else if (t.type() == TokenType::Comment ||
+             t.type() == TokenType::Doctype ||
+             t.type() == TokenType::EndOfFile) {
+    return;
+  } else if (t.type() == TokenType::StartTag && t.data() == "html") {
+    handle_in_body(t);
+    return;
+  }
+
+  m_mode = InsertionMode::InBody;
+  process_token(t);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#the-after-after-frameset-insertion-mode
+void Parser::handle_after_after_frameset(Token &t) {
+  if (t.type() == TokenType::Character) {
+    std::string whitespace;
+    std::copy_if(t.data().begin(), t.data().end(),
+                 std::back_inserter(whitespace), is_whitespace);
+    if (!whitespace.empty()) {
+      Token whitespace_token(TokenType::Character, whitespace);
+      handle_in_body(whitespace_token);
+    }
+  } else if (t.type() == TokenType::StartTag) {
+    if (t.data() == "html") {
+      handle_in_body(t);
+    } else if (t.data() == "noframes") {
+      handle_in_head(t);
+    }
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#appropriate-place-for-inserting-a-node
+Parser::InsertionLocation
+Parser::appropriate_insertion_location(Element *target) {
+  if (target == nullptr) {
+    target = current_node();
+  }
+
+  Tag tag = target->tag();
+  if (!m_foster_parenting ||
+      (tag != Tag::Table && tag != Tag::Tbody && tag != Tag::Tfoot &&
+       tag != Tag::Thead && tag != Tag::Tr)) {
+    return {target, nullptr};
+  }
+
+  // the template's children stand in for its template contents
+  auto last_table = m_open_elements.last_index_of(Tag::Table);
+  auto last_template = m_open_elements.last_index_of(Tag::Template);
+  if (last_template && (!last_table || *last_template > *last_table)) {
+    return {m_open_elements[*last_template].get(), nullptr};
+  }
+  if (!last_table) {
+    return {m_open_elements[0].get(), nullptr};
+  }
+  const auto &table = m_open_elements[*last_table];
+  if (table->parent() != nullptr) {
+    return {table->parent(), table.get()};
+  }
+  return {m_open_elements[*last_table - 1].get(), nullptr};
+}
+
+void Parser::insert_node(const NodePtr &node, InsertionLocation location) {
+  if (m_hash_subtrees) {
+    invalidate_subtree_hash(node->parent());
+    invalidate_subtree_hash(location.parent);
+  }
+  if (node->parent() != nullptr) {
+    node->parent()->remove(node.get());
+  }
+  if (location.before != nullptr) {
+    size_t index = index_of_child(*location.parent, location.before);
+    location.parent->insert_at(index, node);
+    m_before_hint.index = index + 1;
+  } else {
+    location.parent->append(node);
+  }
+
+  // whitespace in front of a block that was collapsed when it was all there
+  // was to go on
+  if (m_whitespace_text == WhitespaceText::Drop && node->is_element() &&
+      is_whitespace_boundary(static_cast<const Element &>(*node).tag()) &&
+      (text.empty() || m_text_location.parent != location.parent)) {
+    drop_collapsed_whitespace(*location.parent,
+                              child_before(*location.parent, node.get()));
+  }
+}
+
+ElementPtr Parser::create_element(const Token &t, Namespace ns) {
+  if (ns == Namespace::Html) {
+    auto el = std::make_shared<Element>(t.data());
+    el->set_source_range(t.source_range());
+    for (const auto &attr : t.attributes()) {
+      // https://html.spec.whatwg.org/multipage/parsing.html#attribute-name-state
+      // duplicate attributes are dropped, the first one wins
+      el->attributes().emplace(attr.name, attr.value);
+    }
+    return el;
+  }
+
+  std::string name = t.data();
+  if (ns == Namespace::Svg) {
+    svg_tag_names().adjust(name);
+  }
+  auto el = std::make_shared<Element>(std::move(name), ns);
+  el->set_source_range(t.source_range());
+  const auto &attribute_names = ns == Namespace::Svg ? svg_attribute_names()
+                                                     : mathml_attribute_names();
+  for (const auto &attr : t.attributes()) {
+    std::string attribute_name = attr.name;
+    attribute_names.adjust(attribute_name);
+    el->attributes().emplace(std::move(attribute_name), attr.value);
+  }
+  return el;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#insert-a-foreign-element
+ElementPtr Parser::insert_element(const Token &t, Namespace ns) {
+  auto el = create_element(t, ns);
+  if (!allow_node()) {
+    // left detached, parsing stops after the current token
+    return el;
+  }
+  insert_node(el, appropriate_insertion_location());
+  if (m_limits.max_depth != 0 && m_open_elements.size() >= m_limits.max_depth) {
+    m_limits_exceeded.depth = true;
+  } else {
+    m_open_elements.push(el);
+  }
+  return el;
+}
+
+// an element that is closed right away, like a void element. one that wasn't
+// pushed for being too deep mustn't take its parent off the stack with it.
+ElementPtr Parser::insert_void_element(const Token &t, Namespace ns) {
+  m_self_closing_acknowledged = true;
+  auto el = insert_element(t, ns);
+  if (was_pushed(el)) {
+    pop();
+  }
+  return el;
+}
+
+ElementPtr Parser::insert_element(const std::string &name) {
+  Token t(TokenType::StartTag, name);
+  if (m_current_token != nullptr &&
+      m_current_token->source_range().is_valid()) {
+    t.set_source_range({m_current_token->source_range().offset, 0});
+  }
+  return insert_element(t);
+}
+
+// the child in front of `before`, or the last one if `before` is null
+Node *Parser::child_before(const Element &parent, const Node *before) {
+  const auto &children = parent.children();
+  if (before == nullptr) {
+    return children.empty() ? nullptr : children.back().get();
+  }
+  size_t index = index_of_child(parent, before);
+  if (index == 0 || index == children.size()) {
+    return nullptr;
+  }
+  return children[index - 1].get();
+}
+
+// nodes are only inserted before another when they are foster parented in
+// front of a table, one after another, so the table is usually found where it
+// was the last time. the number of children if `child` isn't one of them.
+size_t Parser::index_of_child(const Element &parent, const Node *child) {
+  const auto &children = parent.children();
+  auto &hint = m_before_hint;
+  if (hint.parent != &parent || hint.child != child ||
+      hint.index >= children.size() || children[hint.index].get() != child) {
+    // from the back, since the table is usually the last child
+    size_t i = children.size();
+    while (i > 0 && children[i - 1].get() != child) {
+      i--;
+    }
+    hint = {&parent, child, i == 0 ? children.size() : i - 1};
+  }
+  return hint.index;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#insert-a-character
+void Parser::insert_text(std::string_view data, SourceRange range) {
+  auto location = appropriate_insertion_location();
+  if (location.parent == m_root.get()) {
+    // the document can't have text children
+    return;
+  }
+
+  if (m_limits.max_text_bytes != 0) {
+    size_t budget = m_limits.max_text_bytes - m_text_bytes;
+    if (data.size() > budget) {
+      m_limits_exceeded.text_bytes = true;
+      data = data.substr(0, budget);
+      if (data.empty()) {
+        return;
+      }
+    }
+    m_text_bytes += data.size();
+  }
+
+  if (!text.empty() && (location.parent != m_text_location.parent ||
+                        location.before != m_text_location.before)) {
+    flush_text();
+  }
+
+  if (text.empty()) {
+    m_text_location = location;
+    m_text_range = range;
+  } else if (m_text_range.is_valid() && range.is_valid()) {
+    m_text_range.length = range.end() - m_text_range.offset;
+  }
+  text += data;
+}
+
+void Parser::flush_text() {
+  if (text.empty()) {
+    return;
+  }
+
+  // adjacent text is merged into the existing node, as the spec requires
+  auto *parent = m_text_location.parent;
+  Node *previous = child_before(*parent, m_text_location.before);
+
+  bool whitespace = m_whitespace_text != WhitespaceText::Keep &&
+                    std::all_of(text.begin(), text.end(), is_whitespace) &&
+                    !preserves_whitespace();
+  // right where a handed over element was, see SubtreeSink
+  bool after_hand_over = m_subtree_sink != nullptr &&
+                         parent == m_hand_over_gap.parent &&
+                         previous == m_hand_over_gap.previous;
+
+  if (after_hand_over && !preserves_whitespace() &&
+      std::all_of(text.begin(), text.end(), is_whitespace)) {
+    // not even counted against max_nodes
+  } else if (previous != nullptr && !previous->is_element() &&
+             !after_hand_over) {
+    if (m_hash_subtrees) {
+      invalidate_subtree_hash(parent);
+    }
+    auto *node = static_cast<TextNode *>(previous);
+    if (!whitespace || !is_collapsed_whitespace(*node)) {
+      node->append(text, m_text_pool);
+    }
+    SourceRange range = node->source_range();
+    if (range.is_valid() && m_text_range.is_valid()) {
+      range.length = m_text_range.end() - range.offset;
+      node->set_source_range(range);
+    }
+  } else if (whitespace && m_whitespace_text == WhitespaceText::Drop &&
+             drops_whitespace(*parent, previous)) {
+    // not even counted against max_nodes
+  } else if (allow_node()) {
+    auto node = whitespace ? std::make_shared<TextNode>(TextPool::Text{
+                                 collapsed_whitespace, nullptr})
+                           : std::make_shared<TextNode>(m_text_pool.store(text));
+    node->set_source_range(m_text_range);
+    insert_node(node, m_text_location);
+  }
+  text.clear();
+}
+
+// where white-space is not collapsed by the default styles, or the text isn't
+// rendered as text at all
+bool Parser::preserves_whitespace() const {
+  for (Tag tag : {Tag::Pre, Tag::Listing, Tag::Textarea, Tag::Plaintext,
+                  Tag::Xmp, Tag::Script, Tag::Style, Tag::Title, Tag::Iframe,
+                  Tag::Noembed, Tag::Noframes, Tag::Noscript, Tag::Template,
+                  Tag::Svg, Tag::Math}) {
+    if (m_open_elements.contains(tag)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// whitespace at the start of a block, right after one, or in the parts of
+// tables, selects and the document that only hold elements. what comes before
+// the end of a block or the start of the next one isn't known yet, it is
+// collapsed and then dropped once the block shows up.
+bool Parser::drops_whitespace(const Element &parent,
+                              const Node *previous) const {
+  switch (parent.tag()) {
+  case Tag::Html:
+  case Tag::Head:
+  case Tag::Table:
+  case Tag::Tbody:
+  case Tag::Thead:
+  case Tag::Tfoot:
+  case Tag::Tr:
+  case Tag::Colgroup:
+  case Tag::Select:
+  case Tag::Frameset:
+    return true;
+  default:
+    break;
+  }
+  if (previous == nullptr) {
+    return is_whitespace_boundary(parent.tag());
+  }
+  return previous->is_element() &&
+         is_whitespace_boundary(static_cast<const Element &>(*previous).tag());
+}
+
+void Parser::drop_collapsed_whitespace(Element &parent, const Node *child) {
+  if (child == nullptr || !is_collapsed_whitespace(*child)) {
+    return;
+  }
+  if (m_hash_subtrees) {
+    invalidate_subtree_hash(&parent);
+  }
+  parent.remove(child);
+  m_node_count--;
+}
+
+// the tree only changes under closed elements when the adoption agency
+// moves nodes around, which makes the hashes of the closed ancestors stale
+void Parser::invalidate_subtree_hash(Element *element) {
+  while (element != nullptr && element->subtree_hash() != 0) {
+    element->set_subtree_hash(0);
+    element = element->parent();
+  }
+}
+
+// counts a new node against max_nodes. the clones made by the adoption agency
+// are counted without asking, since dropping them would lose content that is
+// already in the tree, so a document can end up a few nodes over the limit.
+bool Parser::allow_node() {
+  if (m_limits.max_nodes != 0 && m_node_count >= m_limits.max_nodes) {
+    m_limits_exceeded.nodes = true;
+    return false;
+  }
+  m_node_count++;
+  return true;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#generic-raw-text-element-parsing-algorithm
+// https://html.spec.whatwg.org/multipage/parsing.html#generic-rcdata-element-parsing-algorithm
+void Parser::insert_raw_text_element(const Token &t, TextState state) {
+  // even an element too deep to be pushed has to keep its content from
+  // being parsed as markup, the text then goes to its parent
+  switch_tokenizer_to(state);
+  if (!was_pushed(insert_element(t))) {
+    return;
+  }
+  m_original_mode = m_mode;
+  m_mode = InsertionMode::Text;
+}
+
+void Parser::switch_tokenizer_to(TextState state) {
+  if (m_tokenizer != nullptr) {
+    m_tokenizer->switch_to(state);
+  }
+}
+
+void Parser::pop() {
+  if (m_open_elements.empty()) {
+    return;
+  }
+  auto el = m_open_elements.pop();
+  if (m_whitespace_text == WhitespaceText::Drop &&
+      is_whitespace_boundary(el->tag()) && !el->children().empty() &&
+      (text.empty() || m_text_location.parent != el.get())) {
+    drop_collapsed_whitespace(*el, el->children().back().get());
+  }
+  if (m_hash_subtrees) {
+    // children are closed before their parent, so this is a single level.
+    // it stays 0 if a child is still open, finish() catches those.
+    el->set_subtree_hash(compute_subtree_hash(*el));
+  }
+  close_source_range(*el);
+  if (m_subtree_sink != nullptr && m_subtree_sink->wants(*el)) {
+    hand_over(el);
+  }
+}
+
+// the element ends after its own end tag, or where the token that implicitly
+// closed it starts. elements closed by the token that opened them, like void
+// elements, keep the range of that token.
+void Parser::close_source_range(Element &element) {
+  SourceRange range = element.source_range();
+  if (!range.is_valid() || m_current_token == nullptr ||
+      !m_current_token->source_range().is_valid()) {
+    return;
+  }
+  const auto &token_range = m_current_token->source_range();
+  uint32_t end = token_range.offset;
+  if (m_current_token->type() == TokenType::EndTag &&
+      m_current_token->data() == element.name()) {
+    end = token_range.end();
+  } else if (token_range.offset == range.offset) {
+    return;
+  }
+  if (end >= range.offset) {
+    range.length = end - range.offset;
+    element.set_source_range(range);
+  }
+}
+
+// once off the stack, nothing but the list of active formatting elements can
+// refer to the element, and that list only ever clones its entries, so the
+// subtree can leave the tree for good
+void Parser::hand_over(const ElementPtr &element) {
+  // text still buffered may belong inside it
+  flush_text();
+  if (auto *parent = element->parent()) {
+    m_hand_over_gap = {parent, child_before(*parent, element.get())};
+    parent->remove(element.get());
+  }
+  // finish() won't see it, so whatever the adoption agency took off the stack
+  // without popping it gets its hash here
+  if (m_hash_subtrees) {
+    fill_subtree_hashes(*element);
+  }
+  m_subtree_sink->subtree_complete(element);
+}
+
+void Parser::pop_until(Tag tag) {
+  if (!m_open_elements.contains(tag)) {
+    return;
+  }
+  while (!m_open_elements.empty()) {
+    bool done = current_node()->tag() == tag;
+    pop();
+    if (done) {
+      break;
+    }
+  }
+}
+
+void Parser::pop_until_any(std::initializer_list<Tag> tags) {
+  while (!m_open_elements.empty()) {
+    bool done = std::find(tags.begin(), tags.end(), current_node()->tag()) !=
+                tags.end();
+    pop();
+    if (done) {
+      break;
+    }
+  }
+}
+
+void Parser::remove_from_stack(size_t i) {
+  if (i + 1 == m_open_elements.size()) {
+    pop();
+  } else {
+    m_open_elements.erase(i);
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#generate-implied-end-tags
+void Parser::generate_implied_end_tags(Tag except) {
+  while (!m_open_elements.empty()) {
+    Tag tag = current_node()->tag();
+    if (tag == except ||
+        (tag != Tag::Dd && tag != Tag::Dt && tag != Tag::Li &&
+         tag != Tag::Optgroup && tag != Tag::Option && tag != Tag::P &&
+         tag != Tag::Rb && tag != Tag::Rp && tag != Tag::Rt &&
+         tag != Tag::Rtc)) {
+      break;
+    }
+    pop();
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#generate-all-implied-end-tags-thoroughly
+void Parser::generate_all_implied_end_tags_thoroughly() {
+  while (!m_open_elements.empty()) {
+    switch (current_node()->tag()) {
+    case Tag::Caption:
+    case Tag::Colgroup:
+    case Tag::Dd:
+    case Tag::Dt:
+    case Tag::Li:
+    case Tag::Optgroup:
+    case Tag::Option:
+    case Tag::P:
+    case Tag::Rb:
+    case Tag::Rp:
+    case Tag::Rt:
+    case Tag::Rtc:
+    case Tag::Tbody:
+    case Tag::Td:
+    case Tag::Tfoot:
+    case Tag::Th:
+    case Tag::Thead:
+    case Tag::Tr:
+      pop();
+      break;
+    default:
+      return;
+    }
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inhead
+// an end tag whose tag name is "template"
+void Parser::close_template_element() {
+  if (!m_open_elements.contains(Tag::Template)) {
+    return;
+  }
+  generate_all_implied_end_tags_thoroughly();
+  pop_until(Tag::Template);
+  clear_active_formatting_to_last_marker();
+  if (!m_template_modes.empty()) {
+    m_template_modes.pop_back();
+  }
+  reset_insertion_mode();
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#close-a-p-element
+void Parser::close_p_element() {
+  generate_implied_end_tags(Tag::P);
+  pop_until(Tag::P);
+}
+
+void Parser::close_p_element_in_button_scope() {
+  if (m_open_elements.has_in_scope(Tag::P, Scope::Button)) {
+    close_p_element();
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#close-the-cell
+void Parser::close_cell() {
+  generate_implied_end_tags();
+  pop_until_any({Tag::Td, Tag::Th});
+  clear_active_formatting_to_last_marker();
+  m_mode = InsertionMode::InRow;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#clear-the-stack-back-to-a-table-context
+void Parser::clear_stack_back_to(std::initializer_list<Tag> tags) {
+  while (!m_open_elements.empty() &&
+         std::find(tags.begin(), tags.end(), current_node()->tag()) ==
+             tags.end()) {
+    pop();
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#reset-the-insertion-mode-appropriately
+void Parser::reset_insertion_mode() {
+  for (size_t i = m_open_elements.size(); i > 0; i--) {
+    bool last = i == 1;
+    switch (m_open_elements[i - 1]->tag()) {
+    case Tag::Select:
+      for (size_t j = i - 1; j > 0; j--) {
+        Tag ancestor = m_open_elements[j - 1]->tag();
+        if (ancestor == Tag::Template) {
+          break;
+        }
+        if (ancestor == Tag::Table) {
+          m_mode = InsertionMode::InSelectInTable;
+          return;
+        }
+      }
+      m_mode = InsertionMode::InSelect;
+      return;
+    case Tag::Td:
+    case Tag::Th:
+      if (!last) {
+        m_mode = InsertionMode::InCell;
+        return;
+      }
+      break;
+    case Tag::Tr:
+      m_mode = InsertionMode::InRow;
+      return;
+    case Tag::Tbody:
+    case Tag::Thead:
+    case Tag::Tfoot:
+      m_mode = InsertionMode::InTableBody;
+      return;
+    case Tag::Caption:
+      m_mode = InsertionMode::InCaption;
+      return;
+    case Tag::Colgroup:
+      m_mode = InsertionMode::InColumnGroup;
+      return;
+    case Tag::Table:
+      m_mode = InsertionMode::InTable;
+      return;
+    case Tag::Template:
+      m_mode = m_template_modes.empty() ? InsertionMode::InBody
+                                        : m_template_modes.back();
+      return;
+    case Tag::Head:
+      if (!last) {
+        m_mode = InsertionMode::InHead;
+        return;
+      }
+      break;
+    case Tag::Body:
+      m_mode = InsertionMode::InBody;
+      return;
+    case Tag::Frameset:
+      m_mode = InsertionMode::InFrameset;
+      return;
+    case Tag::Html:
+      m_mode = m_head ? InsertionMode::AfterHead : InsertionMode::BeforeHead;
+      return;
+    default:
+      break;
+    }
+  }
+  m_mode = InsertionMode::InBody;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#push-onto-the-list-of-active-formatting-elements
+void Parser::push_active_formatting_element(const ElementPtr &element) {
+  if (current_node() != element.get()) {
+    // past the depth limit nothing is pushed, so there is nothing to
+    // reconstruct
+    return;
+  }
+
+  // noah's ark clause: at most three identical entries after the last marker
+  size_t identical = 0;
+  std::optional<size_t> earliest;
+  for (size_t i = m_active_formatting.size(); i > 0; i--) {
+    const auto &entry = m_active_formatting[i - 1];
+    if (!entry) {
+      break;
+    }
+    if (entry->name() == element->name() &&
+        entry->attributes() == element->attributes()) {
+      identical++;
+      earliest = i - 1;
+    }
+  }
+  if (identical >= 3) {
+    m_active_formatting.erase(m_active_formatting.begin() +
+                              static_cast<long>(*earliest));
+  }
+  m_active_formatting.push_back(element);
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#reconstruct-the-active-formatting-elements
+void Parser::reconstruct_active_formatting_elements() {
+  if (m_active_formatting.empty()) {
+    return;
+  }
+  const auto &last = m_active_formatting.back();
+  if (!last || m_open_elements.contains(last.get())) {
+    return;
+  }
+
+  size_t i = m_active_formatting.size() - 1;
+  while (i > 0) {
+    const auto &entry = m_active_formatting[i - 1];
+    if (!entry || m_open_elements.contains(entry.get())) {
+      break;
+    }
+    i--;
+  }
+
+  for (; i < m_active_formatting.size(); i++) {
+    Token t(TokenType::StartTag, m_active_formatting[i]->name());
+    for (const auto &attr : m_active_formatting[i]->attributes()) {
+      t.attributes().push_back({attr.first, attr.second});
+    }
+    if (m_current_token != nullptr &&
+        m_current_token->source_range().is_valid()) {
+      t.set_source_range({m_current_token->source_range().offset, 0});
+    }
+    m_active_formatting[i] = insert_element(t);
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#clear-the-list-of-active-formatting-elements-up-to-the-last-marker
+void Parser::clear_active_formatting_to_last_marker() {
+  while (!m_active_formatting.empty()) {
+    bool marker = !m_active_formatting.back();
+    m_active_formatting.pop_back();
+    if (marker) {
+      break;
+    }
+  }
+}
+
+std::optional<size_t>
+Parser::active_formatting_index_of(const Element *element) {
+  for (size_t i = m_active_formatting.size(); i > 0; i--) {
+    if (m_active_formatting[i - 1].get() == element) {
+      return i - 1;
+    }
+  }
+  return std::nullopt;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#adoption-agency-algorithm
+//
+// returns false if the token should be handled as "any other end tag". the
+// outer and inner loop limits from the spec bound the work done per token.
+bool Parser::run_adoption_agency(Token &t) {
+  const std::string &subject = t.data();
+
+  if (current_node()->name() == subject &&
+      !active_formatting_index_of(current_node())) {
+    pop();
+    return true;
+  }
+
+  for (int outer = 0; outer < 8; outer++) {
+    std::optional<size_t> formatting_index;
+    for (size_t i = m_active_formatting.size(); i > 0; i--) {
+      const auto &entry = m_active_formatting[i - 1];
+      if (!entry) {
+        break;
+      }
+      if (entry->name() == subject) {
+        formatting_index = i - 1;
+        break;
+      }
+    }
+    if (!formatting_index) {
+      return false;
+    }
+
+    auto formatting_element = m_active_formatting[*formatting_index];
+    auto stack_index = m_open_elements.index_of(formatting_element.get());
+    if (!stack_index) {
+      m_active_formatting.erase(m_active_formatting.begin() +
+                                static_cast<long>(*formatting_index));
+      return true;
+    }
+    if (!m_open_elements.has_in_scope(formatting_element.get())) {
+      return true;
+    }
+
+    std::optional<size_t> furthest_block_index;
+    for (size_t i = *stack_index + 1; i < m_open_elements.size(); i++) {
+      if (is_special(m_open_elements[i]->tag())) {
+        furthest_block_index = i;
+        break;
+      }
+    }
+    if (!furthest_block_index) {
+      while (!m_open_elements.empty()) {
+        bool done = current_node() == formatting_element.get();
+        pop();
+        if (done) {
+          break;
+        }
+      }
+      m_active_formatting.erase(m_active_formatting.begin() +
+                                static_cast<long>(*formatting_index));
+      return true;
+    }
+
+    auto furthest_block = m_open_elements[*furthest_block_index];
+    auto common_ancestor = m_open_elements[*stack_index - 1];
+    size_t bookmark = *formatting_index;
+
+    size_t node_index = *furthest_block_index;
+    NodePtr last_node = furthest_block;
+    for (int inner = 1;; inner++) {
+      node_index--;
+      auto node = m_open_elements[node_index];
+      if (node == formatting_element) {
+        break;
+      }
+
+      auto list_index = active_formatting_index_of(node.get());
+      if (inner > 3 && list_index) {
+        m_active_formatting.erase(m_active_formatting.begin() +
+                                  static_cast<long>(*list_index));
+        if (*list_index < bookmark) {
+          bookmark--;
+        }
+        list_index = std::nullopt;
+      }
+      if (!list_index) {
+        m_open_elements.erase(node_index);
+        continue;
+      }
+
+      Token clone_token(TokenType::StartTag, node->name());
+      auto clone = create_element(clone_token);
+      m_node_count++;
+      clone->attributes() = node->attributes();
+      clone->set_source_range({node->source_range().offset, 0});
+      m_active_formatting[*list_index] = clone;
+      m_open_elements.replace(node_index, clone);
+
+      if (last_node == furthest_block) {
+        bookmark = *list_index + 1;
+      }
+      insert_node(last_node, {clone.get(), nullptr});
+      last_node = clone;
+    }
+
+    insert_node(last_node,
+                appropriate_insertion_location(common_ancestor.get()));
+
+    Token clone_token(TokenType::StartTag, formatting_element->name());
+    auto new_element = create_element(clone_token);
+    m_node_count++;
+    new_element->attributes() = formatting_element->attributes();
+    new_element->set_source_range(
+        {formatting_element->source_range().offset, 0});
+    for (const auto &child : furthest_block->take_children()) {
+      new_element->append(child);
+    }
+    furthest_block->append(new_element);
+
+    auto old_index = active_formatting_index_of(formatting_element.get());
+    if (old_index) {
+      m_active_formatting.erase(m_active_formatting.begin() +
+                                static_cast<long>(*old_index));
+      if (*old_index < bookmark) {
+        bookmark--;
+      }
+    }
+    bookmark = std::min(bookmark, m_active_formatting.size());
+    m_active_formatting.insert(
+        m_active_formatting.begin() + static_cast<long>(bookmark),
+        new_element);
+
+    if (auto i = m_open_elements.index_of(formatting_element.get())) {
+      m_open_elements.erase(*i);
+    }
+    if (auto i = m_open_elements.index_of(furthest_block.get())) {
+      m_open_elements.insert(*i + 1, new_element);
+    }
+  }
+
+  return true;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inbody
+// "any other end tag"
+void Parser::handle_any_other_end_tag(Token &t) {
+  Tag tag = lookup_tag(t.data());
+  if (tag != Tag::Unknown && !m_open_elements.contains(tag)) {
+    return;
+  }
+
+  for (size_t i = m_open_elements.size(); i > 0; i--) {
+    auto node = m_open_elements[i - 1];
+    if (node->name() == t.data()) {
+      generate_implied_end_tags(tag);
+      while (!m_open_elements.empty()) {
+        bool done = current_node() == node.get();
+        pop();
+        if (done) {
+          break;
+        }
+      }
+      return;
+    }
+    if (is_special(node->tag())) {
+      return;
+    }
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#special
+bool Parser::is_special(Tag tag) {
+  switch (tag) {
+  case Tag::Address:
+  case Tag::Applet:
+  case Tag::Area:
+  case Tag::Article:
+  case Tag::Aside:
+  case Tag::Base:
+  case Tag::Basefont:
+  case Tag::Bgsound:
+  case Tag::Blockquote:
+  case Tag::Body:
+  case Tag::Br:
+  case Tag::Button:
+  case Tag::Caption:
+  case Tag::Center:
+  case Tag::Col:
+  case Tag::Colgroup:
+  case Tag::Dd:
+  case Tag::Details:
+  case Tag::Dir:
+  case Tag::Div:
+  case Tag::Dl:
+  case Tag::Dt:
+  case Tag::Embed:
+  case Tag::Fieldset:
+  case Tag::Figcaption:
+  case Tag::Figure:
+  case Tag::Footer:
+  case Tag::Form:
+  case Tag::Frame:
+  case Tag::Frameset:
+  case Tag::H1:
+  case Tag::H2:
+  case Tag::H3:
+  case Tag::H4:
+  case Tag::H5:
+  case Tag::H6:
+  case Tag::Head:
+  case Tag::Header:
+  case Tag::Hgroup:
+  case Tag::Hr:
+  case Tag::Html:
+  case Tag::Iframe:
+  case Tag::Img:
+  case Tag::Input:
+  case Tag::Keygen:
+  case Tag::Li:
+  case Tag::Link:
+  case Tag::Listing:
+  case Tag::Main:
+  case Tag::Marquee:
+  case Tag::Menu:
+  case Tag::Meta:
+  case Tag::Nav:
+  case Tag::Noembed:
+  case Tag::Noframes:
+  case Tag::Noscript:
+  case Tag::Object:
+  case Tag::Ol:
+  case Tag::P:
+  case Tag::Param:
+  case Tag::Plaintext:
+  case Tag::Pre:
+  case Tag::Script:
+  case Tag::Search:
+  case Tag::Section:
+  case Tag::Select:
+  case Tag::Source:
+  case Tag::Style:
+  case Tag::Summary:
+  case Tag::Table:
+  case Tag::Tbody:
+  case Tag::Td:
+  case Tag::Template:
+  case Tag::Textarea:
+  case Tag::Tfoot:
+  case Tag::Th:
+  case Tag::Thead:
+  case Tag::Title:
+  case Tag::Tr:
+  case Tag::Track:
+  case Tag::Ul:
+  case Tag::Wbr:
+  case Tag::Xmp:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// splits the leading whitespace off a character token, leaving the rest in t
+Token Parser::split_leading_whitespace(Token &t) {
+  std::string &data = t.data();
+  size_t n = 0;
+  while (n < data.size() && is_whitespace(data[n])) {
+    n++;
+  }
+
+  Token whitespace(TokenType::Character, data.substr(0, n));
+  data.erase(0, n);
+
+  SourceRange range = t.source_range();
+  if (range.is_valid() && n <= range.length) {
+    auto length = static_cast<uint32_t>(n);
+    whitespace.set_source_range({range.offset, length});
+    t.set_source_range({range.offset + length, range.length - length});
+  }
+  return whitespace;
+}
+
+std::shared_ptr<Node> parse(const std::string &s) {
+  Parser parser;
+  Tokenizer tokenizer(s);
+  tokenizer.run(parser);
+  return parser.finish();
+}
+
+Document parse_document(std::string source, const ParseOptions &options) {
+  // truncated before anything else looks at the input, so that neither the
+  // sniffer nor the decoder spends time on bytes that are dropped anyway.
+  // the cut is moved back to the start of a character, which for UTF-8 has
+  // to happen before sniffing, as a cut sequence would look like
+  // windows-1252.
+  LimitsExceeded exceeded;
+  size_t max_input_size = options.limits.max_input_size;
+  std::string_view raw = source;
+  if (max_input_size != 0 && raw.size() > max_input_size) {
+    raw = raw.substr(0, max_input_size);
+    exceeded.input_size = true;
+  }
+  SniffResult sniffed = sniff(
+      exceeded.input_size
+          ? raw.substr(0, character_boundary(raw, Encoding::Utf8))
+          : raw,
+      options.encoding);
+  if (exceeded.input_size) {
+    raw = raw.substr(0, character_boundary(raw, sniffed.encoding));
+  }
+
+  // UTF-8 is tokenized in place, anything else is decoded into a new source
+  // first. either way the document keeps what was tokenized, so that recorded
+  // ranges point into its source.
+  std::string decoded;
+  std::string_view input = decode_to_utf8(raw, sniffed, decoded);
+  // decoding can make the input longer again, e.g. 2 or 3 bytes of UTF-8 for
+  // every byte of windows-1252 above ASCII
+  if (max_input_size != 0 && input.size() > max_input_size) {
+    input = input.substr(
+        0, character_boundary(input.substr(0, max_input_size), Encoding::Utf8));
+    exceeded.input_size = true;
+  }
+  if (input.data() == decoded.data()) {
+    decoded.resize(input.size());
+    source = std::move(decoded);
+  } else {
+    // a byte order mark or a cut, input is a part of source
+    auto offset = static_cast<size_t>(input.data() - source.data());
+    source.resize(offset + input.size());
+    source.erase(0, offset);
+  }
+  if (exceeded.input_size) {
+    source.shrink_to_fit();
+  }
+  // done here rather than by the tokenizer, so that the document's source
+  // is what the ranges refer to
+  normalize_newlines(source);
+
+  // tokens go straight to the tree builder instead of being collected first
+  Parser parser(options);
+  Tokenizer tokenizer(source, options);
+  tokenizer.run(parser);
+  exceeded.attributes = tokenizer.limits_exceeded().attributes;
+  auto root = parser.finish();
+  const auto &parser_exceeded = parser.limits_exceeded();
+  exceeded.nodes = parser_exceeded.nodes;
+  exceeded.depth = parser_exceeded.depth;
+  exceeded.text_bytes = parser_exceeded.text_bytes;
+
+  Document document(std::move(source), std::move(root));
+  document.set_limits_exceeded(exceeded);
+  document.set_encoding(sniffed.encoding);
+  document.set_quirks_mode(parser.quirks_mode());
+  return document;
+}
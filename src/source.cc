@@ -0,0 +1,90 @@
+#include "source.hh"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void append_normalized_newlines(std::string &out, std::string_view chunk,
+                                bool &pending_cr) {
+  if (chunk.empty()) {
+    return;
+  }
+  if (pending_cr && chunk.front() == '\n') {
+    chunk.remove_prefix(1);
+  }
+  pending_cr = false;
+  size_t cr = chunk.find('\r');
+  while (cr != std::string_view::npos) {
+    out.append(chunk.substr(0, cr));
+    out += '\n';
+    if (cr + 1 == chunk.size()) {
+      pending_cr = true;
+    } else if (chunk[cr + 1] == '\n') {
+      cr++;
+    }
+    chunk.remove_prefix(cr + 1);
+    cr = chunk.find('\r');
+  }
+  out.append(chunk);
+}
+
+void normalize_newlines(std::string &text) {
+  size_t read = text.find('\r');
+  if (read == std::string::npos) {
+    return;
+  }
+  size_t write = read;
+  while (read < text.size()) {
+    char c = text[read++];
+    if (c == '\r') {
+      c = '\n';
+      if (read < text.size() && text[read] == '\n') {
+        read++;
+      }
+    }
+    text[write++] = c;
+  }
+  text.resize(write);
+}
+
+LineTable::LineTable(std::string_view source) {
+  m_line_starts.push_back(0);
+
+  const char *data = source.data();
+  size_t size = std::min<size_t>(source.size(), SourceRange::invalid_offset);
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  // compare 16 bytes at a time and walk the set bits of the match mask
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    auto mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+    while (mask != 0) {
+      auto bit = static_cast<uint32_t>(__builtin_ctz(mask));
+      m_line_starts.push_back(static_cast<uint32_t>(i + bit + 1));
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  while (i < size) {
+    const void *found = std::memchr(data + i, '\n', size - i);
+    if (found == nullptr) {
+      break;
+    }
+    i = static_cast<size_t>(static_cast<const char *>(found) - data) + 1;
+    m_line_starts.push_back(static_cast<uint32_t>(i));
+  }
+}
+
+SourcePosition LineTable::position(uint32_t offset) const {
+  auto it =
+      std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+  auto line = static_cast<uint32_t>(it - m_line_starts.begin());
+  return {line, offset - *(it - 1) + 1};
+}
@@ -0,0 +1,81 @@
+#include "stream.hh"
+#include <algorithm>
+
+void StreamParser::feed(std::string_view chunk) {
+  // nothing past the node limit is parsed, so it isn't kept either
+  if (m_finished || m_parser.stopped()) {
+    return;
+  }
+  if (m_keep_source) {
+    size_t room = m_max_input_size == 0
+                      ? chunk.size()
+                      : m_max_input_size - std::min(m_max_input_size,
+                                                    m_source.size());
+    // normalized the same way as the tokenizer does it
+    append_normalized_newlines(m_source, chunk.substr(0, room),
+                               m_source_pending_cr);
+  }
+  m_tokenizer.feed(chunk);
+}
+
+Document StreamParser::finish() {
+  // the parser has handed its tree over already
+  if (m_finished) {
+    return {std::string(), std::make_shared<Element>("root")};
+  }
+  m_finished = true;
+
+  m_tokenizer.finish();
+  auto root = m_parser.finish();
+
+  LimitsExceeded exceeded = m_parser.limits_exceeded();
+  exceeded.input_size = m_tokenizer.limits_exceeded().input_size;
+  exceeded.attributes = m_tokenizer.limits_exceeded().attributes;
+
+  Document document(std::move(m_source), std::move(root));
+  document.set_limits_exceeded(exceeded);
+  document.set_quirks_mode(m_parser.quirks_mode());
+  return document;
+}
+
+void TokenStream::feed(std::string_view chunk) {
+  if (m_done) {
+    return;
+  }
+  m_tokenizer.feed(chunk);
+  resume_reader();
+}
+
+void TokenStream::finish() {
+  if (m_done) {
+    return;
+  }
+  m_tokenizer.finish();
+  resume_reader();
+}
+
+void TokenStream::emit(Token &token) {
+  if (token.type() == TokenType::EndOfFile) {
+    m_done = true;
+  }
+  m_tokens.push_back(std::move(token));
+}
+
+// the reader runs until it has taken every token and suspends again, or
+// finishes
+void TokenStream::resume_reader() {
+  if (m_reader && (!m_tokens.empty() || m_done)) {
+    auto reader = m_reader;
+    m_reader = {};
+    reader.resume();
+  }
+}
+
+std::optional<Token> TokenStream::NextToken::await_resume() {
+  if (m_stream.m_tokens.empty()) {
+    return std::nullopt;
+  }
+  Token token = std::move(m_stream.m_tokens.front());
+  m_stream.m_tokens.pop_front();
+  return token;
+}
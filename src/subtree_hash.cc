@@ -0,0 +1,141 @@
+#include "subtree_hash.hh"
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// the murmur3 finalizer
+uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCDULL;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+class Hasher {
+public:
+  explicit Hasher(uint64_t kind) : m_hash(mix(kind)) {}
+
+  void add(uint64_t value) { m_hash = mix(m_hash ^ value) + value; }
+
+  void add(std::string_view s) {
+    add(s.size());
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+      uint64_t word;
+      std::memcpy(&word, s.data() + i, 8);
+      add(word);
+    }
+    if (i < s.size()) {
+      uint64_t word = 0;
+      std::memcpy(&word, s.data() + i, s.size() - i);
+      add(word);
+    }
+  }
+
+  [[nodiscard]] uint64_t finish() const {
+    // 0 means "no hash yet"
+    return m_hash == 0 ? 1 : m_hash;
+  }
+
+private:
+  uint64_t m_hash;
+};
+
+enum : uint64_t {
+  ElementKind = 1,
+  TextKind = 2,
+  AttributeKind = 3,
+};
+
+} // namespace
+
+uint64_t compute_subtree_hash(const Element &element) {
+  Hasher hasher(ElementKind);
+  hasher.add(element.name());
+
+  // a sum doesn't depend on the order the map happens to iterate in
+  uint64_t attributes = 0;
+  for (const auto &[name, value] : element.attributes()) {
+    Hasher attribute(AttributeKind);
+    attribute.add(name);
+    attribute.add(value);
+    attributes += attribute.finish();
+  }
+  hasher.add(element.attributes().size());
+  hasher.add(attributes);
+
+  hasher.add(element.children().size());
+  for (const auto &child : element.children()) {
+    if (child->is_element()) {
+      uint64_t hash = static_cast<const Element &>(*child).subtree_hash();
+      if (hash == 0) {
+        return 0;
+      }
+      hasher.add(hash);
+    } else {
+      Hasher text(TextKind);
+      text.add(static_cast<const TextNode &>(*child).content());
+      hasher.add(text.finish());
+    }
+  }
+  return hasher.finish();
+}
+
+void fill_subtree_hashes(Element &root) {
+  // post-order without recursion. an element with a hash has hashes all the
+  // way down, so its subtree is skipped.
+  std::vector<std::pair<Element *, bool>> stack;
+  if (root.subtree_hash() == 0) {
+    stack.emplace_back(&root, false);
+  }
+  while (!stack.empty()) {
+    auto &[element, expanded] = stack.back();
+    if (expanded) {
+      element->set_subtree_hash(compute_subtree_hash(*element));
+      stack.pop_back();
+      continue;
+    }
+    expanded = true;
+    Element *parent = element;
+    for (const auto &child : parent->children()) {
+      if (child->is_element()) {
+        auto *child_element = static_cast<Element *>(child.get());
+        if (child_element->subtree_hash() == 0) {
+          stack.emplace_back(child_element, false);
+        }
+      }
+    }
+  }
+}
+
+void SubtreeIndex::add(const Document &document, size_t document_id) {
+  if (!document.root() || !document.root()->is_element()) {
+    return;
+  }
+  std::vector<const Element *> stack = {
+      static_cast<const Element *>(document.root().get())};
+  while (!stack.empty()) {
+    const auto *element = stack.back();
+    stack.pop_back();
+    if (element->subtree_hash() != 0) {
+      m_entries[element->subtree_hash()].push_back({document_id, element});
+    }
+    const auto &children = element->children();
+    for (auto it = children.rbegin(); it != children.rend(); ++it) {
+      if ((*it)->is_element()) {
+        stack.push_back(static_cast<const Element *>(it->get()));
+      }
+    }
+  }
+}
+
+std::span<const SubtreeIndex::Entry> SubtreeIndex::find(uint64_t hash) const {
+  auto it = m_entries.find(hash);
+  if (it == m_entries.end()) {
+    return {};
+  }
+  return it->second;
+}
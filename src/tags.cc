@@ -0,0 +1,203 @@
+#include "tags.hh"
+#include <array>
+#include <unordered_map>
+
+namespace {
+
+constexpr std::array<std::string_view, static_cast<size_t>(Tag::Count)>
+    tag_names = {
+        "",
+        "a",
+        "address",
+        "applet",
+        "area",
+        "article",
+        "aside",
+        "b",
+        "base",
+        "basefont",
+        "bgsound",
+        "big",
+        "blockquote",
+        "body",
+        "br",
+        "button",
+        "caption",
+        "center",
+        "code",
+        "col",
+        "colgroup",
+        "dd",
+        "details",
+        "dialog",
+        "dir",
+        "div",
+        "dl",
+        "dt",
+        "em",
+        "embed",
+        "fieldset",
+        "figcaption",
+        "figure",
+        "font",
+        "footer",
+        "form",
+        "frame",
+        "frameset",
+        "h1",
+        "h2",
+        "h3",
+        "h4",
+        "h5",
+        "h6",
+        "head",
+        "header",
+        "hgroup",
+        "hr",
+        "html",
+        "i",
+        "iframe",
+        "image",
+        "img",
+        "input",
+        "keygen",
+        "li",
+        "link",
+        "listing",
+        "main",
+        "marquee",
+        "math",
+        "menu",
+        "meta",
+        "nav",
+        "nobr",
+        "noembed",
+        "noframes",
+        "noscript",
+        "object",
+        "ol",
+        "optgroup",
+        "option",
+        "p",
+        "param",
+        "plaintext",
+        "pre",
+        "rb",
+        "rp",
+        "rt",
+        "rtc",
+        "ruby",
+        "s",
+        "script",
+        "search",
+        "section",
+        "select",
+        "small",
+        "source",
+        "span",
+        "strike",
+        "strong",
+        "style",
+        "sub",
+        "summary",
+        "sup",
+        "svg",
+        "table",
+        "tbody",
+        "td",
+        "template",
+        "textarea",
+        "tfoot",
+        "th",
+        "thead",
+        "title",
+        "tr",
+        "track",
+        "tt",
+        "u",
+        "ul",
+        "wbr",
+        "xmp",
+};
+
+} // namespace
+
+Tag lookup_tag(std::string_view name) {
+  static const std::unordered_map<std::string_view, Tag> tags = [] {
+    std::unordered_map<std::string_view, Tag> map;
+    for (size_t i = 1; i < tag_names.size(); i++) {
+      map.emplace(tag_names[i], static_cast<Tag>(i));
+    }
+    return map;
+  }();
+
+  auto it = tags.find(name);
+  return it == tags.end() ? Tag::Unknown : it->second;
+}
+
+Tag lookup_tag(std::string_view name, Namespace ns) {
+  switch (ns) {
+  case Namespace::Html:
+    return lookup_tag(name);
+  case Namespace::Svg:
+    return name == "svg" ? Tag::Svg : Tag::Unknown;
+  case Namespace::MathMl:
+    return name == "math" ? Tag::Math : Tag::Unknown;
+  }
+  return Tag::Unknown;
+}
+
+std::string_view tag_name(Tag tag) {
+  return tag_names[static_cast<size_t>(tag)];
+}
+
+bool is_block_level(Tag tag) {
+  switch (tag) {
+  case Tag::Address:
+  case Tag::Article:
+  case Tag::Aside:
+  case Tag::Blockquote:
+  case Tag::Caption:
+  case Tag::Center:
+  case Tag::Dd:
+  case Tag::Details:
+  case Tag::Dialog:
+  case Tag::Dir:
+  case Tag::Div:
+  case Tag::Dl:
+  case Tag::Dt:
+  case Tag::Fieldset:
+  case Tag::Figcaption:
+  case Tag::Figure:
+  case Tag::Footer:
+  case Tag::Form:
+  case Tag::H1:
+  case Tag::H2:
+  case Tag::H3:
+  case Tag::H4:
+  case Tag::H5:
+  case Tag::H6:
+  case Tag::Header:
+  case Tag::Hgroup:
+  case Tag::Hr:
+  case Tag::Li:
+  case Tag::Main:
+  case Tag::Menu:
+  case Tag::Nav:
+  case Tag::Ol:
+  case Tag::Option:
+  case Tag::P:
+  case Tag::Search:
+  case Tag::Section:
+  case Tag::Summary:
+  case Tag::Table:
+  case Tag::Tbody:
+  case Tag::Tfoot:
+  case Tag::Thead:
+  case Tag::Tr:
+  case Tag::Ul:
+    return true;
+  default:
+    return false;
+  }
+}
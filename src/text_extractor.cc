@@ -0,0 +1,190 @@
+#include "text_extractor.hh"
+#include <algorithm>
+#include <utility>
+
+std::string_view TextExtractor::extract(std::string_view html) {
+  m_text.clear();
+  m_pending = Break::None;
+  m_skip_tag = Tag::Unknown;
+  m_skip_depth = 0;
+  m_pre_depth = 0;
+  m_skip_newline = false;
+  m_in_head = false;
+
+  ParseOptions options = m_options;
+  options.track_positions = false;
+  Tokenizer tokenizer(html, options);
+  tokenizer.run(*this);
+  return m_text;
+}
+
+void TextExtractor::emit(Token &token) {
+  bool skip_newline = std::exchange(m_skip_newline, false);
+  switch (token.type()) {
+  case TokenType::StartTag:
+    start_tag(token);
+    break;
+  case TokenType::EndTag:
+    end_tag(token);
+    break;
+  case TokenType::Character:
+    // the tree builder drops a newline right after <pre>, <listing> and
+    // <textarea>
+    // https://html.spec.whatwg.org/multipage/parsing.html#parsing-main-inbody
+    if (skip_newline && token.data().starts_with('\n')) {
+      characters(std::string_view(token.data()).substr(1));
+    } else {
+      characters(token.data());
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void TextExtractor::start_tag(const Token &token) {
+  Tag tag = lookup_tag(token.data());
+  if (m_skip_depth > 0) {
+    if (tag == m_skip_tag) {
+      m_skip_depth++;
+    }
+    return;
+  }
+
+  switch (tag) {
+  case Tag::Script:
+  case Tag::Style:
+  case Tag::Title:
+  case Tag::Template:
+    m_skip_tag = tag;
+    m_skip_depth = 1;
+    return;
+  case Tag::Noscript:
+  case Tag::Noframes:
+    if (m_in_head) {
+      m_skip_tag = tag;
+      m_skip_depth = 1;
+    }
+    return;
+  case Tag::Head:
+    m_in_head = true;
+    return;
+  case Tag::Base:
+  case Tag::Basefont:
+  case Tag::Bgsound:
+  case Tag::Link:
+  case Tag::Meta:
+    return;
+  case Tag::Br:
+    if (m_pending == Break::Line) {
+      flush_pending();
+    }
+    m_text += '\n';
+    m_pending = Break::None;
+    break;
+  case Tag::Td:
+  case Tag::Th:
+    if (m_pending == Break::None) {
+      m_pending = Break::Space;
+    }
+    break;
+  case Tag::Pre:
+  case Tag::Listing:
+  case Tag::Textarea:
+  case Tag::Xmp:
+    m_skip_newline = tag != Tag::Xmp;
+    m_pre_depth++;
+    m_pending = Break::Line;
+    break;
+  default:
+    if (is_block_level(tag)) {
+      m_pending = Break::Line;
+    }
+    break;
+  }
+  // anything that can't be in head means head was implicitly closed
+  m_in_head = false;
+}
+
+void TextExtractor::end_tag(const Token &token) {
+  Tag tag = lookup_tag(token.data());
+  if (m_skip_depth > 0) {
+    if (tag == m_skip_tag) {
+      m_skip_depth--;
+    }
+    return;
+  }
+
+  switch (tag) {
+  case Tag::Head:
+    m_in_head = false;
+    break;
+  case Tag::Pre:
+  case Tag::Listing:
+  case Tag::Textarea:
+  case Tag::Xmp:
+    if (m_pre_depth > 0) {
+      m_pre_depth--;
+    }
+    m_pending = Break::Line;
+    break;
+  case Tag::Br:
+    // "</br>" is treated as "<br>"
+    m_text += '\n';
+    m_pending = Break::None;
+    break;
+  default:
+    if (is_block_level(tag)) {
+      m_pending = Break::Line;
+    }
+    break;
+  }
+}
+
+void TextExtractor::characters(std::string_view data) {
+  if (m_skip_depth > 0) {
+    return;
+  }
+  if (m_in_head) {
+    if (std::all_of(data.begin(), data.end(), is_whitespace)) {
+      return;
+    }
+    m_in_head = false;
+  }
+
+  if (m_pre_depth > 0) {
+    flush_pending();
+    m_text += data;
+    return;
+  }
+
+  size_t i = 0;
+  while (i < data.size()) {
+    if (is_whitespace(data[i])) {
+      if (m_pending == Break::None) {
+        m_pending = Break::Space;
+      }
+      i++;
+      continue;
+    }
+    size_t end = i + 1;
+    while (end < data.size() && !is_whitespace(data[end])) {
+      end++;
+    }
+    flush_pending();
+    m_text.append(data.substr(i, end - i));
+    i = end;
+  }
+}
+
+void TextExtractor::flush_pending() {
+  bool at_line_start = m_text.empty() || m_text.back() == '\n';
+  if (!at_line_start) {
+    if (m_pending == Break::Space) {
+      m_text += ' ';
+    } else if (m_pending == Break::Line) {
+      m_text += '\n';
+    }
+  }
+  m_pending = Break::None;
+}
@@ -0,0 +1,87 @@
+#include "text_pool.hh"
+#include <cstring>
+
+std::shared_ptr<char[]> TextPool::new_block(size_t size) {
+  auto block = std::make_shared_for_overwrite<char[]>(sizeof(size_t) + size);
+  std::memcpy(block.get(), &size, sizeof(size_t));
+  return block;
+}
+
+size_t TextPool::block_size(const Text &text) {
+  if (!text.block) {
+    return 0;
+  }
+  size_t size = 0;
+  std::memcpy(&size, text.block.get(), sizeof(size_t));
+  return sizeof(size_t) + size;
+}
+
+char *TextPool::allocate(size_t size,
+                         std::shared_ptr<const char[]> &block) {
+  if (size > m_block_size / 4) {
+    // left out of the current block, which then still has room for the
+    // small texts that make up most of a document
+    auto own = new_block(size);
+    block = own;
+    return own.get() + sizeof(size_t);
+  }
+  if (m_capacity - m_used < size) {
+    m_block = new_block(m_block_size);
+    m_used = sizeof(size_t);
+    m_capacity = sizeof(size_t) + m_block_size;
+  }
+  char *data = m_block.get() + m_used;
+  m_used += size;
+  block = m_block;
+  return data;
+}
+
+TextPool::Text TextPool::store(std::string_view text) {
+  if (text.empty()) {
+    return {};
+  }
+  Text stored;
+  char *data = allocate(text.size(), stored.block);
+  std::memcpy(data, text.data(), text.size());
+  stored.content = {data, text.size()};
+  return stored;
+}
+
+TextPool::Text TextPool::append(const Text &text, std::string_view more) {
+  if (more.empty()) {
+    return text;
+  }
+  size_t size = text.content.size() + more.size();
+  if (text.capacity >= size && text.block.use_count() == 1) {
+    // the block was allocated writable below, and nothing else can see the
+    // bytes behind the content
+    auto *data = const_cast<char *>(text.content.data());
+    std::memcpy(data + text.content.size(), more.data(), more.size());
+    return {{data, size}, text.block, text.capacity};
+  }
+
+  const char *end = text.content.data() + text.content.size();
+  if (m_block && text.block.get() == m_block.get() &&
+      end == m_block.get() + m_used &&
+      m_capacity - m_used >= more.size()) {
+    std::memcpy(m_block.get() + m_used, more.data(), more.size());
+    m_used += more.size();
+    return {{text.content.data(), text.content.size() + more.size()},
+            text.block};
+  }
+
+  Text grown;
+  char *data = nullptr;
+  if (size > m_block_size / 4) {
+    grown.capacity = 2 * size;
+    auto own = new_block(grown.capacity);
+    grown.block = own;
+    data = own.get() + sizeof(size_t);
+  } else {
+    data = allocate(size, grown.block);
+  }
+  std::memcpy(data, text.content.data(), text.content.size());
+  std::memcpy(data + text.content.size(), more.data(), more.size());
+  grown.content = {data, size};
+  return grown;
+}
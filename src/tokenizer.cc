@@ -1,83 +1,613 @@
 #include "tokenizer.hh"
-#include <cassert>
-#include <functional>
+#include "encoding.hh"
+#include "entities.hh"
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// U+FFFD REPLACEMENT CHARACTER
+constexpr std::string_view replacement_character = "\xEF\xBF\xBD";
+
+void append_utf8(std::string &out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    out += static_cast<char>(0xC0 | (code_point >> 6));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += static_cast<char>(0xE0 | (code_point >> 12));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code_point >> 18));
+    out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+}
+
+int digit_value(char c, bool hex) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (hex && c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (hex && c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+} // namespace
 
 std::vector<Token> Tokenizer::parse() {
-  const std::unordered_map<State, std::function<void()>> state_handlers = {
-      {State::Data, [this]() { handle_data(); }},
-      {State::TagOpen, [this]() { handle_tag_open(); }},
-      {State::TagName, [this]() { handle_tag_name(); }},
-      {State::EndTagOpen, [this]() { handle_end_tag_open(); }},
-      {State::MarkupDeclarationOpen,
-       [this]() { handle_markup_declaration_open(); }},
-      {State::Doctype, [this]() { handle_doctype(); }},
-      {State::BeforeDoctypeName, [this]() { handle_before_doctype_name(); }},
-      {State::DoctypeName, [this]() { handle_doctype_name(); }},
-      {State::AfterDoctypeName, [this]() { handle_after_doctype_name(); }},
-      {State::AfterDoctypePublicKeyword,
-       [this]() { handle_after_doctype_public_keyword(); }},
-      {State::BeforeDoctypePublicIdentifier,
-       [this]() { handle_before_doctype_public_identifier(); }},
-      {State::DoctypePublicIdentifierDoubleQuoted,
-       [this]() { handle_doctype_public_identifier_double_quoted(); }},
-      {State::AfterDoctypePublicIdentifier,
-       [this]() { handle_after_doctype_public_identifier(); }},
-      {State::BetweenDoctypePublicAndSystemIdentifiers,
-       [this]() { handle_between_doctype_public_and_system_identifiers(); }},
-      {State::DoctypeSystemIdentifierDoubleQuoted,
-       [this]() { handle_doctype_system_identifier_double_quoted(); }},
-      {State::AfterDoctypeSystemIdentifier,
-       [this]() { handle_after_doctype_system_identifier(); }},
-      {State::BeforeAttributeName,
-       [this]() { handle_before_attribute_name(); }},
-      {State::AttributeName, [this]() { handle_attribute_name(); }},
-      {State::AfterAttributeName, [this]() { handle_after_attribute_name(); }},
-      {State::BeforeAttributeValue,
-       [this]() { handle_before_attribute_value(); }},
-      {State::AttributeValueDoubleQuoted,
-       [this]() { handle_attribute_value_double_quoted(); }},
-      {State::AttributeValueSingleQuoted,
-       [this]() { handle_attribute_value_single_quoted(); }},
-      {State::AttributeValueUnquoted,
-       [this]() { handle_attribute_value_unquoted(); }},
-      {State::AfterAttributeValueQuoted,
-       [this]() { handle_after_attribute_value_quoted(); }},
-      {State::CommentStart, [this]() { handle_comment_start(); }},
-      {State::CommentStartDash, [this]() { handle_comment_start_dash(); }},
-      {State::Comment, [this]() { handle_comment(); }},
-      {State::CommentLessThanSign,
-       [this]() { handle_comment_less_than_sign(); }},
-      {State::CommentLessThanSignBang,
-       [this]() { handle_comment_less_than_sign_bang(); }},
-      {State::CommentLessThanSignBangDash,
-       [this]() { handle_comment_less_than_sign_bang_dash(); }},
-      {State::CommentLessThanSignBangDashDash,
-       [this]() { handle_comment_less_than_sign_bang_dash_dash(); }},
-      {State::CommentEndDash, [this]() { handle_comment_end_dash(); }},
-      {State::CommentEnd, [this]() { handle_comment_end(); }},
-      {State::SelfClosingStartTag,
-       [this]() { handle_self_closing_start_tag(); }},
-      {State::ScriptData, [this]() { handle_script_data(); }},
-      {State::StyleData, [this]() { handle_style_data(); }},
-  };
-
-  while (!eof()) {
-    auto it = state_handlers.find(m_state);
-    assert(it != state_handlers.end());
-    it->second();
-  }
-  return m_tokens;
+  tokenize();
+  return std::move(m_tokens);
+}
+
+void Tokenizer::run(TokenSink &sink) {
+  m_sink = &sink;
+  m_sink_switches_state = sink.attach(*this);
+  tokenize();
+  m_sink = nullptr;
+  m_sink_switches_state = false;
+}
+
+void Tokenizer::feed(std::string_view chunk) {
+  if (sink_stopped()) {
+    return;
+  }
+  size_t max = m_limits.max_input_size;
+  size_t fed = m_base + m_buffer.size();
+  if (max != 0 && fed + chunk.size() > max) {
+    chunk = chunk.substr(0, max - std::min(max, fed));
+    m_limits_exceeded.input_size = true;
+  }
+
+  // tokens own their data, so the consumed input is not needed anymore
+  if (m_current > 0) {
+    m_buffer.erase(0, m_current);
+    m_base += m_current;
+    m_current = 0;
+  }
+  append_normalized_newlines(m_buffer, chunk, m_pending_cr);
+  m_data = m_buffer;
+  m_need_input = false;
+  tokenize_available();
+}
+
+void Tokenizer::finish() {
+  m_input_finished = true;
+  tokenize();
+}
+
+void Tokenizer::tokenize() {
+  tokenize_available();
+
+  handle_eof();
+  begin_token(TokenType::EndOfFile, m_base + m_current);
+  if (m_sink != nullptr) {
+    flush_to_sink();
+  }
+}
+
+// until the input is finished, a state only runs with enough input buffered
+// for its longest lookahead, so it never sees a keyword or a reference cut in
+// half
+void Tokenizer::tokenize_available() {
+  while (!eof() && !m_need_input && !sink_stopped()) {
+    if (!m_input_finished && m_data.size() - m_current < max_lookahead) {
+      break;
+    }
+    State previous = m_state;
+    step();
+    // every tag, comment and doctype token is finished by switching back to
+    // one of the text states. "</>" gets there without emitting anything.
+    if (m_track_positions && previous != m_state && in_text_state() &&
+        !m_tokens.empty() &&
+        current_token().source_range().offset == m_token_start) {
+      end_token();
+    }
+    // the sink may switch the state in response, before the text that
+    // follows a start tag is read
+    if (m_sink != nullptr && in_text_state()) {
+      flush_to_sink();
+    }
+  }
+}
+
+void Tokenizer::step() {
+  switch (m_state) {
+  case State::Data:
+    handle_data();
+    break;
+  case State::TagOpen:
+    handle_tag_open();
+    break;
+  case State::TagName:
+    handle_tag_name();
+    break;
+  case State::EndTagOpen:
+    handle_end_tag_open();
+    break;
+  case State::MarkupDeclarationOpen:
+    handle_markup_declaration_open();
+    break;
+  case State::BogusComment:
+    handle_bogus_comment();
+    break;
+  case State::Doctype:
+    handle_doctype();
+    break;
+  case State::BeforeDoctypeName:
+    handle_before_doctype_name();
+    break;
+  case State::DoctypeName:
+    handle_doctype_name();
+    break;
+  case State::AfterDoctypeName:
+    handle_after_doctype_name();
+    break;
+  case State::AfterDoctypePublicKeyword:
+    handle_after_doctype_public_keyword();
+    break;
+  case State::BeforeDoctypePublicIdentifier:
+    handle_before_doctype_public_identifier();
+    break;
+  case State::DoctypePublicIdentifierDoubleQuoted:
+    handle_doctype_public_identifier_quoted('"');
+    break;
+  case State::DoctypePublicIdentifierSingleQuoted:
+    handle_doctype_public_identifier_quoted('\'');
+    break;
+  case State::AfterDoctypePublicIdentifier:
+    handle_after_doctype_public_identifier();
+    break;
+  case State::BetweenDoctypePublicAndSystemIdentifiers:
+    handle_between_doctype_public_and_system_identifiers();
+    break;
+  case State::AfterDoctypeSystemKeyword:
+    handle_after_doctype_system_keyword();
+    break;
+  case State::BeforeDoctypeSystemIdentifier:
+    handle_before_doctype_system_identifier();
+    break;
+  case State::DoctypeSystemIdentifierDoubleQuoted:
+    handle_doctype_system_identifier_quoted('"');
+    break;
+  case State::DoctypeSystemIdentifierSingleQuoted:
+    handle_doctype_system_identifier_quoted('\'');
+    break;
+  case State::AfterDoctypeSystemIdentifier:
+    handle_after_doctype_system_identifier();
+    break;
+  case State::BogusDoctype:
+    handle_bogus_doctype();
+    break;
+  case State::BeforeAttributeName:
+    handle_before_attribute_name();
+    break;
+  case State::AttributeName:
+    handle_attribute_name();
+    break;
+  case State::AfterAttributeName:
+    handle_after_attribute_name();
+    break;
+  case State::BeforeAttributeValue:
+    handle_before_attribute_value();
+    break;
+  case State::AttributeValueDoubleQuoted:
+    handle_attribute_value_double_quoted();
+    break;
+  case State::AttributeValueSingleQuoted:
+    handle_attribute_value_single_quoted();
+    break;
+  case State::AttributeValueUnquoted:
+    handle_attribute_value_unquoted();
+    break;
+  case State::AfterAttributeValueQuoted:
+    handle_after_attribute_value_quoted();
+    break;
+  case State::CommentStart:
+    handle_comment_start();
+    break;
+  case State::CommentStartDash:
+    handle_comment_start_dash();
+    break;
+  case State::Comment:
+    handle_comment();
+    break;
+  case State::CommentLessThanSign:
+    handle_comment_less_than_sign();
+    break;
+  case State::CommentLessThanSignBang:
+    handle_comment_less_than_sign_bang();
+    break;
+  case State::CommentLessThanSignBangDash:
+    handle_comment_less_than_sign_bang_dash();
+    break;
+  case State::CommentLessThanSignBangDashDash:
+    handle_comment_less_than_sign_bang_dash_dash();
+    break;
+  case State::CommentEndDash:
+    handle_comment_end_dash();
+    break;
+  case State::CommentEnd:
+    handle_comment_end();
+    break;
+  case State::CommentEndBang:
+    handle_comment_end_bang();
+    break;
+  case State::SelfClosingStartTag:
+    handle_self_closing_start_tag();
+    break;
+  case State::Rcdata:
+  case State::Rawtext:
+  case State::ScriptData:
+  case State::Plaintext:
+    handle_raw_text();
+    break;
+  case State::CdataSection:
+    handle_cdata_section();
+    break;
+  }
+}
+
+// only called in the data states, where no token is still being built
+void Tokenizer::flush_to_sink() {
+  for (auto &token : m_tokens) {
+    m_sink->emit(token);
+  }
+  m_tokens.clear();
+}
+
+void Tokenizer::begin_token(TokenType type, size_t offset, std::string data) {
+  m_tokens.emplace_back(type, std::move(data));
+  if (m_track_positions && offset < SourceRange::invalid_offset) {
+    current_token().set_source_range({static_cast<uint32_t>(offset), 0});
+  }
+}
+
+void Tokenizer::end_token() {
+  if (m_tokens.empty()) {
+    return;
+  }
+  SourceRange range = current_token().source_range();
+  if (range.is_valid()) {
+    range.length = static_cast<uint32_t>(
+        std::min<size_t>(m_base + m_current - range.offset,
+                         SourceRange::invalid_offset));
+    current_token().set_source_range(range);
+  }
+}
+
+// attributes past the limit are still tokenized, but into a scratch attribute
+// that is thrown away
+void Tokenizer::begin_attribute(std::string name) {
+  auto &attributes = current_token().attributes();
+  size_t max = m_limits.max_attributes;
+  if (max != 0 && attributes.size() >= max) {
+    m_limits_exceeded.attributes = true;
+    m_discarded_attribute = {std::move(name), ""};
+    m_discard_attribute = true;
+    return;
+  }
+  attributes.push_back({std::move(name), ""});
+  m_discard_attribute = false;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#attribute-name-state
+// once its name is complete, an attribute the tag already has is dropped
+// along with its value, so that the first one wins
+void Tokenizer::end_attribute_name() {
+  if (m_discard_attribute) {
+    return;
+  }
+  // a linear search is faster for the few attributes most tags have, a set
+  // keeps tags with thousands from taking quadratic time
+  constexpr size_t max_linear = 16;
+  auto &attributes = current_token().attributes();
+  const std::string &name = attributes.back().name;
+  bool duplicate = false;
+  if (attributes.size() <= max_linear) {
+    duplicate = std::any_of(
+        attributes.begin(), attributes.end() - 1,
+        [&](const Token::Attribute &other) { return other.name == name; });
+  } else {
+    if (attributes.size() == max_linear + 1) {
+      m_attribute_names.clear();
+      for (size_t i = 0; i < max_linear; i++) {
+        m_attribute_names.insert(attributes[i].name);
+      }
+    }
+    duplicate = !m_attribute_names.insert(name).second;
+  }
+  if (duplicate) {
+    error(ParseErrorCode::DuplicateAttribute);
+    m_discarded_attribute = std::move(attributes.back());
+    attributes.pop_back();
+    m_discard_attribute = true;
+  }
+}
+
+// adjacent character data is merged into one token, the tree builder splits
+// it again where whitespace matters
+void Tokenizer::emit_characters(size_t offset, std::string_view data) {
+  if (!m_tokens.empty() && current_token().type() == TokenType::Character &&
+      (!m_track_positions || current_token().source_range().end() == offset)) {
+    current_token().data() += data;
+  } else {
+    begin_token(TokenType::Character, offset, std::string(data));
+  }
+  end_token();
+}
+
+// emits the current tag token and, unless the sink takes care of it,
+// switches to the state its content is most likely read in
+void Tokenizer::emit_tag() {
+  m_state = State::Data;
+  if (current_token().type() == TokenType::EndTag) {
+    // https://html.spec.whatwg.org/multipage/parsing.html#parse-error-end-tag-with-attributes
+    if (!current_token().attributes().empty()) {
+      error(ParseErrorCode::EndTagWithAttributes);
+    }
+    if (current_token().is_self_closing()) {
+      error(ParseErrorCode::EndTagWithTrailingSolidus);
+    }
+    return;
+  }
+  if (current_token().type() != TokenType::StartTag) {
+    return;
+  }
+  m_last_start_tag = current_token().data();
+  if (m_sink_switches_state) {
+    return;
+  }
+  const std::string &name = m_last_start_tag;
+  if (name == "script") {
+    m_state = State::ScriptData;
+  } else if (name == "style" || name == "xmp" || name == "iframe" ||
+             name == "noembed" || name == "noframes") {
+    m_state = State::Rawtext;
+  } else if (name == "title" || name == "textarea") {
+    m_state = State::Rcdata;
+  } else if (name == "plaintext") {
+    m_state = State::Plaintext;
+  }
+}
+
+void Tokenizer::switch_to(TextState state) {
+  switch (state) {
+  case TextState::Data:
+    m_state = State::Data;
+    break;
+  case TextState::Rcdata:
+    m_state = State::Rcdata;
+    break;
+  case TextState::Rawtext:
+    m_state = State::Rawtext;
+    break;
+  case TextState::ScriptData:
+    m_state = State::ScriptData;
+    break;
+  case TextState::Plaintext:
+    m_state = State::Plaintext;
+    break;
+  }
+}
+
+// the states that no token is being built in
+bool Tokenizer::in_text_state() const {
+  return m_state == State::Data || m_state == State::Rcdata ||
+         m_state == State::Rawtext || m_state == State::ScriptData ||
+         m_state == State::Plaintext || m_state == State::CdataSection;
+}
+
+void Tokenizer::error(ParseErrorCode code) {
+  error(code, m_base + (m_current == 0 ? 0 : m_current - 1));
+}
+
+void Tokenizer::error(ParseErrorCode code, size_t offset) {
+  if (m_error_sink == nullptr) {
+    return;
+  }
+  m_error_sink->report(
+      {code, static_cast<uint32_t>(
+                 std::min<size_t>(offset, SourceRange::invalid_offset))});
+}
+
+bool Tokenizer::next_chars_are(std::string_view s, bool case_insensitive) {
+  for (size_t i = 0; i < s.size(); i++) {
+    char c = peek(static_cast<long>(i));
+    if (case_insensitive) {
+      c = to_ascii_lower(c);
+    }
+    if (c != s[i]) {
+      return false;
+    }
+  }
+  return true;
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#data-state
 void Tokenizer::handle_data() {
   char c = consume();
-  // TODO: handle entities (&)
   if (c == '<') {
+    m_token_start = m_base + m_current - 1;
     m_state = State::TagOpen;
+  } else if (c == '&') {
+    size_t start = m_current - 1;
+    std::string decoded;
+    consume_character_reference(decoded, false);
+    if (!m_need_input) {
+      emit_characters(m_base + start, decoded);
+    }
   } else {
-    m_tokens.emplace_back(TokenType::Character, std::string(1, c));
+    // the rest of the run up to the next tag or reference is taken in one go
+    size_t start = m_current - 1;
+    size_t end = m_data.find_first_of(std::string_view("<&\0", 3), m_current);
+    if (end == std::string_view::npos) {
+      end = m_data.size();
+    }
+    if (c == '\0') {
+      error(ParseErrorCode::UnexpectedNullCharacter);
+    }
+    while (end < m_data.size() && m_data[end] == '\0') {
+      error(ParseErrorCode::UnexpectedNullCharacter, m_base + end);
+      end = m_data.find_first_of(std::string_view("<&\0", 3), end + 1);
+      if (end == std::string_view::npos) {
+        end = m_data.size();
+      }
+    }
+    m_current = end;
+    emit_characters(m_base + start, m_data.substr(start, end - start));
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#character-reference-state
+// called after the '&'. appends the replacement text, or the '&' itself when
+// no reference follows, in which case the rest is consumed as ordinary input.
+void Tokenizer::consume_character_reference(std::string &out,
+                                            bool in_attribute) {
+  char c = peek(0);
+  if (c == '#') {
+    m_current++;
+    consume_numeric_character_reference(out);
+    return;
+  }
+  if (!is_ascii_alphanumeric(c)) {
+    out += '&';
+    return;
+  }
+
+  // https://html.spec.whatwg.org/multipage/parsing.html#named-character-reference-state
+  // the longest name in the table wins, so "&notit;" is "\u00ACit;"
+  size_t run = 0;
+  while (run < max_character_reference_name_length &&
+         is_ascii_alphanumeric(peek(static_cast<long>(run)))) {
+    run++;
+  }
+  std::string_view rest = m_data.substr(m_current);
+  std::string_view value;
+  size_t length = 0;
+  if (peek(static_cast<long>(run)) == ';') {
+    value = lookup_named_character_reference(rest.substr(0, run + 1));
+    length = run + 1;
+  }
+  for (size_t n = run; value.empty() && n > 0; n--) {
+    value = lookup_named_character_reference(rest.substr(0, n));
+    length = n;
+  }
+
+  if (value.empty()) {
+    // https://html.spec.whatwg.org/multipage/parsing.html#ambiguous-ampersand-state
+    while (is_ascii_alphanumeric(peek(static_cast<long>(run)))) {
+      run++;
+    }
+    if (peek(static_cast<long>(run)) == ';') {
+      error(ParseErrorCode::UnknownNamedCharacterReference,
+            m_base + m_current + run);
+    }
+    out += '&';
+    return;
+  }
+
+  bool semicolon = rest[length - 1] == ';';
+  char next = peek(static_cast<long>(length));
+  if (in_attribute && !semicolon && (next == '=' || is_ascii_alphanumeric(next))) {
+    // left as written for the sake of query strings like "?a=1&copy=2"
+    out += '&';
+    out += rest.substr(0, length);
+    m_current += length;
+    return;
+  }
+
+  m_current += length;
+  if (!semicolon) {
+    error(ParseErrorCode::MissingSemicolonAfterCharacterReference);
   }
+  out += value;
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#numeric-character-reference-state
+// called after the "&#"
+void Tokenizer::consume_numeric_character_reference(std::string &out) {
+  bool hex = peek(0) == 'x' || peek(0) == 'X';
+  size_t digits_start = m_current + (hex ? 1 : 0);
+  size_t i = digits_start;
+  uint32_t code_point = 0;
+  if (m_partial_reference &&
+      m_partial_reference->digits_start == m_base + digits_start) {
+    i = m_partial_reference->end - m_base;
+    code_point = m_partial_reference->code_point;
+  }
+  m_partial_reference.reset();
+  for (; i < m_data.size(); i++) {
+    int digit = digit_value(m_data[i], hex);
+    if (digit < 0) {
+      break;
+    }
+    // saturates just past the unicode range, which is an error anyway
+    if (code_point <= 0x10FFFF) {
+      code_point = code_point * (hex ? 16 : 10) + static_cast<uint32_t>(digit);
+    }
+  }
+
+  if (i == m_data.size() && !m_input_finished) {
+    // the digits might go on in the next chunk, start over from the '&'
+    // but not from the first digit
+    m_partial_reference = {m_base + digits_start, m_base + i, code_point};
+    m_current -= 2;
+    m_need_input = true;
+    return;
+  }
+
+  if (i == digits_start) {
+    error(ParseErrorCode::AbsenceOfDigitsInNumericCharacterReference);
+    out += "&#";
+    out += m_data.substr(m_current, digits_start - m_current);
+    m_current = digits_start;
+    return;
+  }
+
+  m_current = i;
+  if (peek(0) == ';') {
+    m_current++;
+  } else {
+    error(ParseErrorCode::MissingSemicolonAfterCharacterReference);
+  }
+
+  // https://html.spec.whatwg.org/multipage/parsing.html#numeric-character-reference-end-state
+  if (code_point == 0) {
+    error(ParseErrorCode::NullCharacterReference);
+    code_point = 0xFFFD;
+  } else if (code_point > 0x10FFFF) {
+    error(ParseErrorCode::CharacterReferenceOutsideUnicodeRange);
+    code_point = 0xFFFD;
+  } else if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+    error(ParseErrorCode::SurrogateCharacterReference);
+    code_point = 0xFFFD;
+  } else {
+    if ((code_point >= 0xFDD0 && code_point <= 0xFDEF) ||
+        (code_point & 0xFFFE) == 0xFFFE) {
+      error(ParseErrorCode::NoncharacterCharacterReference);
+    }
+    bool control = code_point < 0x20 || (code_point >= 0x7F && code_point <= 0x9F);
+    bool whitespace = code_point == '\t' || code_point == '\n' ||
+                      code_point == '\f' || code_point == ' ';
+    if (control && !whitespace) {
+      error(ParseErrorCode::ControlCharacterReference);
+    }
+    // numeric references to C1 controls mean the windows-1252 character
+    // instead, which is the control itself where windows-1252 has none
+    if (code_point >= 0x80 && code_point <= 0x9F) {
+      const auto &windows_1252 = *single_byte_index(Encoding::Windows1252);
+      code_point = windows_1252[code_point - 0x80];
+    }
+  }
+  append_utf8(out, code_point);
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#tag-open-state
@@ -87,15 +617,18 @@ void Tokenizer::handle_tag_open() {
     m_state = State::MarkupDeclarationOpen;
   } else if (c == '/') {
     m_state = State::EndTagOpen;
-  } else if (std::isalpha(c) != 0) {
-    m_tokens.emplace_back(TokenType::StartTag, "");
+  } else if (is_ascii_alpha(c)) {
+    begin_token(TokenType::StartTag, m_token_start);
     m_current--;
     m_state = State::TagName;
   } else if (c == '?') {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::UnexpectedQuestionMarkInsteadOfTagName);
+    begin_token(TokenType::Comment, m_token_start);
+    m_current--;
+    m_state = State::BogusComment;
   } else {
-    // TODO: This is an invalid-first-character-of-tag-name parse error.
-    m_tokens.emplace_back(TokenType::Character, "<");
+    error(ParseErrorCode::InvalidFirstCharacterOfTagName);
+    begin_token(TokenType::Character, m_token_start, "<");
     m_current--;
     m_state = State::Data;
   }
@@ -105,212 +638,391 @@ void Tokenizer::handle_tag_open() {
 void Tokenizer::handle_tag_name() {
   char c = consume();
   if (c == '>') {
-    if (current_token().type() == TokenType::StartTag &&
-        current_token().data() == "script") {
-      m_state = State::ScriptData;
-    } else if (current_token().type() == TokenType::StartTag &&
-               current_token().data() == "style") {
-      m_state = State::StyleData;
-    } else {
-      m_state = State::Data;
-    }
+    emit_tag();
   } else if (c == '/') {
     m_state = State::SelfClosingStartTag;
-  } else if (c == '\t' || c == '\n' || c == ' ') {
+  } else if (is_whitespace(c)) {
     m_state = State::BeforeAttributeName;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_token().data() += replacement_character;
   } else {
-    current_token().data() += c;
+    current_token().data() += to_ascii_lower(c);
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#end-tag-open-state
 void Tokenizer::handle_end_tag_open() {
   char c = consume();
-  if (std::isalpha(c) != 0) {
-    m_tokens.emplace_back(TokenType::EndTag, "");
+  if (is_ascii_alpha(c)) {
+    begin_token(TokenType::EndTag, m_token_start);
     m_current--;
     m_state = State::TagName;
   } else if (c == '>') {
-    UNIMPLEMENTED();
+    // nothing is emitted for "</>"
+    error(ParseErrorCode::MissingEndTagName);
+    m_state = State::Data;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::InvalidFirstCharacterOfTagName);
+    begin_token(TokenType::Comment, m_token_start);
+    m_current--;
+    m_state = State::BogusComment;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#markup-declaration-open-state
 void Tokenizer::handle_markup_declaration_open() {
-  if (std::toupper(peek(0)) == 'D' && std::toupper(peek(1)) == 'O' &&
-      std::toupper(peek(2)) == 'C' && std::toupper(peek(3)) == 'T' &&
-      std::toupper(peek(4)) == 'Y' && std::toupper(peek(5)) == 'P' &&
-      std::toupper(peek(6)) == 'E') {
-    m_current += 7;
-    m_state = State::Doctype;
-  } else if (std::toupper(peek(0)) == '-' && std::toupper(peek(1)) == '-') {
+  if (next_chars_are("--", false)) {
     m_current += 2;
-    m_tokens.emplace_back(TokenType::Comment, "");
+    begin_token(TokenType::Comment, m_token_start);
     m_state = State::CommentStart;
+  } else if (next_chars_are("doctype", true)) {
+    m_current += 7;
+    m_state = State::Doctype;
+  } else if (next_chars_are("[CDATA[", false) && m_cdata_allowed) {
+    m_current += 7;
+    m_state = State::CdataSection;
+  } else if (next_chars_are("[CDATA[", false)) {
+    error(ParseErrorCode::CdataInHtmlContent);
+    m_current += 7;
+    begin_token(TokenType::Comment, m_token_start, "[CDATA[");
+    m_state = State::BogusComment;
+  } else {
+    error(ParseErrorCode::IncorrectlyOpenedComment);
+    begin_token(TokenType::Comment, m_token_start);
+    m_state = State::BogusComment;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#cdata-section-state
+// the content is text, up to the first "]]>"
+void Tokenizer::handle_cdata_section() {
+  size_t start = m_current;
+  size_t end = m_data.find("]]>", start);
+  if (end == std::string_view::npos) {
+    // a "]]" at the end may be completed by the next chunk
+    end = m_input_finished ? m_data.size() : m_data.size() - 2;
+    m_current = end;
+  } else {
+    m_current = end + 3;
+    m_state = State::Data;
+  }
+  if (end > start) {
+    emit_characters(m_base + start, m_data.substr(start, end - start));
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#bogus-comment-state
+void Tokenizer::handle_bogus_comment() {
+  char c = consume();
+  if (c == '>') {
+    m_state = State::Data;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_token().data() += replacement_character;
   } else {
-    UNIMPLEMENTED();
+    current_token().data() += c;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#doctype-state
 void Tokenizer::handle_doctype() {
   char c = consume();
-  if (c == ' ') {
+  if (is_whitespace(c)) {
+    m_state = State::BeforeDoctypeName;
+  } else if (c == '>') {
+    m_current--;
     m_state = State::BeforeDoctypeName;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingWhitespaceBeforeDoctypeName);
+    m_current--;
+    m_state = State::BeforeDoctypeName;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#before-doctype-name-state
 void Tokenizer::handle_before_doctype_name() {
   char c = consume();
-  if (std::isalpha(c) != 0) {
-    m_tokens.emplace_back(TokenType::Doctype, "");
-    m_current--;
+  if (is_whitespace(c)) {
+    // ignore
+  } else if (c == '>') {
+    error(ParseErrorCode::MissingDoctypeName);
+    begin_token(TokenType::Doctype, m_token_start);
+    current_token().set_force_quirks(true);
+    m_state = State::Data;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    begin_token(TokenType::Doctype, m_token_start,
+                std::string(replacement_character));
     m_state = State::DoctypeName;
   } else {
-    UNIMPLEMENTED();
+    begin_token(TokenType::Doctype, m_token_start);
+    m_current--;
+    m_state = State::DoctypeName;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#doctype-name-state
 void Tokenizer::handle_doctype_name() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     m_state = State::AfterDoctypeName;
   } else if (c == '>') {
     m_state = State::Data;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_token().data() += replacement_character;
   } else {
-    current_token().data() += c;
+    current_token().data() += to_ascii_lower(c);
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#after-doctype-name-state
 void Tokenizer::handle_after_doctype_name() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '>') {
     m_state = State::Data;
-  } else if (std::toupper(peek(-1)) == 'P' && std::toupper(peek(0)) == 'U' &&
-             std::toupper(peek(1)) == 'B' && std::toupper(peek(2)) == 'L' &&
-             std::toupper(peek(3)) == 'I' && std::toupper(peek(4)) == 'C') {
-    m_current += 5;
-    m_state = State::AfterDoctypePublicKeyword;
   } else {
-    UNIMPLEMENTED();
+    m_current--;
+    if (next_chars_are("public", true)) {
+      m_current += 6;
+      m_state = State::AfterDoctypePublicKeyword;
+    } else if (next_chars_are("system", true)) {
+      m_current += 6;
+      m_state = State::AfterDoctypeSystemKeyword;
+    } else {
+      error(ParseErrorCode::InvalidCharacterSequenceAfterDoctypeName);
+      current_token().set_force_quirks(true);
+      m_state = State::BogusDoctype;
+    }
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#after-doctype-public-keyword-state
 void Tokenizer::handle_after_doctype_public_keyword() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     m_state = State::BeforeDoctypePublicIdentifier;
+  } else if (c == '"') {
+    error(ParseErrorCode::MissingWhitespaceAfterDoctypePublicKeyword);
+    current_token().public_identifier().emplace();
+    m_state = State::DoctypePublicIdentifierDoubleQuoted;
+  } else if (c == '\'') {
+    error(ParseErrorCode::MissingWhitespaceAfterDoctypePublicKeyword);
+    current_token().public_identifier().emplace();
+    m_state = State::DoctypePublicIdentifierSingleQuoted;
+  } else if (c == '>') {
+    error(ParseErrorCode::MissingDoctypePublicIdentifier);
+    current_token().set_force_quirks(true);
+    m_state = State::Data;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingQuoteBeforeDoctypePublicIdentifier);
+    current_token().set_force_quirks(true);
+    m_current--;
+    m_state = State::BogusDoctype;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#before-doctype-public-identifier-state
 void Tokenizer::handle_before_doctype_public_identifier() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '"') {
+    current_token().public_identifier().emplace();
     m_state = State::DoctypePublicIdentifierDoubleQuoted;
   } else if (c == '\'') {
-    UNIMPLEMENTED();
+    current_token().public_identifier().emplace();
+    m_state = State::DoctypePublicIdentifierSingleQuoted;
   } else if (c == '>') {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingDoctypePublicIdentifier);
+    current_token().set_force_quirks(true);
+    m_state = State::Data;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingQuoteBeforeDoctypePublicIdentifier);
+    current_token().set_force_quirks(true);
+    m_current--;
+    m_state = State::BogusDoctype;
   }
 }
 
-// https://html.spec.whatwg.org/multipage/parsing.html#before-doctype-public-identifier-state
-void Tokenizer::handle_doctype_public_identifier_double_quoted() {
-  char c = consume();
-  if (c == '"') {
-    m_state = State::AfterDoctypePublicIdentifier;
-  } else {
-    // TODO: >Append the current input character to the current DOCTYPE token's
-    // public identifier.
-  }
+// https://html.spec.whatwg.org/multipage/parsing.html#doctype-public-identifier-(double-quoted)-state
+// https://html.spec.whatwg.org/multipage/parsing.html#doctype-public-identifier-(single-quoted)-state
+void Tokenizer::handle_doctype_public_identifier_quoted(char quote) {
+  handle_doctype_identifier_quoted(quote, *current_token().public_identifier(),
+                                   State::AfterDoctypePublicIdentifier,
+                                   ParseErrorCode::AbruptDoctypePublicIdentifier);
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#after-doctype-public-identifier-state
 void Tokenizer::handle_after_doctype_public_identifier() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     m_state = State::BetweenDoctypePublicAndSystemIdentifiers;
-  } else if (c == '"') {
-    UNIMPLEMENTED();
-  } else if (c == '\'') {
-    UNIMPLEMENTED();
   } else if (c == '>') {
     m_state = State::Data;
+  } else if (c == '"') {
+    error(ParseErrorCode::
+              MissingWhitespaceBetweenDoctypePublicAndSystemIdentifiers);
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierDoubleQuoted;
+  } else if (c == '\'') {
+    error(ParseErrorCode::
+              MissingWhitespaceBetweenDoctypePublicAndSystemIdentifiers);
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierSingleQuoted;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingQuoteBeforeDoctypeSystemIdentifier);
+    current_token().set_force_quirks(true);
+    m_current--;
+    m_state = State::BogusDoctype;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#between-doctype-public-and-system-identifiers-state
 void Tokenizer::handle_between_doctype_public_and_system_identifiers() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
+    // ignore
+  } else if (c == '>') {
+    m_state = State::Data;
+  } else if (c == '"') {
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierDoubleQuoted;
+  } else if (c == '\'') {
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierSingleQuoted;
+  } else {
+    error(ParseErrorCode::MissingQuoteBeforeDoctypeSystemIdentifier);
+    current_token().set_force_quirks(true);
+    m_current--;
+    m_state = State::BogusDoctype;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#after-doctype-system-keyword-state
+void Tokenizer::handle_after_doctype_system_keyword() {
+  char c = consume();
+  if (is_whitespace(c)) {
+    m_state = State::BeforeDoctypeSystemIdentifier;
+  } else if (c == '"') {
+    error(ParseErrorCode::MissingWhitespaceAfterDoctypeSystemKeyword);
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierDoubleQuoted;
+  } else if (c == '\'') {
+    error(ParseErrorCode::MissingWhitespaceAfterDoctypeSystemKeyword);
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierSingleQuoted;
+  } else if (c == '>') {
+    error(ParseErrorCode::MissingDoctypeSystemIdentifier);
+    current_token().set_force_quirks(true);
+    m_state = State::Data;
+  } else {
+    error(ParseErrorCode::MissingQuoteBeforeDoctypeSystemIdentifier);
+    current_token().set_force_quirks(true);
+    m_current--;
+    m_state = State::BogusDoctype;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#before-doctype-system-identifier-state
+void Tokenizer::handle_before_doctype_system_identifier() {
+  char c = consume();
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '"') {
+    current_token().system_identifier().emplace();
     m_state = State::DoctypeSystemIdentifierDoubleQuoted;
   } else if (c == '\'') {
-    UNIMPLEMENTED();
+    current_token().system_identifier().emplace();
+    m_state = State::DoctypeSystemIdentifierSingleQuoted;
   } else if (c == '>') {
+    error(ParseErrorCode::MissingDoctypeSystemIdentifier);
+    current_token().set_force_quirks(true);
     m_state = State::Data;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingQuoteBeforeDoctypeSystemIdentifier);
+    current_token().set_force_quirks(true);
+    m_current--;
+    m_state = State::BogusDoctype;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#doctype-system-identifier-(double-quoted)-state
-void Tokenizer::handle_doctype_system_identifier_double_quoted() {
+// https://html.spec.whatwg.org/multipage/parsing.html#doctype-system-identifier-(single-quoted)-state
+void Tokenizer::handle_doctype_system_identifier_quoted(char quote) {
+  handle_doctype_identifier_quoted(quote, *current_token().system_identifier(),
+                                   State::AfterDoctypeSystemIdentifier,
+                                   ParseErrorCode::AbruptDoctypeSystemIdentifier);
+}
+
+// the rest of the identifier up to the closing quote is taken in one go
+void Tokenizer::handle_doctype_identifier_quoted(char quote,
+                                                 std::string &identifier,
+                                                 State after,
+                                                 ParseErrorCode abrupt) {
   char c = consume();
-  if (c == '"') {
-    m_state = State::AfterDoctypeSystemIdentifier;
+  if (c == quote) {
+    m_state = after;
   } else if (c == '>') {
-    UNIMPLEMENTED();
+    error(abrupt);
+    current_token().set_force_quirks(true);
+    m_state = State::Data;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    identifier += replacement_character;
   } else {
-    // TODO: >Append the current input character to the current DOCTYPE
-    // token's system identifier.
+    size_t start = m_current - 1;
+    char stops[] = {quote, '>', '\0'};
+    size_t end = m_data.find_first_of(std::string_view(stops, 3), m_current);
+    if (end == std::string_view::npos) {
+      end = m_data.size();
+    }
+    m_current = end;
+    identifier += m_data.substr(start, end - start);
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#after-doctype-system-identifier-state
 void Tokenizer::handle_after_doctype_system_identifier() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '>') {
     m_state = State::Data;
   } else {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::UnexpectedCharacterAfterDoctypeSystemIdentifier);
+    m_current--;
+    m_state = State::BogusDoctype;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#bogus-doctype-state
+void Tokenizer::handle_bogus_doctype() {
+  char c = consume();
+  if (c == '>') {
+    m_state = State::Data;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#before-attribute-name-state
 void Tokenizer::handle_before_attribute_name() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '/' || c == '>') {
     m_current--;
     m_state = State::AfterAttributeName;
   } else if (c == '=') {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::UnexpectedEqualsSignBeforeAttributeName);
+    begin_attribute("=");
+    m_state = State::AttributeName;
   } else {
-    current_token().attributes().push_back(Token::Attribute{});
+    begin_attribute();
     m_current--;
     m_state = State::AttributeName;
   }
@@ -319,34 +1031,37 @@ void Tokenizer::handle_before_attribute_name() {
 // https://html.spec.whatwg.org/multipage/parsing.html#attribute-name-state
 void Tokenizer::handle_attribute_name() {
   char c = consume();
-  if (c == '\t' || c == '\n' || c == ' ' || c == '/' || c == '>') {
+  if (is_whitespace(c) || c == '/' || c == '>') {
     m_current--;
+    end_attribute_name();
     m_state = State::AfterAttributeName;
   } else if (c == '=') {
+    end_attribute_name();
     m_state = State::BeforeAttributeValue;
-  } else if (c == '>') {
-    m_state = State::Data;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_attribute().name += replacement_character;
   } else if (c == '"' || c == '\'' || c == '<') {
-    // TODO: This is an unexpected-character-in-attribute-name parse error.
-    current_token().attributes().back().name += c;
+    error(ParseErrorCode::UnexpectedCharacterInAttributeName);
+    current_attribute().name += c;
   } else {
-    current_token().attributes().back().name += c;
+    current_attribute().name += to_ascii_lower(c);
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#after-attribute-name-state
 void Tokenizer::handle_after_attribute_name() {
   char c = consume();
-  if (c == '\t' || c == '\n' || c == ' ') {
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '=') {
     m_state = State::BeforeAttributeValue;
   } else if (c == '/') {
     m_state = State::SelfClosingStartTag;
   } else if (c == '>') {
-    m_state = State::Data;
+    emit_tag();
   } else {
-    current_token().attributes().push_back(Token::Attribute{});
+    begin_attribute();
     m_current--;
     m_state = State::AttributeName;
   }
@@ -355,15 +1070,17 @@ void Tokenizer::handle_after_attribute_name() {
 // https://html.spec.whatwg.org/multipage/parsing.html#before-attribute-value-state
 void Tokenizer::handle_before_attribute_value() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     // ignore
   } else if (c == '"') {
     m_state = State::AttributeValueDoubleQuoted;
   } else if (c == '\'') {
     m_state = State::AttributeValueSingleQuoted;
   } else if (c == '>') {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::MissingAttributeValue);
+    emit_tag();
   } else {
+    m_current--;
     m_state = State::AttributeValueUnquoted;
   }
 }
@@ -373,8 +1090,13 @@ void Tokenizer::handle_attribute_value_double_quoted() {
   char c = consume();
   if (c == '"') {
     m_state = State::AfterAttributeValueQuoted;
+  } else if (c == '&') {
+    consume_character_reference(current_attribute().value, true);
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_attribute().value += replacement_character;
   } else {
-    current_token().attributes().back().value += c;
+    current_attribute().value += c;
   }
 }
 
@@ -383,50 +1105,47 @@ void Tokenizer::handle_attribute_value_single_quoted() {
   char c = consume();
   if (c == '\'') {
     m_state = State::AfterAttributeValueQuoted;
+  } else if (c == '&') {
+    consume_character_reference(current_attribute().value, true);
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_attribute().value += replacement_character;
   } else {
-    current_token().attributes().back().value += c;
+    current_attribute().value += c;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#attribute-value-(unquoted)-state
 void Tokenizer::handle_attribute_value_unquoted() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     m_state = State::BeforeAttributeName;
+  } else if (c == '&') {
+    consume_character_reference(current_attribute().value, true);
   } else if (c == '>') {
-    if (current_token().type() == TokenType::StartTag &&
-        current_token().data() == "script") {
-      m_state = State::ScriptData;
-    } else if (current_token().type() == TokenType::StartTag &&
-               current_token().data() == "style") {
-      m_state = State::StyleData;
-    } else {
-      m_state = State::Data;
-    }
+    emit_tag();
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_attribute().value += replacement_character;
+  } else if (c == '"' || c == '\'' || c == '<' || c == '=' || c == '`') {
+    error(ParseErrorCode::UnexpectedCharacterInUnquotedAttributeValue);
+    current_attribute().value += c;
   } else {
-    current_token().attributes().back().value += c;
+    current_attribute().value += c;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#after-attribute-value-(quoted)-state
 void Tokenizer::handle_after_attribute_value_quoted() {
   char c = consume();
-  if (c == ' ' || c == '\t' || c == '\n') {
+  if (is_whitespace(c)) {
     m_state = State::BeforeAttributeName;
   } else if (c == '/') {
     m_state = State::SelfClosingStartTag;
   } else if (c == '>') {
-    if (current_token().type() == TokenType::StartTag &&
-        current_token().data() == "script") {
-      m_state = State::ScriptData;
-    } else if (current_token().type() == TokenType::StartTag &&
-               current_token().data() == "style") {
-      m_state = State::StyleData;
-    } else {
-      m_state = State::Data;
-    }
+    emit_tag();
   } else {
-    // TODO: This is a missing-whitespace-between-attributes parse error.
+    error(ParseErrorCode::MissingWhitespaceBetweenAttributes);
     m_current--;
     m_state = State::BeforeAttributeName;
   }
@@ -438,7 +1157,8 @@ void Tokenizer::handle_comment_start() {
   if (c == '-') {
     m_state = State::CommentStartDash;
   } else if (c == '>') {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::AbruptClosingOfEmptyComment);
+    m_state = State::Data;
   } else {
     m_current--;
     m_state = State::Comment;
@@ -451,7 +1171,8 @@ void Tokenizer::handle_comment_start_dash() {
   if (c == '-') {
     m_state = State::CommentEnd;
   } else if (c == '>') {
-    UNIMPLEMENTED();
+    error(ParseErrorCode::AbruptClosingOfEmptyComment);
+    m_state = State::Data;
   } else {
     current_token().data() += "-";
     m_current--;
@@ -467,6 +1188,9 @@ void Tokenizer::handle_comment() {
     m_state = State::CommentLessThanSign;
   } else if (c == '-') {
     m_state = State::CommentEndDash;
+  } else if (c == '\0') {
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    current_token().data() += replacement_character;
   } else {
     current_token().data() += c;
   }
@@ -478,6 +1202,7 @@ void Tokenizer::handle_comment_less_than_sign() {
   if (c == '<') {
     current_token().data() += c;
   } else if (c == '!') {
+    current_token().data() += c;
     m_state = State::CommentLessThanSignBang;
   } else {
     m_current--;
@@ -503,20 +1228,18 @@ void Tokenizer::handle_comment_less_than_sign_bang_dash() {
     m_state = State::CommentLessThanSignBangDashDash;
   } else {
     m_current--;
-    m_state = State::Comment;
+    m_state = State::CommentEndDash;
   }
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#comment-less-than-sign-bang-dash-dash-state
 void Tokenizer::handle_comment_less_than_sign_bang_dash_dash() {
   char c = consume();
-  if (c == '>') {
-    m_state = State::CommentEnd;
-  } else {
-    // TODO: This is a nested-comment parse error.
-    m_current--;
-    m_state = State::CommentEnd;
+  if (c != '>') {
+    error(ParseErrorCode::NestedComment);
   }
+  m_current--;
+  m_state = State::CommentEnd;
 }
 
 // https://html.spec.whatwg.org/multipage/parsing.html#comment-end-dash-state
@@ -537,12 +1260,27 @@ void Tokenizer::handle_comment_end() {
   if (c == '>') {
     m_state = State::Data;
   } else if (c == '!') {
-    UNIMPLEMENTED();
+    m_state = State::CommentEndBang;
   } else if (c == '-') {
     current_token().data() += c;
   } else {
-    current_token().data() += "-";
-    current_token().data() += "-";
+    current_token().data() += "--";
+    m_current--;
+    m_state = State::Comment;
+  }
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#comment-end-bang-state
+void Tokenizer::handle_comment_end_bang() {
+  char c = consume();
+  if (c == '-') {
+    current_token().data() += "--!";
+    m_state = State::CommentEndDash;
+  } else if (c == '>') {
+    error(ParseErrorCode::IncorrectlyClosedComment);
+    m_state = State::Data;
+  } else {
+    current_token().data() += "--!";
     m_current--;
     m_state = State::Comment;
   }
@@ -553,35 +1291,247 @@ void Tokenizer::handle_self_closing_start_tag() {
   char c = consume();
   if (c == '>') {
     current_token().set_is_self_closing(true);
-    m_state = State::Data;
+    emit_tag();
   } else {
-    // TODO: This is an unexpected-solidus-in-tag parse error.
+    error(ParseErrorCode::UnexpectedSolidusInTag);
     m_current--;
     m_state = State::BeforeAttributeName;
   }
 }
 
-// not in the spec and very buggy but its the easiest way to do this. im sorry
-void Tokenizer::handle_script_data() {
-  if (peek(0) == '<' && peek(1) == '/' && std::toupper(peek(2)) == 'S' &&
-      std::toupper(peek(3)) == 'C' && std::toupper(peek(4)) == 'R' &&
-      std::toupper(peek(5)) == 'I' && std::toupper(peek(6)) == 'P' &&
-      std::toupper(peek(7)) == 'T' && peek(8) == '>') {
+// https://html.spec.whatwg.org/multipage/parsing.html#rcdata-state
+// https://html.spec.whatwg.org/multipage/parsing.html#rawtext-state
+// https://html.spec.whatwg.org/multipage/parsing.html#script-data-state
+// https://html.spec.whatwg.org/multipage/parsing.html#plaintext-state
+// the four only differ in whether references are decoded and whether an end
+// tag can end them. the end tag itself is tokenized in the data state.
+void Tokenizer::handle_raw_text() {
+  if (m_state == State::ScriptData &&
+      m_script_escape != ScriptEscape::None) {
+    handle_script_data_escaped();
+    return;
+  }
+  char c = peek(0);
+  if (c == '<' && m_state != State::Plaintext &&
+      next_chars_are_appropriate_end_tag()) {
     m_state = State::Data;
-  } else {
-    char c = consume();
-    m_tokens.emplace_back(TokenType::Character, std::string(1, c));
+    return;
+  }
+  // https://html.spec.whatwg.org/multipage/parsing.html#script-data-escape-start-state
+  if (c == '<' && m_state == State::ScriptData &&
+      next_chars_are("<!--", false)) {
+    emit_characters(m_base + m_current, "<!--");
+    m_current += 4;
+    m_script_escape = ScriptEscape::Escaped;
+    m_script_dashes = 2;
+    return;
+  }
+  if (c == '&' && m_state == State::Rcdata) {
+    size_t start = m_current;
+    consume();
+    std::string decoded;
+    consume_character_reference(decoded, false);
+    if (!m_need_input) {
+      emit_characters(m_base + start, decoded);
+    }
+    return;
   }
+  if (c == '\0') {
+    consume();
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    emit_characters(m_base + m_current - 1, replacement_character);
+    return;
+  }
+
+  // everything before the next character that might mean something else is
+  // text
+  std::string_view stops;
+  switch (m_state) {
+  case State::Rcdata:
+    stops = std::string_view("<&\0", 3);
+    break;
+  case State::Plaintext:
+    stops = std::string_view("\0", 1);
+    break;
+  default:
+    stops = std::string_view("<\0", 2);
+    break;
+  }
+  size_t start = m_current;
+  size_t end = m_data.find_first_of(stops, start + 1);
+  if (end == std::string_view::npos) {
+    end = m_data.size();
+  }
+  m_current = end;
+  emit_characters(m_base + start, m_data.substr(start, end - start));
 }
 
-void Tokenizer::handle_style_data() {
-  if (peek(0) == '<' && peek(1) == '/' && std::toupper(peek(2)) == 'S' &&
-      std::toupper(peek(3)) == 'T' && std::toupper(peek(4)) == 'Y' &&
-      std::toupper(peek(5)) == 'L' && std::toupper(peek(6)) == 'E' &&
-      peek(7) == '>') {
-    m_state = State::Data;
-  } else {
-    char c = consume();
-    m_tokens.emplace_back(TokenType::Character, std::string(1, c));
+// https://html.spec.whatwg.org/multipage/parsing.html#script-data-escaped-state
+// https://html.spec.whatwg.org/multipage/parsing.html#script-data-double-escaped-state
+// the dash, dash dash and less-than sign states of both are folded into
+// m_script_dashes and a look at what follows '<'. "-->" goes back to script
+// data, "<script" and "</script" go in and out of double escaping, and only
+// outside of that does the end tag end the script.
+void Tokenizer::handle_script_data_escaped() {
+  char c = peek(0);
+  if (c == '<') {
+    if (m_script_escape == ScriptEscape::Escaped &&
+        next_chars_are_appropriate_end_tag()) {
+      m_script_escape = ScriptEscape::None;
+      m_state = State::Data;
+      return;
+    }
+    // https://html.spec.whatwg.org/multipage/parsing.html#script-data-double-escape-start-state
+    // https://html.spec.whatwg.org/multipage/parsing.html#script-data-double-escape-end-state
+    bool escaped = m_script_escape == ScriptEscape::Escaped;
+    std::string_view name = escaped ? "<script" : "</script";
+    char after = peek(static_cast<long>(name.size()));
+    if (next_chars_are(name, true) &&
+        (is_whitespace(after) || after == '/' || after == '>')) {
+      m_script_escape =
+          escaped ? ScriptEscape::DoubleEscaped : ScriptEscape::Escaped;
+    }
+    // the name is read again as text
+    consume();
+    m_script_dashes = 0;
+    emit_characters(m_base + m_current - 1, "<");
+    return;
+  }
+  if (c == '\0') {
+    consume();
+    error(ParseErrorCode::UnexpectedNullCharacter);
+    m_script_dashes = 0;
+    emit_characters(m_base + m_current - 1, replacement_character);
+    return;
+  }
+  if (c == '-' || c == '>') {
+    consume();
+    if (c == '-') {
+      m_script_dashes = std::min(m_script_dashes + 1, 2);
+    } else {
+      if (m_script_dashes == 2) {
+        m_script_escape = ScriptEscape::None;
+      }
+      m_script_dashes = 0;
+    }
+    emit_characters(m_base + m_current - 1, std::string_view(&c, 1));
+    return;
   }
-}
\ No newline at end of file
+
+  size_t start = m_current;
+  size_t end =
+      m_data.find_first_of(std::string_view("<\0->", 4), start + 1);
+  if (end == std::string_view::npos) {
+    end = m_data.size();
+  }
+  m_current = end;
+  m_script_dashes = 0;
+  emit_characters(m_base + start, m_data.substr(start, end - start));
+}
+
+// https://html.spec.whatwg.org/multipage/parsing.html#appropriate-end-tag-token
+// "</" and the name of the last start tag, followed by something that ends a
+// tag name
+bool Tokenizer::next_chars_are_appropriate_end_tag() {
+  if (m_last_start_tag.empty() || peek(1) != '/') {
+    return false;
+  }
+  for (size_t i = 0; i < m_last_start_tag.size(); i++) {
+    if (to_ascii_lower(peek(static_cast<long>(i + 2))) != m_last_start_tag[i]) {
+      return false;
+    }
+  }
+  char after = peek(static_cast<long>(m_last_start_tag.size() + 2));
+  return is_whitespace(after) || after == '/' || after == '>';
+}
+
+// the EOF branch of every state. incomplete tags are dropped, incomplete
+// comments and doctypes are emitted as they are.
+void Tokenizer::handle_eof() {
+  switch (m_state) {
+  case State::Data:
+  case State::Rcdata:
+  case State::Rawtext:
+  case State::Plaintext:
+    break;
+  case State::ScriptData:
+    if (m_script_escape != ScriptEscape::None) {
+      error(ParseErrorCode::EofInScriptHtmlCommentLikeText);
+    }
+    break;
+  case State::CdataSection:
+    error(ParseErrorCode::EofInCdata);
+    break;
+  case State::TagOpen:
+    error(ParseErrorCode::EofBeforeTagName);
+    begin_token(TokenType::Character, m_token_start, "<");
+    end_token();
+    break;
+  case State::EndTagOpen:
+    error(ParseErrorCode::EofBeforeTagName);
+    begin_token(TokenType::Character, m_token_start, "</");
+    end_token();
+    break;
+  case State::TagName:
+  case State::BeforeAttributeName:
+  case State::AttributeName:
+  case State::AfterAttributeName:
+  case State::BeforeAttributeValue:
+  case State::AttributeValueDoubleQuoted:
+  case State::AttributeValueSingleQuoted:
+  case State::AttributeValueUnquoted:
+  case State::AfterAttributeValueQuoted:
+  case State::SelfClosingStartTag:
+    error(ParseErrorCode::EofInTag);
+    m_tokens.pop_back();
+    break;
+  case State::MarkupDeclarationOpen:
+    error(ParseErrorCode::IncorrectlyOpenedComment);
+    begin_token(TokenType::Comment, m_token_start);
+    end_token();
+    break;
+  case State::BogusComment:
+    end_token();
+    break;
+  case State::CommentStart:
+  case State::CommentStartDash:
+  case State::Comment:
+  case State::CommentLessThanSign:
+  case State::CommentLessThanSignBang:
+  case State::CommentLessThanSignBangDash:
+  case State::CommentLessThanSignBangDashDash:
+  case State::CommentEndDash:
+  case State::CommentEnd:
+  case State::CommentEndBang:
+    error(ParseErrorCode::EofInComment);
+    end_token();
+    break;
+  case State::Doctype:
+  case State::BeforeDoctypeName:
+    error(ParseErrorCode::EofInDoctype);
+    begin_token(TokenType::Doctype, m_token_start);
+    current_token().set_force_quirks(true);
+    end_token();
+    break;
+  case State::DoctypeName:
+  case State::AfterDoctypeName:
+  case State::AfterDoctypePublicKeyword:
+  case State::BeforeDoctypePublicIdentifier:
+  case State::DoctypePublicIdentifierDoubleQuoted:
+  case State::DoctypePublicIdentifierSingleQuoted:
+  case State::AfterDoctypePublicIdentifier:
+  case State::BetweenDoctypePublicAndSystemIdentifiers:
+  case State::AfterDoctypeSystemKeyword:
+  case State::BeforeDoctypeSystemIdentifier:
+  case State::DoctypeSystemIdentifierDoubleQuoted:
+  case State::DoctypeSystemIdentifierSingleQuoted:
+  case State::AfterDoctypeSystemIdentifier:
+    error(ParseErrorCode::EofInDoctype);
+    current_token().set_force_quirks(true);
+    end_token();
+    break;
+  case State::BogusDoctype:
+    end_token();
+    break;
+  }
+}
@@ -0,0 +1,297 @@
+#include "url.hh"
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// https://www.rfc-editor.org/rfc/rfc3986#section-3
+struct UrlParts {
+  std::string_view scheme;
+  std::string_view authority;
+  std::string_view path;
+  std::string_view query;
+  std::string_view fragment;
+  bool has_scheme = false;
+  bool has_authority = false;
+  bool has_query = false;
+  bool has_fragment = false;
+};
+
+bool is_ascii_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool is_scheme_char(char c) {
+  return is_ascii_alpha(c) || (c >= '0' && c <= '9') || c == '+' ||
+         c == '-' || c == '.';
+}
+
+char to_ascii_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// the scheme without its ':', empty if there is none
+std::string_view scheme_of(std::string_view url) {
+  if (url.empty() || !is_ascii_alpha(url[0])) {
+    return {};
+  }
+  size_t end = 1;
+  while (end < url.size() && is_scheme_char(url[end])) {
+    ++end;
+  }
+  if (end >= url.size() || url[end] != ':') {
+    return {};
+  }
+  return url.substr(0, end);
+}
+
+// schemes are case-insensitive, `lower` is lowercase already
+bool scheme_is(std::string_view scheme, std::string_view lower) {
+  return lower.size() == scheme.size() &&
+         std::equal(lower.begin(), lower.end(), scheme.begin(),
+                    [](char a, char b) { return a == to_ascii_lower(b); });
+}
+
+// https://url.spec.whatwg.org/#special-scheme
+bool is_special_scheme(std::string_view scheme) {
+  constexpr std::array<std::string_view, 6> special = {
+      "ftp", "file", "http", "https", "ws", "wss"};
+  return std::any_of(special.begin(), special.end(),
+                     [&](auto s) { return scheme_is(scheme, s); });
+}
+
+UrlParts split_url(std::string_view url) {
+  UrlParts parts;
+  parts.scheme = scheme_of(url);
+  if (!parts.scheme.empty()) {
+    parts.has_scheme = true;
+    url.remove_prefix(parts.scheme.size() + 1);
+  }
+  if (size_t hash = url.find('#'); hash != std::string_view::npos) {
+    parts.fragment = url.substr(hash + 1);
+    parts.has_fragment = true;
+    url = url.substr(0, hash);
+  }
+  if (size_t question = url.find('?'); question != std::string_view::npos) {
+    parts.query = url.substr(question + 1);
+    parts.has_query = true;
+    url = url.substr(0, question);
+  }
+  if (url.starts_with("//")) {
+    size_t slash = url.find('/', 2);
+    if (slash == std::string_view::npos) {
+      slash = url.size();
+    }
+    parts.authority = url.substr(2, slash - 2);
+    parts.has_authority = true;
+    url.remove_prefix(slash);
+  }
+  parts.path = url;
+  return parts;
+}
+
+void append_lowercase(std::string &out, std::string_view s) {
+  for (char c : s) {
+    out += to_ascii_lower(c);
+  }
+}
+
+// https://url.spec.whatwg.org/#default-port
+std::string_view default_port(std::string_view scheme) {
+  if (scheme_is(scheme, "http") || scheme_is(scheme, "ws")) {
+    return "80";
+  }
+  if (scheme_is(scheme, "https") || scheme_is(scheme, "wss")) {
+    return "443";
+  }
+  if (scheme_is(scheme, "ftp")) {
+    return "21";
+  }
+  return {};
+}
+
+// the host is case-insensitive, user info is not. a port is written without
+// leading zeros, and not at all if it is empty or the scheme's default.
+void append_authority(std::string &out, std::string_view authority,
+                      std::string_view scheme) {
+  out += "//";
+  size_t at = authority.rfind('@');
+  size_t host = at == std::string_view::npos ? 0 : at + 1;
+  out.append(authority.substr(0, host));
+  authority.remove_prefix(host);
+
+  // the colon of an IPv6 address is not the one before the port
+  size_t colon = authority.rfind(':');
+  if (colon == std::string_view::npos ||
+      authority.find(']', colon) != std::string_view::npos) {
+    append_lowercase(out, authority);
+    return;
+  }
+  std::string_view port = authority.substr(colon + 1);
+  if (!std::all_of(port.begin(), port.end(),
+                   [](char c) { return c >= '0' && c <= '9'; })) {
+    append_lowercase(out, authority);
+    return;
+  }
+  append_lowercase(out, authority.substr(0, colon));
+  while (port.size() > 1 && port.front() == '0') {
+    port.remove_prefix(1);
+  }
+  if (!port.empty() && port != default_port(scheme)) {
+    out += ':';
+    out.append(port);
+  }
+}
+
+// https://www.rfc-editor.org/rfc/rfc3986#section-5.2.4
+// in place on out[from..], which never gets longer
+void remove_dot_segments(std::string &out, size_t from) {
+  size_t read = from;
+  size_t write = from;
+  size_t end = out.size();
+  auto rest = [&] { return std::string_view(out).substr(read, end - read); };
+  auto pop_segment = [&] {
+    while (write > from && out[write - 1] != '/') {
+      --write;
+    }
+    if (write > from) {
+      --write;
+    }
+  };
+
+  while (read < end) {
+    std::string_view input = rest();
+    if (input.starts_with("../")) {
+      read += 3;
+    } else if (input.starts_with("./")) {
+      read += 2;
+    } else if (input.starts_with("/./")) {
+      read += 2;
+    } else if (input == "/.") {
+      read += 1;
+      out[read] = '/';
+    } else if (input.starts_with("/../")) {
+      read += 3;
+      pop_segment();
+    } else if (input == "/..") {
+      read += 2;
+      out[read] = '/';
+      pop_segment();
+    } else if (input == "." || input == "..") {
+      read = end;
+    } else {
+      do {
+        out[write++] = out[read++];
+      } while (read < end && out[read] != '/');
+    }
+  }
+  out.resize(write);
+}
+
+// https://url.spec.whatwg.org/#url-serializing
+// the path of a special URL is never empty, "http://a" is "http://a/"
+void append_path(std::string &out, std::string_view path, bool special) {
+  size_t from = out.size();
+  out.append(path);
+  remove_dot_segments(out, from);
+  if (special && out.size() == from) {
+    out += '/';
+  }
+}
+
+} // namespace
+
+void resolve_url(std::string_view base, std::string_view reference,
+                 std::string &out) {
+  // https://url.spec.whatwg.org/#concept-basic-url-parser
+  // leading and trailing C0 controls and spaces go, and so do tabs and
+  // newlines anywhere. what is left may be empty, which stands for the base
+  // without its fragment. the cleaned reference is staged at the end of `out`,
+  // followed by the result, which is then moved down over it.
+  while (!reference.empty() &&
+         static_cast<unsigned char>(reference.front()) <= ' ') {
+    reference.remove_prefix(1);
+  }
+  while (!reference.empty() &&
+         static_cast<unsigned char>(reference.back()) <= ' ') {
+    reference.remove_suffix(1);
+  }
+  size_t start = out.size();
+  // the result is no longer than the base and the reference together plus
+  // a few separators. reserved up front so that views into the staged
+  // reference stay valid.
+  out.reserve(start + 2 * reference.size() + base.size() + 8);
+  std::string_view scheme = scheme_of(reference);
+  bool special = is_special_scheme(scheme.empty() ? scheme_of(base) : scheme);
+  bool in_path = true;
+  for (char c : reference) {
+    if (c == '\t' || c == '\n' || c == '\r') {
+      continue;
+    }
+    if (c == '?' || c == '#') {
+      in_path = false;
+    }
+    out += special && in_path && c == '\\' ? '/' : c;
+  }
+  size_t result = out.size();
+
+  UrlParts r = split_url(std::string_view(out).substr(start));
+  UrlParts b = split_url(base);
+  // "http:foo" in an http page is relative, as in browsers
+  if (r.has_scheme && !r.has_authority && special && b.has_scheme &&
+      is_special_scheme(r.scheme) && r.scheme.size() == b.scheme.size() &&
+      std::equal(r.scheme.begin(), r.scheme.end(), b.scheme.begin(),
+                 [](char x, char y) {
+                   return to_ascii_lower(x) == to_ascii_lower(y);
+                 })) {
+    r.has_scheme = false;
+  }
+
+  UrlParts &origin = r.has_scheme ? r : b;
+  if (origin.has_scheme) {
+    append_lowercase(out, origin.scheme);
+    out += ':';
+  }
+  if (r.has_scheme || r.has_authority) {
+    if (r.has_authority) {
+      append_authority(out, r.authority, origin.scheme);
+    }
+    append_path(out, r.path, special);
+  } else {
+    if (b.has_authority) {
+      append_authority(out, b.authority, origin.scheme);
+    }
+    if (r.path.empty()) {
+      append_path(out, b.path, special);
+      if (!r.has_query && b.has_query) {
+        out += '?';
+        out.append(b.query);
+      }
+    } else if (r.path.front() == '/') {
+      append_path(out, r.path, special);
+    } else {
+      // https://www.rfc-editor.org/rfc/rfc3986#section-5.2.3
+      size_t from = out.size();
+      if (b.has_authority && b.path.empty()) {
+        out += '/';
+      } else {
+        size_t slash = b.path.rfind('/');
+        if (slash != std::string_view::npos) {
+          out.append(b.path.substr(0, slash + 1));
+        }
+      }
+      out.append(r.path);
+      remove_dot_segments(out, from);
+    }
+  }
+  if (r.has_query) {
+    out += '?';
+    out.append(r.query);
+  }
+  if (r.has_fragment) {
+    out += '#';
+    out.append(r.fragment);
+  }
+
+  out.erase(start, result - start);
+}
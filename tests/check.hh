@@ -0,0 +1,40 @@
+#pragma once
+
+// the tests are plain executables that meson runs. a failed check prints
+// where it was and makes the test fail through check_result(), the rest of
+// the checks still run.
+
+#include <chrono>
+#include <cstdio>
+
+inline int &check_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      check_failures()++;                                                      \
+    }                                                                          \
+  } while (false)
+
+// what main() returns
+inline int check_result() {
+  if (check_failures() == 0) {
+    std::printf("ok\n");
+    return 0;
+  }
+  std::printf("%d checks failed\n", check_failures());
+  return 1;
+}
+
+// how long `run` takes, in seconds
+template <typename F> double seconds(F &&run) {
+  auto start = std::chrono::steady_clock::now();
+  run();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
@@ -0,0 +1,263 @@
+// what ColumnarWriter writes has to read back into the documents it was given,
+// across any number of blocks
+
+#include "check.hh"
+
+#include <osmium-html/columnar.hh>
+#include <osmium-html/parser.hh>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> documents() {
+  std::vector<std::string> parts = {
+      "<div class=a id=b>", "</div>", "<p>", "text", " ", "&amp;", "<b>",
+      "</b>", "<a href='/x?y'>", "</a>", "<table><tr><td>", "<template>",
+      "<my-element data-x=1>", "</my-element>", "<svg viewBox='0 0 1 1'>",
+      "<br>", "<!-- c -->", "\xC3\xA9", "<input disabled>", "<ul><li>",
+  };
+  std::vector<std::string> out = {"", "x", "<html lang=en></html>"};
+  std::mt19937 random(1);
+  for (int i = 0; i < 200; i++) {
+    std::string document;
+    size_t length = random() % 30;
+    for (size_t j = 0; j < length; j++) {
+      document += parts[random() % parts.size()];
+    }
+    out.push_back(std::move(document));
+  }
+  return out;
+}
+
+// one line per node, attributes sorted as the DOM keeps them unordered
+std::string node_line(size_t depth, bool element, std::string_view name,
+                      std::vector<std::string> attributes) {
+  std::sort(attributes.begin(), attributes.end());
+  std::string line(depth, ' ');
+  line += element ? "<" : "\"";
+  line += name;
+  for (const auto &attribute : attributes) {
+    line += " " + attribute;
+  }
+  return line + "\n";
+}
+
+void describe(const Node &node, size_t depth, std::string &out) {
+  if (!node.is_element()) {
+    out += node_line(depth, false,
+                     static_cast<const TextNode &>(node).content(), {});
+    return;
+  }
+  const auto &element = static_cast<const Element &>(node);
+  std::vector<std::string> attributes;
+  for (const auto &[name, value] : element.attributes()) {
+    attributes.push_back(name + "=" + value);
+  }
+  out += node_line(depth, true, element.name(), std::move(attributes));
+  for (const auto &child : element.children()) {
+    describe(*child, depth + 1, out);
+  }
+}
+
+// reads the format documented in columnar.hh back into describe()'s form
+class Reader {
+public:
+  explicit Reader(std::string_view data) : m_data(data) {}
+
+  // false once the data is used up or doesn't make sense
+  bool read_block(std::vector<std::string> &documents) {
+    if (m_position == m_data.size() ||
+        m_data.substr(m_position, 8) != std::string_view("OSMCOL1\0", 8)) {
+      return false;
+    }
+    m_position += 8;
+    auto document_count = read<uint32_t>();
+    auto node_count = read<uint32_t>();
+    auto attribute_count = read<uint32_t>();
+    if (read<uint32_t>() != 0) {
+      return false;
+    }
+    auto text_bytes = read<uint64_t>();
+    auto name_bytes = read<uint64_t>();
+    auto value_bytes = read<uint64_t>();
+
+    auto document_nodes = column<uint32_t>(document_count + 1);
+    auto kind = column<uint8_t>(node_count);
+    auto tag = column<uint8_t>(node_count);
+    auto depth = column<uint32_t>(node_count);
+    auto parent = column<uint32_t>(node_count);
+    auto text_offsets = column<uint32_t>(node_count + 1);
+    auto attributes = column<uint32_t>(node_count + 1);
+    auto name_offsets = column<uint32_t>(attribute_count + 1);
+    auto value_offsets = column<uint32_t>(attribute_count + 1);
+    std::string_view text = heap(text_bytes);
+    std::string_view names = heap(name_bytes);
+    std::string_view values = heap(value_bytes);
+    bool ends_match = document_nodes.back() == node_count &&
+                      text_offsets.back() == text_bytes &&
+                      attributes.back() == attribute_count &&
+                      name_offsets.back() == name_bytes &&
+                      value_offsets.back() == value_bytes;
+    if (m_position > m_data.size() || !ends_match) {
+      return false;
+    }
+
+    for (uint32_t d = 0; d < document_count; d++) {
+      std::string out;
+      for (uint32_t i = document_nodes[d]; i < document_nodes[d + 1]; i++) {
+        bool root = i == document_nodes[d];
+        // parents come first, one level up
+        bool parent_ok =
+            root ? parent[i] == 0xFFFFFFFF && depth[i] == 0
+                 : parent[i] >= document_nodes[d] && parent[i] < i &&
+                       kind[parent[i]] == 0 && depth[parent[i]] + 1 == depth[i];
+        if (!parent_ok) {
+          return false;
+        }
+        std::string_view string = text.substr(
+            text_offsets[i], text_offsets[i + 1] - text_offsets[i]);
+        std::string_view name =
+            kind[i] == 1 || tag[i] == 0 ? string
+                                        : tag_name(static_cast<Tag>(tag[i]));
+        std::vector<std::string> node_attributes;
+        for (uint32_t a = attributes[i]; a < attributes[i + 1]; a++) {
+          node_attributes.push_back(
+              std::string(names.substr(name_offsets[a],
+                                       name_offsets[a + 1] - name_offsets[a])) +
+              "=" +
+              std::string(values.substr(
+                  value_offsets[a], value_offsets[a + 1] - value_offsets[a])));
+        }
+        out += node_line(depth[i], kind[i] == 0, name,
+                         std::move(node_attributes));
+      }
+      documents.push_back(std::move(out));
+    }
+    return true;
+  }
+
+  [[nodiscard]] bool at_end() const { return m_position == m_data.size(); }
+
+private:
+  std::string_view m_data;
+  size_t m_position = 0;
+
+  // the test only runs where the bytes are already little-endian
+  template <typename T> T read() {
+    T value = 0;
+    if (m_position + sizeof(T) <= m_data.size()) {
+      std::memcpy(&value, m_data.data() + m_position, sizeof(T));
+    }
+    m_position += sizeof(T);
+    return value;
+  }
+
+  template <typename T> std::vector<T> column(size_t count) {
+    std::vector<T> values(count);
+    for (auto &value : values) {
+      value = read<T>();
+    }
+    skip_padding();
+    return values;
+  }
+
+  std::string_view heap(size_t bytes) {
+    std::string_view out;
+    if (m_position + bytes <= m_data.size()) {
+      out = m_data.substr(m_position, bytes);
+    }
+    m_position += bytes;
+    skip_padding();
+    return out;
+  }
+
+  void skip_padding() {
+    while (m_position % 8 != 0) {
+      if (m_position < m_data.size() && m_data[m_position] != '\0') {
+        m_position = m_data.size() + 1;
+        return;
+      }
+      m_position++;
+    }
+  }
+};
+
+std::vector<std::string> read_back(const std::string &data) {
+  std::vector<std::string> out;
+  Reader reader(data);
+  size_t blocks = 0;
+  while (reader.read_block(out)) {
+    blocks++;
+  }
+  CHECK(reader.at_end());
+  CHECK(blocks > 0);
+  return out;
+}
+
+void test_round_trip() {
+  std::vector<std::string> expected;
+  std::vector<Document> parsed;
+  for (const auto &html : documents()) {
+    parsed.push_back(parse_document(html));
+    expected.emplace_back();
+    describe(*parsed.back().root(), 0, expected.back());
+  }
+
+  // every document in a block of its own, some blocks with several, and all
+  // of them in one
+  for (size_t block_nodes : {size_t{1}, size_t{100},
+                             ColumnarWriter::default_block_nodes}) {
+    std::ostringstream out;
+    ColumnarWriter writer(out, block_nodes);
+    for (const auto &document : parsed) {
+      writer.add(document);
+    }
+    CHECK(writer.flush());
+    CHECK(writer.buffered_nodes() == 0);
+    CHECK(read_back(out.str()) == expected);
+  }
+}
+
+// blocks can be appended to a file that already has some
+void test_append() {
+  auto first = parse_document("<p class=x>one</p>");
+  auto second = parse_document("<ul><li>two</ul>");
+  std::string a;
+  std::string b;
+  describe(*first.root(), 0, a);
+  describe(*second.root(), 0, b);
+
+  std::ostringstream out;
+  {
+    ColumnarWriter writer(out);
+    writer.add(first);
+    CHECK(writer.flush());
+    // nothing buffered writes nothing
+    CHECK(writer.flush());
+  }
+  ColumnarWriter writer(out);
+  writer.add(second);
+  writer.add(first);
+  CHECK(writer.flush());
+  CHECK(read_back(out.str()) == std::vector<std::string>({a, b, a}));
+}
+
+} // namespace
+
+int main() {
+  if constexpr (std::endian::native != std::endian::little) {
+    return 77;
+  }
+  test_round_trip();
+  test_append();
+  return check_result();
+}
@@ -0,0 +1,138 @@
+// the parse errors reported for small inputs, and the tokens the tokenizer
+// recovers with
+
+#include "check.hh"
+
+#include <osmium-html/frozen_document.hh>
+#include <osmium-html/parser.hh>
+#include <osmium-html/tokenizer.hh>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::vector<std::string_view> errors(std::string_view html) {
+  ErrorList list;
+  ParseOptions options;
+  options.error_sink = &list;
+  (void)parse_document(std::string(html), options);
+  std::vector<std::string_view> codes;
+  for (const auto &error : list.errors()) {
+    codes.push_back(to_string(error.code));
+  }
+  return codes;
+}
+
+bool reports(std::string_view html, std::string_view code) {
+  auto codes = errors(html);
+  return std::find(codes.begin(), codes.end(), code) != codes.end();
+}
+
+void test_duplicate_attribute() {
+  CHECK(reports("<!DOCTYPE html><p a=1 b=2 a=3>", "duplicate-attribute"));
+  CHECK(!reports("<!DOCTYPE html><p a=1 b=2 c=3>", "duplicate-attribute"));
+
+  // the first one wins, the value of the second goes with it
+  auto tokens = Tokenizer("<p a=1 b=2 A=3 b>").parse();
+  CHECK(tokens[0].attributes().size() == 2);
+  CHECK(tokens[0].attributes()[0].name == "a");
+  CHECK(tokens[0].attributes()[0].value == "1");
+  CHECK(tokens[0].attributes()[1].value == "2");
+
+  // past the point where names go into a set
+  std::string many = "<p";
+  for (int i = 0; i < 100; i++) {
+    many += " a" + std::to_string(i) + "=" + std::to_string(i);
+  }
+  many += " a50=x a99=y a0=z a100=new>";
+  tokens = Tokenizer(many).parse();
+  CHECK(tokens[0].attributes().size() == 101);
+  CHECK(tokens[0].attributes()[50].value == "50");
+  CHECK(tokens[0].attributes()[100].name == "a100");
+
+  // and the tree gets the first as well
+  auto frozen = freeze(parse_document("<div id=first id=second></div>"));
+  for (FrozenDocument::NodeId id = 0; id < frozen.size(); id++) {
+    if (frozen.tag(id) == Tag::Div) {
+      CHECK(frozen.attribute(id, "id") == "first");
+      CHECK(frozen.attributes(id).size() == 1);
+    }
+  }
+}
+
+void test_end_tags() {
+  CHECK(reports("<!DOCTYPE html><p></p a=1>", "end-tag-with-attributes"));
+  CHECK(reports("<!DOCTYPE html><p></p/>", "end-tag-with-trailing-solidus"));
+  CHECK(errors("<!DOCTYPE html><p></p>").empty());
+}
+
+void test_trailing_solidus() {
+  constexpr std::string_view code =
+      "non-void-html-element-start-tag-with-trailing-solidus";
+  CHECK(reports("<!DOCTYPE html><div/>", code));
+  CHECK(reports("<!DOCTYPE html><title/>x</title>", code));
+  // void elements and foreign elements acknowledge it
+  CHECK(errors("<!DOCTYPE html><br/><img/><input/><meta/>").empty());
+  CHECK(errors("<!DOCTYPE html><svg><path/><circle/></svg>").empty());
+  CHECK(errors("<!DOCTYPE html><math/>").empty());
+}
+
+std::string script_text(std::string_view html) {
+  std::string text;
+  for (const auto &token : Tokenizer(html).parse()) {
+    if (token.type() == TokenType::Character) {
+      text += token.data();
+    }
+  }
+  return text;
+}
+
+void test_script_escapes() {
+  constexpr std::string_view code = "eof-in-script-html-comment-like-text";
+  CHECK(reports("<!DOCTYPE html><script><!-- x", code));
+  CHECK(reports("<!DOCTYPE html><script><!--<script>x</script>", code));
+  CHECK(!reports("<!DOCTYPE html><script><!-- x -->", code));
+  CHECK(!reports("<!DOCTYPE html><script>x", code));
+
+  // "<!--" alone doesn't hide the end tag, "<script>" within it does until
+  // its own end tag
+  CHECK(script_text("<script><!--x</script>y") == "<!--xy");
+  CHECK(script_text("<script><!--<script>x</script>y</script>z") ==
+        "<!--<script>x</script>yz");
+  CHECK(script_text("<script><!--<script>x--></script>y") ==
+        "<!--<script>x-->y");
+  CHECK(script_text("<script><!--<SCRIPT/>x</script >y</script>z") ==
+        "<!--<SCRIPT/>x</script >yz");
+  // "<scripts" is another tag name
+  CHECK(script_text("<script><!--<scripts>x</script>y") ==
+        "<!--<scripts>xy");
+}
+
+void test_offsets() {
+  ErrorList list;
+  ParseOptions options;
+  options.error_sink = &list;
+  options.track_positions = true;
+  (void)parse_document("<!DOCTYPE html><p a a><div/>", options);
+  CHECK(list.errors().size() == 2);
+  if (list.errors().size() == 2) {
+    // at the end of the second name, and at the start of the tag the tree
+    // builder didn't acknowledge
+    CHECK(list.errors()[0].offset == 20);
+    CHECK(list.errors()[1].offset == 22);
+  }
+}
+
+} // namespace
+
+int main() {
+  test_duplicate_attribute();
+  test_end_tags();
+  test_trailing_solidus();
+  test_script_escapes();
+  test_offsets();
+  return check_result();
+}
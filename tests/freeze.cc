@@ -0,0 +1,51 @@
+// a frozen document has the same tree as the one it was made from, and only
+// keeps the source when there are positions to look up in it
+
+#include "check.hh"
+
+#include <osmium-html/frozen_document.hh>
+#include <osmium-html/parser.hh>
+
+#include <string>
+
+namespace {
+
+const std::string page =
+    "<!DOCTYPE html>\n<ul>\n  <li id=a>one\n  <li>two\n</ul>";
+
+FrozenDocument::NodeId find(const FrozenDocument &frozen, Tag tag) {
+  for (FrozenDocument::NodeId id = 0; id < frozen.size(); id++) {
+    if (frozen.is_element(id) && frozen.tag(id) == tag) {
+      return id;
+    }
+  }
+  return FrozenDocument::no_node;
+}
+
+void test_without_positions() {
+  auto frozen = freeze(parse_document(page));
+  CHECK(frozen.source().empty());
+  auto li = find(frozen, Tag::Li);
+  CHECK(li != FrozenDocument::no_node);
+  CHECK(frozen.attribute(li, "id") == "a");
+  CHECK(frozen.text(frozen.first_child(li)) == "one\n  ");
+  CHECK(frozen.position(li).line == 0);
+}
+
+void test_with_positions() {
+  ParseOptions options;
+  options.track_positions = true;
+  auto frozen = freeze(parse_document(page, options));
+  CHECK(frozen.source() == page);
+  auto li = find(frozen, Tag::Li);
+  CHECK(frozen.position(li).line == 3);
+  CHECK(frozen.position(li).column == 3);
+}
+
+} // namespace
+
+int main() {
+  test_without_positions();
+  test_with_positions();
+  return check_result();
+}
@@ -0,0 +1,245 @@
+// documents cut short by the limits in ParseLimits, and the work spent on
+// what is cut off
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/stream.hh>
+#include <osmium-html/tokenizer.hh>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// every allocation of the test is counted, to hold the estimate of
+// Document::estimate_memory_usage() against
+namespace {
+
+size_t live_bytes = 0;
+
+// room in front of each allocation to remember its size, aligned for anything
+constexpr size_t header_size = alignof(std::max_align_t);
+
+} // namespace
+
+void *operator new(size_t size) {
+  auto *block = static_cast<char *>(std::malloc(header_size + size));
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  *reinterpret_cast<size_t *>(block) = size;
+  live_bytes += size;
+  return block + header_size;
+}
+
+void operator delete(void *pointer) noexcept {
+  if (pointer == nullptr) {
+    return;
+  }
+  char *block = static_cast<char *>(pointer) - header_size;
+  live_bytes -= *reinterpret_cast<size_t *>(block);
+  std::free(block);
+}
+
+void operator delete(void *pointer, size_t /*size*/) noexcept {
+  operator delete(pointer);
+}
+
+namespace {
+
+std::string repeat(std::string_view s, size_t n) {
+  std::string out;
+  out.reserve(s.size() * n);
+  for (size_t i = 0; i < n; i++) {
+    out += s;
+  }
+  return out;
+}
+
+struct TreeSize {
+  size_t nodes = 0;
+  size_t depth = 0;
+};
+
+// iterative, some of the trees are deep
+TreeSize tree_size(const NodePtr &root) {
+  TreeSize size;
+  std::vector<std::pair<const Node *, size_t>> stack = {{root.get(), 0}};
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    size.depth = std::max(size.depth, depth);
+    if (node->is_element()) {
+      for (const auto &child : static_cast<const Element *>(node)->children()) {
+        size.nodes++;
+        stack.emplace_back(child.get(), depth + 1);
+      }
+    }
+  }
+  return size;
+}
+
+void test_max_depth() {
+  ParseOptions options;
+  options.limits.max_depth = 10;
+  auto document = parse_document(repeat("<div>", 1000), options);
+  CHECK(document.limits_exceeded().depth);
+  // the limit counts html and body as well, then come the elements attached
+  // to the deepest open one
+  CHECK(tree_size(document.root()).depth == 10 + 1);
+  // nothing is dropped
+  CHECK(tree_size(document.root()).nodes == 3 + 1000);
+
+  options.limits.max_depth = 0;
+  document = parse_document(repeat("<div>", 1000), options);
+  CHECK(!document.limits_exceeded().depth);
+  CHECK(tree_size(document.root()).depth == 2 + 1000);
+}
+
+void test_max_nodes() {
+  ParseOptions options;
+  options.limits.max_nodes = 100;
+  auto document = parse_document(repeat("<p>x</p>", 1000), options);
+  CHECK(document.limits_exceeded().nodes);
+  CHECK(tree_size(document.root()).nodes <= 100);
+
+  options.limits.max_nodes = 10000;
+  document = parse_document(repeat("<p>x</p>", 1000), options);
+  CHECK(!document.limits_exceeded().nodes);
+  // html, head, body and two nodes per paragraph
+  CHECK(tree_size(document.root()).nodes == 3 + 2000);
+}
+
+void test_max_input_size() {
+  ParseOptions options;
+  options.limits.max_input_size = 51;
+  // a cut in the middle of a character moves back to its start
+  std::string input = repeat("\xC3\xA9", 100);
+  auto document = parse_document(input, options);
+  CHECK(document.limits_exceeded().input_size);
+  CHECK(document.source() == repeat("\xC3\xA9", 25));
+
+  // windows-1252 gets longer as UTF-8, and is cut again after decoding
+  options.encoding = Encoding::Windows1252;
+  document = parse_document(repeat("\xE9", 100), options);
+  CHECK(document.limits_exceeded().input_size);
+  CHECK(document.source() == repeat("\xC3\xA9", 25));
+
+  options.encoding = Encoding::Utf8;
+  options.track_positions = true;
+  StreamParser parser(options);
+  for (size_t i = 0; i < input.size(); i += 7) {
+    parser.feed(std::string_view(input).substr(i, 7));
+  }
+  auto streamed = parser.finish();
+  CHECK(streamed.limits_exceeded().input_size);
+  CHECK(streamed.source().size() <= 51);
+
+  options.limits.max_input_size = 0;
+  document = parse_document(input, options);
+  CHECK(!document.limits_exceeded().input_size);
+  CHECK(document.source() == input);
+}
+
+// what the document allocates grows with the records, and the estimate
+// follows it
+void test_memory_growth() {
+  std::vector<size_t> estimated;
+  std::vector<size_t> allocated;
+  for (size_t count : {1000, 2000, 4000}) {
+    std::string page = "<!DOCTYPE html><ul>";
+    for (size_t i = 0; i < count; i++) {
+      page += "<li class=item id=i" + std::to_string(i) + ">item " +
+              std::to_string(i) + "</li>";
+    }
+    size_t before = live_bytes;
+    auto document = parse_document(page, {});
+    allocated.push_back(live_bytes - before);
+    estimated.push_back(document.estimate_memory_usage().total());
+  }
+
+  for (size_t i = 0; i < estimated.size(); i++) {
+    // the estimate misses what the allocator and the tokenizer keep
+    // around, but not by much
+    CHECK(estimated[i] <= allocated[i] * 11 / 10);
+    CHECK(estimated[i] >= allocated[i] * 9 / 10);
+  }
+  // twice the records, twice the memory
+  for (size_t i = 1; i < estimated.size(); i++) {
+    CHECK(allocated[i] >= allocated[i - 1] * 19 / 10);
+    CHECK(allocated[i] <= allocated[i - 1] * 21 / 10);
+  }
+}
+
+// stops after a fixed number of tokens
+class StoppingSink : public TokenSink {
+public:
+  explicit StoppingSink(size_t max_tokens) : m_max_tokens(max_tokens) {}
+
+  void emit(Token & /*token*/) override { m_count++; }
+  [[nodiscard]] bool stopped() const override {
+    return m_count >= m_max_tokens;
+  }
+
+  [[nodiscard]] size_t count() const { return m_count; }
+
+private:
+  size_t m_max_tokens;
+  size_t m_count = 0;
+};
+
+void test_sink_stops_tokenizer() {
+  std::string input = repeat("<p>x</p>", 1000);
+
+  StoppingSink sink(10);
+  Tokenizer(input).run(sink);
+  // the end of file isn't held back by the stop
+  CHECK(sink.count() <= 11);
+
+  StoppingSink fed_sink(10);
+  Tokenizer tokenizer(fed_sink);
+  for (size_t i = 0; i < input.size(); i += 64) {
+    tokenizer.feed(std::string_view(input).substr(i, 64));
+  }
+  tokenizer.finish();
+  CHECK(fed_sink.count() <= 11);
+}
+
+// the rest of the input isn't scanned once max_nodes is hit
+void test_max_nodes_bounds_work() {
+  ParseOptions options;
+  options.limits.max_nodes = 10;
+  std::string input = repeat("<p>x</p>", 4000000);
+
+  double one_shot = seconds([&] {
+    CHECK(parse_document(input, options).limits_exceeded().nodes);
+  });
+
+  double fed = seconds([&] {
+    StreamParser parser(options);
+    for (size_t i = 0; i < input.size(); i += 4096) {
+      parser.feed(std::string_view(input).substr(i, 4096));
+    }
+    CHECK(parser.finish().limits_exceeded().nodes);
+  });
+
+  // 32 MB take well over a second to tokenize in a debug build
+  CHECK(one_shot < 0.2);
+  CHECK(fed < 0.2);
+}
+
+} // namespace
+
+int main() {
+  test_max_depth();
+  test_max_nodes();
+  test_max_input_size();
+  test_memory_growth();
+  test_sink_stops_tokenizer();
+  test_max_nodes_bounds_work();
+  return check_result();
+}
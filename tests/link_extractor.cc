@@ -0,0 +1,68 @@
+// LinkExtractor has to come up with the links a walk of the parsed document
+// would, each one once
+
+#include "check.hh"
+
+#include <osmium-html/link_extractor.hh>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> urls(LinkExtractor &extractor, std::string_view html,
+                              std::string_view document_url) {
+  std::vector<std::string> out;
+  for (const auto &link : extractor.extract(html, document_url)) {
+    out.emplace_back(link.url);
+  }
+  return out;
+}
+
+void test_empty_href_links_to_the_base() {
+  LinkExtractor extractor;
+  CHECK(urls(extractor, "<a href=\"\">x</a>", "https://example.com/a#b") ==
+        std::vector<std::string>{"https://example.com/a"});
+  CHECK(urls(extractor, "<base href=\"/dir/\"><a href=\"\">x</a>",
+             "https://example.com/a") ==
+        std::vector<std::string>{"https://example.com/dir/"});
+  CHECK(urls(extractor, "<a href=\" \">x</a><img src=\"\">",
+             "https://example.com/a") ==
+        std::vector<std::string>{"https://example.com/a"});
+  // an empty base href is the document's own URL
+  CHECK(urls(extractor, "<base href=\"\"><a href=\"x\">x</a>",
+             "https://example.com/a/b") ==
+        std::vector<std::string>{"https://example.com/a/x"});
+}
+
+void test_same_url_written_differently() {
+  LinkExtractor extractor;
+  auto links = extractor.extract("<a href=\"https://Example.com\">a</a>"
+                                 "<a href=\"https://example.com/\">b</a>"
+                                 "<img src=\"https://example.com:443/#top\">"
+                                 "<a href=\"HTTPS://EXAMPLE.COM:443\">d</a>",
+                                 "http://other.org/");
+  CHECK(links.size() == 1);
+  CHECK(links.size() == 1 && links[0].url == "https://example.com/" &&
+        links[0].tag == Tag::A);
+}
+
+void test_base_url() {
+  LinkExtractor extractor;
+  (void)extractor.extract("<p>x", "https://Example.com");
+  CHECK(extractor.base_url() == "https://example.com/");
+  // only the first base counts, even after the links
+  (void)extractor.extract("<a href=x></a><base href=/one/><base href=/two/>",
+                          "https://example.com/");
+  CHECK(extractor.base_url() == "https://example.com/one/");
+}
+
+} // namespace
+
+int main() {
+  test_empty_href_links_to_the_base();
+  test_same_url_written_differently();
+  test_base_url();
+  return check_result();
+}
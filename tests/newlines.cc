@@ -0,0 +1,86 @@
+// CR LF and CR are read as LF, however the input is cut up
+
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/source.hh>
+#include <osmium-html/stream.hh>
+#include <osmium-html/text_extractor.hh>
+#include <osmium-html/tokenizer.hh>
+
+#include <string>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view crlf =
+    "<!DOCTYPE html>\r\n<pre>\r\na\r\rb\n\r</pre>\r"
+    "<p title=\"x\ry\r\nz\">c\r\n<textarea>\r\nt</textarea><!--\r-->\r";
+constexpr std::string_view lf =
+    "<!DOCTYPE html>\n<pre>\na\n\nb\n\n</pre>\n"
+    "<p title=\"x\ny\nz\">c\n<textarea>\nt</textarea><!--\n-->\n";
+
+void test_normalize() {
+  std::string text(crlf);
+  normalize_newlines(text);
+  CHECK(text == lf);
+
+  for (size_t chunk_size = 1; chunk_size <= 4; chunk_size++) {
+    std::string out;
+    bool pending_cr = false;
+    for (size_t i = 0; i < crlf.size(); i += chunk_size) {
+      append_normalized_newlines(out, crlf.substr(i, chunk_size), pending_cr);
+    }
+    CHECK(out == lf);
+  }
+
+  std::string out;
+  bool pending_cr = false;
+  for (std::string_view chunk : {"a\r", "", "\nb\r", "\r", "c"}) {
+    append_normalized_newlines(out, chunk, pending_cr);
+  }
+  CHECK(out == "a\nb\n\nc");
+}
+
+void test_parse() {
+  ParseOptions options;
+  options.track_positions = true;
+  auto expected = parse_document(std::string(lf), options);
+  auto document = parse_document(std::string(crlf), options);
+  CHECK(document.source() == lf);
+  CHECK(document.root()->dump(0) == expected.root()->dump(0));
+
+  // split between a CR and its LF, too
+  for (size_t chunk_size : {1, 2, 5}) {
+    StreamParser parser(options);
+    for (size_t i = 0; i < crlf.size(); i += chunk_size) {
+      parser.feed(crlf.substr(i, chunk_size));
+    }
+    auto streamed = parser.finish();
+    CHECK(streamed.source() == lf);
+    CHECK(streamed.root()->dump(0) == expected.root()->dump(0));
+  }
+}
+
+void test_tokenizer() {
+  auto expected = Tokenizer(lf).parse();
+  auto tokens = Tokenizer(crlf).parse();
+  CHECK(tokens.size() == expected.size());
+  for (size_t i = 0; i < tokens.size() && i < expected.size(); i++) {
+    CHECK(tokens[i].dump() == expected[i].dump());
+  }
+
+  TextExtractor extractor;
+  std::string text(extractor.extract(crlf));
+  CHECK(text.find('\r') == std::string::npos);
+  CHECK(text == std::string(TextExtractor().extract(lf)));
+}
+
+} // namespace
+
+int main() {
+  test_normalize();
+  test_parse();
+  test_tokenizer();
+  return check_result();
+}
@@ -0,0 +1,96 @@
+// inputs that are cheap to write and expensive to parse naively: every case
+// has to stay within the depth limit and parse in roughly linear time
+
+#include <osmium-html/parser.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Case {
+  const char *name;
+  std::string input;
+};
+
+std::string repeat(std::string_view s, size_t n) {
+  std::string out;
+  out.reserve(s.size() * n);
+  for (size_t i = 0; i < n; i++) {
+    out += s;
+  }
+  return out;
+}
+
+// iterative, the trees that fail this test are the ones too deep to recurse
+size_t tree_depth(const NodePtr &root) {
+  size_t max_depth = 0;
+  std::vector<std::pair<const Node *, size_t>> stack = {{root.get(), 1}};
+  while (!stack.empty()) {
+    auto [node, depth] = stack.back();
+    stack.pop_back();
+    max_depth = std::max(max_depth, depth);
+    if (node->is_element()) {
+      for (const auto &child : static_cast<const Element *>(node)->children()) {
+        stack.emplace_back(child.get(), depth + 1);
+      }
+    }
+  }
+  return max_depth;
+}
+
+std::vector<Case> corpus() {
+  constexpr size_t n = 100000;
+  return {
+      {"deep nesting", repeat("<div>", n)},
+      {"deep nesting with text", repeat("<span>x", n)},
+      {"deep formatting", repeat("<b>", n)},
+      {"deep anchors", repeat("<a>x", n)},
+      {"stray end tags", repeat("</div></p></b></table></td>x", n)},
+      {"stray end tags in a table", "<table>" + repeat("</p></b></div>", n)},
+      {"misnested formatting", repeat("<b><i><u><s>x</b>", n)},
+      {"misnested formatting across blocks", repeat("<b><p>x</b>y</p>", n)},
+      {"unclosed formatting before blocks", repeat("<i><div>", n)},
+      {"nested tables", repeat("<table><tr><td>", n)},
+      {"nested captions", repeat("<table><caption>", n)},
+      {"foster-parented blocks", "<table>" + repeat("<div>x", n)},
+      {"foster-parented text", repeat("<table><tr>x", n)},
+      {"foster-parented formatting", repeat("<table><b>x", n)},
+      {"nested templates", repeat("<template><b>", n)},
+      {"templates in tables", repeat("<table><template><tr>", n)},
+      {"nested selects", repeat("<select><option>", n)},
+      {"nested svg", repeat("<svg><foreignObject>", n)},
+  };
+}
+
+} // namespace
+
+int main() {
+  // generous for a debug build, a quadratic case takes minutes
+  constexpr double max_seconds = 5.0;
+
+  ParseOptions options;
+  // the root, html and body, then the limit, then one more for elements
+  // attached to the deepest open element
+  size_t max_tree_depth = options.limits.max_depth + 4;
+
+  int failures = 0;
+  for (auto &c : corpus()) {
+    auto start = std::chrono::steady_clock::now();
+    auto document = parse_document(std::move(c.input), options);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    size_t depth = tree_depth(document.root());
+    bool ok = depth <= max_tree_depth && elapsed.count() <= max_seconds;
+    std::printf("%s %-36s depth %6zu  %.3f s\n", ok ? "ok  " : "FAIL", c.name,
+                depth, elapsed.count());
+    if (!ok) {
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+// source ranges of nodes and the line and column they map to, across CR LF
+// and multibyte input
+
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/source.hh>
+#include <osmium-html/stream.hh>
+
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// every node in document order
+std::vector<const Node *> nodes(const Document &document) {
+  std::vector<const Node *> out;
+  std::vector<const Node *> stack = {document.root().get()};
+  while (!stack.empty()) {
+    const auto *node = stack.back();
+    stack.pop_back();
+    out.push_back(node);
+    if (node->is_element()) {
+      const auto &children = static_cast<const Element *>(node)->children();
+      for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        stack.push_back(it->get());
+      }
+    }
+  }
+  return out;
+}
+
+const Node *find(const Document &document, std::string_view name) {
+  for (const auto *node : nodes(document)) {
+    if (node->is_element() &&
+        static_cast<const Element *>(node)->name() == name) {
+      return node;
+    }
+  }
+  return nullptr;
+}
+
+std::string_view text_of(const Document &document, const Node &node) {
+  auto range = node.source_range();
+  return std::string_view(document.source()).substr(range.offset, range.length);
+}
+
+bool at(SourcePosition position, uint32_t line, uint32_t column) {
+  return position.line == line && position.column == column;
+}
+
+void test_line_table() {
+  LineTable table("a\nbc\n\nd");
+  CHECK(table.line_count() == 4);
+  CHECK(at(table.position(0), 1, 1));
+  CHECK(at(table.position(1), 1, 2));
+  CHECK(at(table.position(2), 2, 1));
+  CHECK(at(table.position(3), 2, 2));
+  CHECK(at(table.position(5), 3, 1));
+  CHECK(at(table.position(6), 4, 1));
+  // one past the end is where the next character would go
+  CHECK(at(table.position(7), 4, 2));
+
+  // long enough for the 16 byte steps and the tail after them, against a
+  // count of every character
+  std::mt19937 random(1);
+  for (size_t size : {15, 16, 17, 100, 1000}) {
+    std::string source;
+    for (size_t i = 0; i < size; i++) {
+      source += random() % 4 == 0 ? '\n' : 'x';
+    }
+    LineTable lines(source);
+    uint32_t line = 1;
+    uint32_t column = 1;
+    for (size_t i = 0; i < size; i++) {
+      CHECK(at(lines.position(static_cast<uint32_t>(i)), line, column));
+      if (source[i] == '\n') {
+        line++;
+        column = 1;
+      } else {
+        column++;
+      }
+    }
+  }
+}
+
+constexpr std::string_view page = "<!DOCTYPE html>\r\n"
+                                  "<p class=x>h\xC3\xA9\r\n"
+                                  "<b>x</b>\r"
+                                  "<i>\xE2\x82\xAC<u>y</u></i></p>";
+
+void check_page(const Document &document) {
+  const auto *p = find(document, "p");
+  const auto *b = find(document, "b");
+  const auto *i = find(document, "i");
+  const auto *u = find(document, "u");
+  CHECK(p != nullptr && b != nullptr && i != nullptr && u != nullptr);
+  if (p == nullptr || b == nullptr || i == nullptr || u == nullptr) {
+    return;
+  }
+
+  // an element runs from its start tag to the end of its end tag
+  CHECK(text_of(document, *b) == "<b>x</b>");
+  CHECK(text_of(document, *u) == "<u>y</u>");
+  CHECK(text_of(document, *p).starts_with("<p class=x>"));
+  CHECK(text_of(document, *p).ends_with("</p>"));
+  // the text node holds the normalized newline
+  const auto *text = static_cast<const Element *>(p)->children()[0].get();
+  CHECK(text_of(document, *text) == "h\xC3\xA9\n");
+
+  // CR LF and CR are one line break each, columns count bytes
+  CHECK(at(document.position(*p), 2, 1));
+  CHECK(at(document.position(*text), 2, 12));
+  CHECK(at(document.position(*b), 3, 1));
+  CHECK(at(document.position(*i), 4, 1));
+  CHECK(at(document.position(*u), 4, 7));
+  CHECK(at(document.position(u->source_range().offset + 3), 4, 10));
+}
+
+void test_node_ranges() {
+  ParseOptions options;
+  options.track_positions = true;
+  auto document = parse_document(std::string(page), options);
+  check_page(document);
+
+  // the root stands for the document and has no range
+  CHECK(!document.root()->source_range().is_valid());
+  CHECK(at(document.position(*document.root()), 0, 0));
+
+  // fed in chunks, every range comes out the same
+  for (size_t chunk_size : {1, 2, 7}) {
+    StreamParser parser(options);
+    for (size_t i = 0; i < page.size(); i += chunk_size) {
+      parser.feed(page.substr(i, chunk_size));
+    }
+    auto streamed = parser.finish();
+    check_page(streamed);
+    auto expected = nodes(document);
+    auto actual = nodes(streamed);
+    CHECK(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size() && i < expected.size(); i++) {
+      CHECK(actual[i]->source_range().offset ==
+            expected[i]->source_range().offset);
+      CHECK(actual[i]->source_range().length ==
+            expected[i]->source_range().length);
+    }
+  }
+}
+
+void test_without_positions() {
+  auto document = parse_document(std::string(page));
+  for (const auto *node : nodes(document)) {
+    CHECK(!node->source_range().is_valid());
+    CHECK(at(document.position(*node), 0, 0));
+  }
+}
+
+} // namespace
+
+int main() {
+  test_line_table();
+  test_node_ranges();
+  test_without_positions();
+  return check_result();
+}
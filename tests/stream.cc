@@ -0,0 +1,195 @@
+// input fed in chunks has to parse the same as all at once, and in time
+// linear in its size however it is cut up
+
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/stream.hh>
+#include <osmium-html/tokenizer.hh>
+
+#include <algorithm>
+#include <coroutine>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+// markup that exercises every state that needs lookahead or input from the
+// tree builder, plus soup made of the same pieces
+std::vector<std::string> documents() {
+  std::vector<std::string> parts = {
+      "<!DOCTYPE html>", "<html>", "<head>", "<title>a &amp; b</title>",
+      "<script>if (a < b) { x = '</div>'; }</script>",
+      "<style>p > b { }</style>", "<body>", "<p class=\"x\" id=y>",
+      "text &copy; &notit; &#169; &#xA9", "<!-- comment -->", "<!---->",
+      "<![CDATA[x]]>", "<svg><![CDATA[a<b]]><title>t</title></svg>",
+      "<table><tr><td>cell</td>text</table>", "<template><td>t</template>",
+      "<textarea>\n<b></textarea>", "<pre>\n\nx</pre>", "<b><i>x</b>y</i>",
+      "<a href='/x?a=1&copy=2'>", "\xC3\xA9\xE2\x82\xAC", "</p>", "<br/>",
+      "<plaintext>", std::string("\0x", 2), "<?php x ?>", "</>",
+      "<a b c=d e='f' g=\"h\">", "<script><!--<script>a</script>b--></script>",
+      "<script><!--x-->y</script>",
+  };
+  std::vector<std::string> out = parts;
+  std::mt19937 random(1);
+  for (int i = 0; i < 300; i++) {
+    std::string document;
+    size_t length = random() % 40;
+    for (size_t j = 0; j < length; j++) {
+      document += parts[random() % parts.size()];
+    }
+    out.push_back(std::move(document));
+  }
+  return out;
+}
+
+std::string parse_in_chunks(std::string_view input, size_t chunk_size) {
+  StreamParser parser;
+  for (size_t i = 0; i < input.size(); i += chunk_size) {
+    parser.feed(input.substr(i, chunk_size));
+  }
+  return parser.finish().root()->dump(0);
+}
+
+void test_stream_parser_matches_parse_document() {
+  for (const auto &document : documents()) {
+    std::string expected = parse_document(document).root()->dump(0);
+    for (size_t chunk_size : {1, 2, 3, 7, 64}) {
+      CHECK(parse_in_chunks(document, chunk_size) == expected);
+    }
+  }
+}
+
+// a coroutine that starts right away and is resumed by the stream it reads
+struct Reader {
+  struct promise_type {
+    Reader get_return_object() {
+      return Reader(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+
+  std::coroutine_handle<promise_type> handle;
+
+  explicit Reader(std::coroutine_handle<promise_type> h) : handle(h) {}
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+  ~Reader() { handle.destroy(); }
+};
+
+// adjacent character tokens are merged, chunks may cut a run in two
+void append_token(std::vector<Token> &tokens, const Token &token) {
+  if (token.type() == TokenType::Character && !tokens.empty() &&
+      tokens.back().type() == TokenType::Character) {
+    tokens.back().data() += token.data();
+    return;
+  }
+  tokens.push_back(token);
+}
+
+bool same_tokens(const std::vector<Token> &a, const std::vector<Token> &b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](const Token &x, const Token &y) {
+                      return x.dump() == y.dump();
+                    });
+}
+
+Reader read_tokens(TokenStream &stream, std::vector<Token> &tokens,
+                   size_t &suspensions) {
+  while (true) {
+    auto next = stream.next();
+    if (!next.await_ready()) {
+      suspensions++;
+    }
+    auto token = co_await next;
+    if (!token) {
+      break;
+    }
+    append_token(tokens, *token);
+  }
+}
+
+void test_token_stream() {
+  for (const auto &document : documents()) {
+    std::vector<Token> expected;
+    for (const auto &token : Tokenizer(document).parse()) {
+      append_token(expected, token);
+    }
+
+    TokenStream stream;
+    std::vector<Token> tokens;
+    size_t suspensions = 0;
+    Reader reader = read_tokens(stream, tokens, suspensions);
+    for (size_t i = 0; i < document.size(); i += 5) {
+      stream.feed(std::string_view(document).substr(i, 5));
+    }
+    CHECK(!reader.handle.done());
+    stream.finish();
+    CHECK(reader.handle.done());
+    CHECK(same_tokens(tokens, expected));
+    // it had to wait for input, at the latest for EndOfFile
+    CHECK(suspensions > 0);
+  }
+}
+
+// the text of every character token
+class TextSink : public TokenSink {
+public:
+  void emit(Token &token) override {
+    if (token.type() == TokenType::Character) {
+      m_text += token.data();
+    }
+  }
+
+  [[nodiscard]] const std::string &text() const { return m_text; }
+
+private:
+  std::string m_text;
+};
+
+std::string tokenize_in_chunks(std::string_view input, size_t chunk_size) {
+  TextSink sink;
+  Tokenizer tokenizer(sink);
+  for (size_t i = 0; i < input.size(); i += chunk_size) {
+    tokenizer.feed(input.substr(i, chunk_size));
+  }
+  tokenizer.finish();
+  return sink.text();
+}
+
+void test_split_character_references() {
+  std::string_view input = "a&#1234;b&#x4D2;c&#1234d&amp;e";
+  std::string expected = "aӒbӒcӒd&e";
+  for (size_t chunk_size = 1; chunk_size <= input.size(); chunk_size++) {
+    CHECK(tokenize_in_chunks(input, chunk_size) == expected);
+  }
+}
+
+// the digits of a reference that doesn't end used to be read again from the
+// start with every chunk
+void test_long_numeric_character_reference() {
+  for (std::string_view prefix : {"&#", "&#x"}) {
+    std::string input = std::string(prefix) + std::string(1000000, '1') + ";x";
+    std::string text;
+    double elapsed = seconds([&] { text = tokenize_in_chunks(input, 512); });
+    // out of range, which makes it U+FFFD
+    CHECK(text == "�x");
+    // the quadratic version took over a second even optimized
+    CHECK(elapsed < 0.5);
+  }
+}
+
+} // namespace
+
+int main() {
+  test_stream_parser_matches_parse_document();
+  test_token_stream();
+  test_split_character_references();
+  test_long_numeric_character_reference();
+  return check_result();
+}
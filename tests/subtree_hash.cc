@@ -0,0 +1,166 @@
+// the hashes the parser fills in as elements are closed have to be the ones
+// computed from the finished tree, however the tree builder moved nodes
+// around after they were closed
+
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/stream.hh>
+#include <osmium-html/subtree_hash.hh>
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> documents() {
+  std::vector<std::string> parts = {
+      "<div class=a id=b>", "</div>", "<p>", "</p>", "text", " ", "&amp;",
+      "<b>", "</b>", "<i>", "</i>", "<a href=x>", "</a>", "<table>",
+      "</table>", "<tr>", "<td>", "</td>", "<template>", "</template>",
+      "<ul><li>", "<li>", "</ul>", "<html lang=en>", "<body class=x>",
+      "<select><option>", "<svg><title>t</title></svg>", "<br>", "<!-- c -->",
+      "<pre>\nx</pre>", "<form>", "</form>", "<nobr>", "<h1>", "</h2>",
+  };
+  std::vector<std::string> out = {
+      // adoption agency
+      "<b>1<p>2</b>3</p>",
+      "<a><div><a>x</a></div></a>",
+      "<b><i><u><s>x</b>y",
+      "<div><a href=x><li></a>",
+      // foster parenting
+      "<table>x<tr>y<td>z</td></tr>w</table>",
+      "<table><b>x<tr><td>y</table>z",
+      // attributes added to elements that are already in the tree
+      "<html><body><p>x</p><html id=h><body class=b>",
+      // text appended to a closed element's text node
+      "<p>a</p>b<table>c</table>",
+  };
+  std::mt19937 random(1);
+  for (int i = 0; i < 300; i++) {
+    std::string document;
+    size_t length = random() % 40;
+    for (size_t j = 0; j < length; j++) {
+      document += parts[random() % parts.size()];
+    }
+    out.push_back(std::move(document));
+  }
+  return out;
+}
+
+// post-order, so an element's children are known to be right by the time its
+// own hash is recomputed from theirs
+bool hashes_match(const Element &element) {
+  bool ok = true;
+  for (const auto &child : element.children()) {
+    if (child->is_element()) {
+      ok = hashes_match(static_cast<const Element &>(*child)) && ok;
+    }
+  }
+  return ok && element.subtree_hash() != 0 &&
+         element.subtree_hash() == compute_subtree_hash(element);
+}
+
+bool hashes_match(const Document &document) {
+  return hashes_match(static_cast<const Element &>(*document.root()));
+}
+
+const Element *first_element(const Document &document, Tag tag) {
+  std::vector<const Element *> stack = {
+      static_cast<const Element *>(document.root().get())};
+  while (!stack.empty()) {
+    const auto *element = stack.back();
+    stack.pop_back();
+    if (element->tag() == tag) {
+      return element;
+    }
+    for (const auto &child : element->children()) {
+      if (child->is_element()) {
+        stack.push_back(static_cast<const Element *>(child.get()));
+      }
+    }
+  }
+  return nullptr;
+}
+
+ParseOptions hashing() {
+  ParseOptions options;
+  options.hash_subtrees = true;
+  return options;
+}
+
+void test_parse_document() {
+  for (const auto &document : documents()) {
+    CHECK(hashes_match(parse_document(document, hashing())));
+  }
+}
+
+void test_stream_parser() {
+  for (const auto &document : documents()) {
+    StreamParser parser(hashing());
+    for (size_t i = 0; i < document.size(); i += 3) {
+      parser.feed(std::string_view(document).substr(i, 3));
+    }
+    CHECK(hashes_match(parser.finish()));
+  }
+}
+
+class CheckingSink : public SubtreeSink {
+public:
+  CheckingSink() : SubtreeSink({Tag::Div, Tag::P, Tag::Td}) {}
+
+  void subtree_complete(ElementPtr element) override {
+    m_ok = hashes_match(*element) && m_ok;
+  }
+
+  [[nodiscard]] bool ok() const { return m_ok; }
+
+private:
+  bool m_ok = true;
+};
+
+// what is handed over and what is left behind
+void test_subtree_sink() {
+  for (const auto &document : documents()) {
+    CheckingSink sink;
+    ParseOptions options = hashing();
+    options.subtree_sink = &sink;
+    CHECK(hashes_match(parse_document(document, options)));
+    CHECK(sink.ok());
+  }
+}
+
+void test_equal_subtrees() {
+  auto first = parse_document("<div a=1 b=2><p>x</p></div>", hashing());
+  auto second =
+      parse_document("<section><div b=2 a=1><p>x</p></div></section>",
+                     hashing());
+  SubtreeIndex index;
+  index.add(first, 0);
+  index.add(second, 1);
+  size_t duplicates = 0;
+  index.for_each_duplicate([&](uint64_t, auto entries) {
+    if (entries.front().element->tag() == Tag::Div) {
+      CHECK(entries.size() == 2);
+      duplicates++;
+    }
+  });
+  CHECK(duplicates == 1);
+
+  // a different attribute value
+  auto other = parse_document("<div a=1 b=3><p>x</p></div>", hashing());
+  const Element *div = first_element(other, Tag::Div);
+  CHECK(div != nullptr && index.find(*div).empty());
+}
+
+} // namespace
+
+int main() {
+  test_parse_document();
+  test_stream_parser();
+  test_subtree_sink();
+  test_equal_subtrees();
+  return check_result();
+}
@@ -0,0 +1,84 @@
+// a SubtreeSink takes the records out of the tree as they are parsed, so what
+// is left of the tree must not grow with the number of records
+
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+class Records : public SubtreeSink {
+public:
+  Records() : SubtreeSink({Tag::Div}) {}
+
+  void subtree_complete(ElementPtr element) override {
+    m_count++;
+    m_last = std::move(element);
+  }
+
+  [[nodiscard]] size_t count() const { return m_count; }
+  [[nodiscard]] const ElementPtr &last() const { return m_last; }
+
+private:
+  size_t m_count = 0;
+  ElementPtr m_last;
+};
+
+std::string records(size_t count) {
+  std::string page = "<!DOCTYPE html><html><body>\n";
+  for (size_t i = 0; i < count; i++) {
+    page += "  <div class=record>\n    <p>record " + std::to_string(i) +
+            "</p>\n  </div>\n";
+  }
+  return page + "</body></html>\n";
+}
+
+void test_memory_is_bounded_by_the_largest_record() {
+  for (auto mode :
+       {WhitespaceText::Keep, WhitespaceText::Collapse, WhitespaceText::Drop}) {
+    std::vector<size_t> usage;
+    for (size_t count : {1000, 10000, 100000}) {
+      Records sink;
+      ParseOptions options;
+      options.subtree_sink = &sink;
+      options.whitespace_text = mode;
+      auto document = parse_document(records(count), options);
+      CHECK(sink.count() == count);
+      // the source is kept, everything else has to stay the same
+      usage.push_back(document.estimate_memory_usage().total() -
+                      document.estimate_memory_usage().source);
+    }
+    CHECK(usage[1] == usage[0]);
+    CHECK(usage[2] == usage[0]);
+  }
+}
+
+void test_text_between_records() {
+  Records sink;
+  ParseOptions options;
+  options.subtree_sink = &sink;
+  auto document = parse_document(
+      "<body>a <div>1</div> \n<div>2</div>b<div>3</div>c d", options);
+  CHECK(sink.count() == 3);
+  CHECK(sink.last()->dump(0) == "- div\n    - \"3\"\n");
+  // whitespace right after a record is dropped, other text gets a node of
+  // its own instead of being merged into the text in front of the record
+  CHECK(document.root()->dump(0) == "- root\n"
+                                    "    - html\n"
+                                    "        - head\n"
+                                    "        - body\n"
+                                    "            - \"a \"\n"
+                                    "            - \"b\"\n"
+                                    "            - \"c d\"\n");
+}
+
+} // namespace
+
+int main() {
+  test_memory_is_bounded_by_the_largest_record();
+  test_text_between_records();
+  return check_result();
+}
@@ -0,0 +1,175 @@
+// TextExtractor has to come up with the text a walk of the parsed document
+// renders to, for markup the tree builder doesn't have to fix up
+
+#include "check.hh"
+
+#include <osmium-html/parser.hh>
+#include <osmium-html/text_extractor.hh>
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+bool is_whitespace(char c) {
+  return c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == ' ';
+}
+
+// the same rules as TextExtractor, applied to the tree
+class TreeText {
+public:
+  std::string render(const Document &document) {
+    walk(*document.root());
+    return m_text;
+  }
+
+private:
+  enum class Break {
+    None,
+    Space,
+    Line,
+  };
+
+  std::string m_text;
+  Break m_pending = Break::None;
+  size_t m_pre_depth = 0;
+
+  void flush_pending() {
+    if (!m_text.empty() && m_text.back() != '\n') {
+      if (m_pending == Break::Space) {
+        m_text += ' ';
+      } else if (m_pending == Break::Line) {
+        m_text += '\n';
+      }
+    }
+    m_pending = Break::None;
+  }
+
+  void text(std::string_view data) {
+    if (m_pre_depth > 0) {
+      flush_pending();
+      m_text += data;
+      return;
+    }
+    for (char c : data) {
+      if (is_whitespace(c)) {
+        if (m_pending == Break::None) {
+          m_pending = Break::Space;
+        }
+        continue;
+      }
+      flush_pending();
+      m_text += c;
+    }
+  }
+
+  void walk(const Node &node) {
+    if (!node.is_element()) {
+      text(static_cast<const TextNode &>(node).content());
+      return;
+    }
+    const auto &element = static_cast<const Element &>(node);
+    Tag tag = element.tag();
+    bool pre = false;
+    switch (tag) {
+    case Tag::Head:
+    case Tag::Script:
+    case Tag::Style:
+    case Tag::Template:
+      return;
+    case Tag::Br:
+      if (m_pending == Break::Line) {
+        flush_pending();
+      }
+      m_text += '\n';
+      m_pending = Break::None;
+      return;
+    case Tag::Td:
+    case Tag::Th:
+      if (m_pending == Break::None) {
+        m_pending = Break::Space;
+      }
+      break;
+    case Tag::Pre:
+    case Tag::Listing:
+    case Tag::Textarea:
+    case Tag::Xmp:
+      pre = true;
+      break;
+    default:
+      break;
+    }
+
+    bool block = pre || is_block_level(tag);
+    if (block) {
+      m_pending = Break::Line;
+    }
+    m_pre_depth += pre ? 1 : 0;
+    for (const auto &child : element.children()) {
+      walk(*child);
+    }
+    m_pre_depth -= pre ? 1 : 0;
+    if (block) {
+      m_pending = Break::Line;
+    }
+  }
+};
+
+std::vector<std::string> documents() {
+  std::vector<std::string> out = {
+      "<!DOCTYPE html><html><head><title>t</title><meta charset=utf-8>"
+      "<script>var x = '<p>';</script><style>p { }</style></head>"
+      "<body><h1>Title</h1><p>Some   <b>bold</b>\n text &amp; more</p>"
+      "</body></html>",
+      "<p>a</p><pre>\nx\n  y</pre><p>b</p>",
+      "<pre>\n\nkept</pre><textarea>\nt</textarea><listing>\nl</listing>",
+      "<ul><li>one</li><li>two <i>2</i></li></ul><ol><li>x</li></ol>",
+      "<table><tr><td>a</td><td>b</td></tr><tr><th>c</th></tr></table>",
+      "<div>a<br>b<br/><br>c</div><p>x</br>y</p>",
+      "<p>\n  lots\n\n  of    space  \n</p>  <div> </div> <p>end</p>",
+      "<template><p>hidden</p></template><p>shown &lt;&#169;&copy;</p>",
+      "<div><div><p>nested</p></div>text</div><blockquote>q</blockquote>",
+      "<xmp><b>raw</b></xmp><p>after</p>",
+  };
+  std::string records = "<!DOCTYPE html><html><head><title>x</title></head>"
+                        "<body>\n";
+  for (int i = 0; i < 50; i++) {
+    std::string id = std::to_string(i);
+    records += "  <div class=record>\n    <h2><a href=/" + id + ">Item " +
+               id + "</a></h2>\n    <p>Some <b>bold</b> text &amp; more" +
+               "</p>\n    <ul>\n      <li>one</li>\n    </ul>\n  </div>\n";
+  }
+  out.push_back(records + "</body></html>\n");
+  return out;
+}
+
+void test_matches_tree() {
+  TextExtractor extractor;
+  for (const auto &document : documents()) {
+    std::string expected = TreeText().render(parse_document(document));
+    std::string text(extractor.extract(document));
+    if (text != expected) {
+      std::printf("%s\nextracted:\n%s\nfrom the tree:\n%s\n",
+                  document.c_str(), text.c_str(), expected.c_str());
+    }
+    CHECK(text == expected);
+  }
+}
+
+void test_text() {
+  TextExtractor extractor;
+  CHECK(extractor.extract("<p>a  b</p><p>c</p>") == "a b\nc");
+  CHECK(extractor.extract("<pre>\n a  b</pre>") == " a  b");
+  CHECK(extractor.extract("<head><title>t</title></head>x") == "x");
+  CHECK(extractor.extract("a<br>b") == "a\nb");
+}
+
+} // namespace
+
+int main() {
+  test_matches_tree();
+  test_text();
+  return check_result();
+}